@@ -34,6 +34,7 @@ layout(set = 0, binding = 0) uniform SceneData
 struct ObjectData
 {
   mat4 model;
+  vec4 positionDequant; // Only used by tri_mesh_packed.vert
 };
 
 layout(std140, set = 1, binding = 0) readonly buffer ObjectBuffer
@@ -41,15 +42,9 @@ layout(std140, set = 1, binding = 0) readonly buffer ObjectBuffer
   ObjectData objects[];
 } objectBuffer;
 
-layout(push_constant) uniform constants
-{
-  vec4 data;
-  mat4 render_matrix;
-} PushConstants;
-
 void main()
 {
-  mat4 transform = sceneData.camera.viewproj * objectBuffer.objects[gl_BaseInstance].model;
+  mat4 transform = sceneData.camera.viewproj * objectBuffer.objects[gl_InstanceIndex].model;
   gl_Position = transform * vec4(pos, 1.0f);
   outColor = color;
 	texCoords = uv;
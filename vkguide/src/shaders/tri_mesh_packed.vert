@@ -0,0 +1,63 @@
+#version 460
+#extension GL_KHR_vulkan_glsl : enable
+
+// Quantized vertex layout, see PackedVertex
+layout(location = 0) in vec4 pos;   // snorm16, relative to the mesh bounds
+layout(location = 1) in vec2 norm;  // snorm16, octahedral encoded
+layout(location = 3) in vec2 uv;    // unorm16
+
+layout(location = 0) out vec3 outColor;
+layout(location = 1) out vec2 texCoords;
+
+struct CameraData
+{
+	mat4 view;
+	mat4 proj;
+	mat4 viewproj;
+};
+
+struct Scene
+{
+	vec4 fogColor; // w is for exponent
+	vec4 fogDistances; // x for min, y for max, zw unused.
+	vec4 ambientColor;
+	vec4 sunlightDirection; // w for sun power
+	vec4 sunlightColor;
+};
+
+layout(set = 0, binding = 0) uniform SceneData
+{
+	CameraData camera;
+	Scene scene;
+} sceneData;
+
+struct ObjectData
+{
+  mat4 model;
+  vec4 positionDequant; // xyz + pos * w
+};
+
+layout(std140, set = 1, binding = 0) readonly buffer ObjectBuffer
+{
+  ObjectData objects[];
+} objectBuffer;
+
+vec3 oct_decode(vec2 e)
+{
+  vec3 n = vec3(e.xy, 1.0f - abs(e.x) - abs(e.y));
+  if (n.z < 0.0f)
+    n.xy = (1.0f - abs(n.yx)) * vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+  return normalize(n);
+}
+
+void main()
+{
+  ObjectData object = objectBuffer.objects[gl_InstanceIndex];
+  vec3 position = object.positionDequant.xyz + pos.xyz * object.positionDequant.w;
+
+  mat4 transform = sceneData.camera.viewproj * object.model;
+  gl_Position = transform * vec4(position, 1.0f);
+  // The packed layout has no debug color, use the normal like the loader does for full vertices
+  outColor = oct_decode(norm);
+	texCoords = uv;
+}
@@ -73,6 +73,26 @@ void VulkanEngine::run()
           constrainMouse ^= 1;
           SDL_SetRelativeMouseMode(constrainMouse ? SDL_TRUE : SDL_FALSE);
         }
+        else if (e.key.keysym.sym == SDLK_LEFTBRACKET)
+          basicRenderer.lodErrorThreshold *= .5f;
+        else if (e.key.keysym.sym == SDLK_RIGHTBRACKET)
+          basicRenderer.lodErrorThreshold *= 2.f;
+        else if (e.key.keysym.sym == SDLK_o && basicRenderer.supports_gpu_culling())
+          basicRenderer.occlusionCulling = !basicRenderer.occlusionCulling;
+        else if (e.key.keysym.sym == SDLK_i)
+          basicRenderer.indirectDraws = !basicRenderer.indirectDraws;
+        else if (e.key.keysym.sym == SDLK_v)
+          basicRenderer.bvhCulling = !basicRenderer.bvhCulling;
+        else if (e.key.keysym.sym == SDLK_c)
+          basicRenderer.cpuCulling = !basicRenderer.cpuCulling;
+        else if (e.key.keysym.sym == SDLK_b)
+        {
+          // The last step fills the scene up to MaxObjects
+          constexpr uint32_t benchmarkObjects[] = { 0, 10000, 50000, MaxObjects };
+          benchmarkStep = (benchmarkStep + 1) % std::size(benchmarkObjects);
+          basicRenderer.set_benchmark_objects(benchmarkObjects[benchmarkStep]);
+          basicRenderer.compare_culling();
+        }
       } break;
       case SDL_MOUSEMOTION: {
         if (constrainMouse && SDL_GetWindowFlags(window.window) & SDL_WindowFlags::SDL_WINDOW_INPUT_FOCUS)
@@ -126,7 +146,12 @@ void VulkanEngine::run()
 
     if (time > 1.0)
     {
-      window.set_window_title(fmt::format("{}: {} fps ({:.4}ms)", name, (int)(1.0 / frametime), frametime * 1000));
+      const FrameStats& stats = basicRenderer.get_stats();
+      window.set_window_title(fmt::format("{}: {} fps ({:.4}ms, {:.3}ms recording, {:.3}ms culling) | {} draws ({} instances), {} binds ({} unsorted), {} tris, {}/{} meshlets | {}/{} visible ({:.1f}% culled, {} occluded, {} late) | LOD {}px tris {}/{}/{}/{} | {} streaming, {} dropped", name, (int)(1.0 / frametime), frametime * 1000, stats.recordMs, stats.cullMs,
+        stats.drawCalls, stats.instances, stats.binds.total(), stats.unsortedBinds.total(), stats.triangles, stats.meshletsVisible, stats.meshletsTotal,
+        stats.cullVisible, stats.cullTested, stats.cullTested ? 100.0 * (stats.cullTested - stats.cullVisible) / stats.cullTested : 0.0, stats.cullOccluded,
+        stats.lateDraws, basicRenderer.lodErrorThreshold,
+        stats.lodTriangles[0], stats.lodTriangles[1], stats.lodTriangles[2], stats.lodTriangles[3], stats.objectsStreaming, stats.drawsDropped));
       time = 0.0;
     }
   }
@@ -25,4 +25,7 @@ private:
   bool constrainMouse = false;
   
   double frametime = 0.016;
+
+  // Index into the object counts B cycles through, see VulkanRenderer::set_benchmark_objects
+  uint32_t benchmarkStep = 0;
 };
\ No newline at end of file
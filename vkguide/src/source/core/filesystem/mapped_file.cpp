@@ -0,0 +1,124 @@
+#include <pch.hpp>
+#include "mapped_file.hpp"
+
+#ifdef _WIN32
+  #define WIN32_LEAN_AND_MEAN
+  #define NOMINMAX
+  #include <Windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+  close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+  *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+  if (this != &other)
+  {
+    close();
+
+    std::swap(mapped, other.mapped);
+    std::swap(mappedSize, other.mappedSize);
+#ifdef _WIN32
+    std::swap(fileHandle, other.fileHandle);
+    std::swap(mappingHandle, other.mappingHandle);
+#else
+    std::swap(fileDescriptor, other.fileDescriptor);
+#endif
+  }
+
+  return *this;
+}
+
+bool MappedFile::open(const std::string& filePath)
+{
+  close();
+
+#ifdef _WIN32
+  HANDLE file = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+  {
+    CloseHandle(file);
+    return false;
+  }
+
+  HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!mapping)
+  {
+    CloseHandle(file);
+    return false;
+  }
+
+  void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!view)
+  {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return false;
+  }
+
+  fileHandle = file;
+  mappingHandle = mapping;
+  mappedSize = (size_t)fileSize.QuadPart;
+#else
+  int fd = ::open(filePath.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0)
+  {
+    ::close(fd);
+    return false;
+  }
+
+  void* view = mmap(nullptr, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (view == MAP_FAILED)
+  {
+    ::close(fd);
+    return false;
+  }
+
+  fileDescriptor = fd;
+  mappedSize = (size_t)fileStat.st_size;
+#endif
+
+  mapped = static_cast<const unsigned char*>(view);
+  return true;
+}
+
+void MappedFile::close()
+{
+  if (!mapped)
+    return;
+
+#ifdef _WIN32
+  UnmapViewOfFile(mapped);
+  CloseHandle(mappingHandle);
+  CloseHandle(fileHandle);
+  mappingHandle = nullptr;
+  fileHandle = nullptr;
+#else
+  munmap(const_cast<unsigned char*>(mapped), mappedSize);
+  ::close(fileDescriptor);
+  fileDescriptor = -1;
+#endif
+
+  mapped = nullptr;
+  mappedSize = 0;
+}
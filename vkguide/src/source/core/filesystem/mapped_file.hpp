@@ -0,0 +1,40 @@
+#pragma once
+
+// Read only memory mapping of a whole file. The mapping lives as long as the object does.
+class MappedFile
+{
+public:
+  MappedFile() = default;
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  MappedFile(MappedFile&& other) noexcept;
+  MappedFile& operator=(MappedFile&& other) noexcept;
+
+  [[nodiscard]]
+  bool open(const std::string& filePath);
+
+  void close();
+
+  [[nodiscard]]
+  const unsigned char* data() const { return mapped; }
+
+  [[nodiscard]]
+  size_t size() const { return mappedSize; }
+
+  [[nodiscard]]
+  bool is_open() const { return mapped != nullptr; }
+
+private:
+  const unsigned char* mapped = nullptr;
+  size_t mappedSize = 0;
+
+#ifdef _WIN32
+  void* fileHandle = nullptr;
+  void* mappingHandle = nullptr;
+#else
+  int fileDescriptor = -1;
+#endif
+};
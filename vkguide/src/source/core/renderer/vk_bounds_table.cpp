@@ -0,0 +1,157 @@
+#include <pch.hpp>
+#include "vk_bounds_table.hpp"
+
+#include "core/renderer/vk_bounds_table_avx2.hpp"
+#include "core/threading/thread_pool.hpp"
+
+#include <bit>
+
+// SSE is part of every x64 target, AVX2 is only used when the kernel was built (VKGUIDE_AVX2 in CMake) and the
+// CPU has it
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define VKGUIDE_CULL_SSE
+#if defined(VKGUIDE_AVX2)
+#define VKGUIDE_CULL_AVX2
+#endif
+#endif
+
+#if defined(VKGUIDE_CULL_AVX2) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(VKGUIDE_CULL_AVX2)
+namespace
+{
+  bool cpu_has_avx2()
+  {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+      return false;
+
+    // AVX needs the OS to save the YMM registers too, OSXSAVE and XCR0 tell whether it does
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+      return false;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+  }
+}
+#endif
+
+uint32_t BoundsTable::push(const glm::vec3& center, float radius)
+{
+  if (count == centerX.size())
+  {
+    const size_t padded = centerX.size() + 8;
+    centerX.resize(padded);
+    centerY.resize(padded);
+    centerZ.resize(padded);
+    this->radius.resize(padded);
+  }
+
+  centerX[count] = center.x;
+  centerY[count] = center.y;
+  centerZ[count] = center.z;
+  this->radius[count] = radius;
+
+  return count++;
+}
+
+void BoundsTable::cull(const Frustum& frustum, std::vector<uint32_t>& visible, ThreadPool* workers) const
+{
+  if (!workers || workers->get_thread_count() == 0 || count < ParallelCullMinSpheres)
+  {
+    cull_range(frustum, 0, count, visible);
+    return;
+  }
+
+  // Every chunk fills its own list, appended in chunk order so the indices stay ascending
+  const uint32_t chunkCount = (count + ParallelCullChunkSpheres - 1) / ParallelCullChunkSpheres;
+  std::vector<std::vector<uint32_t>> chunkVisible(chunkCount);
+
+  std::latch done{ (ptrdiff_t)chunkCount - 1 };
+  for (uint32_t chunk = 1; chunk < chunkCount; ++chunk)
+  {
+    workers->submit([&, chunk] {
+      cull_range(frustum, chunk * ParallelCullChunkSpheres, std::min(count, (chunk + 1) * ParallelCullChunkSpheres), chunkVisible[chunk]);
+      done.count_down();
+    });
+  }
+
+  // The calling thread takes the first chunk instead of idling
+  cull_range(frustum, 0, ParallelCullChunkSpheres, chunkVisible[0]);
+  done.wait();
+
+  for (const std::vector<uint32_t>& chunk : chunkVisible)
+    visible.insert(visible.end(), chunk.begin(), chunk.end());
+}
+
+// cull_spheres_avx2 reads the planes as plain floats
+static_assert(sizeof(Frustum) == 6 * 4 * sizeof(float), "Frustum planes have to be tightly packed xyzw floats");
+
+void BoundsTable::cull_range(const Frustum& frustum, uint32_t first, uint32_t last, std::vector<uint32_t>& visible) const
+{
+  // A sphere is outside once it is entirely behind one plane: dot(normal, center) + d < -radius
+#if defined(VKGUIDE_CULL_AVX2)
+  static const bool avx2 = cpu_has_avx2();
+  if (avx2)
+  {
+    const size_t offset = visible.size();
+    visible.resize(offset + (last - first));
+    visible.resize(offset + cull_spheres_avx2(&frustum.planes[0].x, centerX.data(), centerY.data(), centerZ.data(), radius.data(), first, last, visible.data() + offset));
+    return;
+  }
+#endif
+
+#if defined(VKGUIDE_CULL_SSE)
+  __m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+  for (int p = 0; p < 6; ++p)
+  {
+    planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+    planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+    planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+    planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+  }
+
+  for (uint32_t i = first; i < last; i += 4)
+  {
+    const __m128 x = _mm_loadu_ps(&centerX[i]);
+    const __m128 y = _mm_loadu_ps(&centerY[i]);
+    const __m128 z = _mm_loadu_ps(&centerZ[i]);
+    const __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&radius[i]));
+
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (int p = 0; p < 6; ++p)
+    {
+      const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)),
+        _mm_add_ps(_mm_mul_ps(planeZ[p], z), planeW[p]));
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+    }
+
+    uint32_t mask = (uint32_t)_mm_movemask_ps(inside);
+    if (last - i < 4)
+      mask &= (1u << (last - i)) - 1;
+
+    while (mask)
+    {
+      visible.push_back(i + std::countr_zero(mask));
+      mask &= mask - 1;
+    }
+  }
+#else
+  for (uint32_t i = first; i < last; ++i)
+  {
+    if (sphere_in_frustum(frustum, glm::vec3{ centerX[i], centerY[i], centerZ[i] }, radius[i]))
+      visible.push_back(i);
+  }
+#endif
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "core/renderer/vk_frustum.hpp"
+
+class ThreadPool;
+
+// Tables at least this large are culled in chunks spread over worker threads
+constexpr uint32_t ParallelCullMinSpheres = 16384;
+constexpr uint32_t ParallelCullChunkSpheres = 4096;
+
+// World space bounding spheres as a structure of arrays, so the frustum test runs on 8 spheres at once with
+// AVX2, on CPUs that have it, and 4 with SSE. The arrays are kept padded to a multiple of 8, lanes past the last sphere are masked off.
+class BoundsTable
+{
+public:
+  void clear() { count = 0; }
+
+  // Returns the index the sphere is reported under
+  uint32_t push(const glm::vec3& center, float radius);
+
+  // Appends the indices of the spheres touching the frustum to visible, in ascending order. Large tables are
+  // split over workers if any are given.
+  void cull(const Frustum& frustum, std::vector<uint32_t>& visible, ThreadPool* workers = nullptr) const;
+
+  [[nodiscard]]
+  uint32_t size() const { return count; }
+
+private:
+  // first is a multiple of 8
+  void cull_range(const Frustum& frustum, uint32_t first, uint32_t last, std::vector<uint32_t>& visible) const;
+
+  std::vector<float> centerX;
+  std::vector<float> centerY;
+  std::vector<float> centerZ;
+  std::vector<float> radius;
+  uint32_t count = 0;
+};
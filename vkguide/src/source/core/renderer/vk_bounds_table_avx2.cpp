@@ -0,0 +1,53 @@
+// No precompiled header, see SKIP_PRECOMPILE_HEADERS in CMakeLists.txt
+#include "vk_bounds_table_avx2.hpp"
+
+// Built with AVX2 enabled when VKGUIDE_AVX2 is on, BoundsTable only calls into it on CPUs that have it.
+// Nothing inline from other headers may be used here: the linker keeps one copy of each inline function, and it
+// could pick the AVX2 one for the whole executable. That keeps glm and the standard library out, the planes come
+// in as plain floats.
+#if defined(VKGUIDE_AVX2)
+#include <immintrin.h>
+
+uint32_t cull_spheres_avx2(const float* planes, const float* centerX, const float* centerY, const float* centerZ, const float* radius,
+  uint32_t first, uint32_t last, uint32_t* out)
+{
+  uint32_t written = 0;
+
+  __m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+  for (int p = 0; p < 6; ++p)
+  {
+    planeX[p] = _mm256_set1_ps(planes[p * 4 + 0]);
+    planeY[p] = _mm256_set1_ps(planes[p * 4 + 1]);
+    planeZ[p] = _mm256_set1_ps(planes[p * 4 + 2]);
+    planeW[p] = _mm256_set1_ps(planes[p * 4 + 3]);
+  }
+
+  for (uint32_t i = first; i < last; i += 8)
+  {
+    const __m256 x = _mm256_loadu_ps(&centerX[i]);
+    const __m256 y = _mm256_loadu_ps(&centerY[i]);
+    const __m256 z = _mm256_loadu_ps(&centerZ[i]);
+    const __m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&radius[i]));
+
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (int p = 0; p < 6; ++p)
+    {
+      const __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[p], x), _mm256_mul_ps(planeY[p], y)),
+        _mm256_add_ps(_mm256_mul_ps(planeZ[p], z), planeW[p]));
+      inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negRadius, _CMP_GE_OQ));
+    }
+
+    uint32_t mask = (uint32_t)_mm256_movemask_ps(inside);
+    if (last - i < 8)
+      mask &= (1u << (last - i)) - 1;
+
+    for (uint32_t lane = 0; mask != 0; ++lane, mask >>= 1)
+    {
+      if (mask & 1)
+        out[written++] = i + lane;
+    }
+  }
+
+  return written;
+}
+#endif
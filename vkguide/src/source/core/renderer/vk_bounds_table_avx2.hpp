@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstdint>
+
+// BoundsTable::cull_range 8 spheres at a time, in a translation unit of its own built for AVX2. planes holds the
+// frustum's six planes as xyzw. Writes the indices of the spheres in [first, last) touching the frustum to out,
+// which has room for all of them, and returns how many it wrote.
+// Only plain types cross this header, so the kernel's translation unit never sees glm or the standard library.
+uint32_t cull_spheres_avx2(const float* planes, const float* centerX, const float* centerY, const float* centerZ, const float* radius,
+  uint32_t first, uint32_t last, uint32_t* out);
@@ -0,0 +1,244 @@
+#include <pch.hpp>
+#include "vk_depth_pyramid.hpp"
+
+#include "core/renderer/vk_initializers.hpp"
+
+#include <bit>
+
+bool DepthPyramid::init(VkDevice device, VmaAllocator allocator, VkImageView depthView, VkExtent2D depthExtent)
+{
+  VkShaderModule pyramidShader;
+  if (!vkinit::load_shader_module("shaders/depth_pyramid.comp.spv", device, pyramidShader))
+  {
+    std::cout << "Failed to build depth pyramid compute shader\n";
+    return false;
+  }
+
+  this->device = device;
+  this->allocator = allocator;
+
+  // Rounding down keeps every level exactly half of the one below
+  extent = VkExtent2D{ std::bit_floor(depthExtent.width), std::bit_floor(depthExtent.height) };
+  levelCount = std::bit_width(std::max(extent.width, extent.height));
+
+  VkImageCreateInfo imageInfo = vkinit::image_create_info(VK_FORMAT_R32_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+    VkExtent3D{ extent.width, extent.height, 1 }, levelCount);
+
+  VmaAllocationCreateInfo allocInfo{
+    .usage = VMA_MEMORY_USAGE_GPU_ONLY,
+    .requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+  };
+
+  VK_CHECK(vmaCreateImage(allocator, &imageInfo, &allocInfo, &image.image, &image.alloc, nullptr));
+  image.format = VK_FORMAT_R32_SFLOAT;
+  image.mipLevels = levelCount;
+
+  VkImageViewCreateInfo viewInfo = vkinit::image_view_create_info(VK_FORMAT_R32_SFLOAT, image.image, VK_IMAGE_ASPECT_COLOR_BIT, levelCount);
+  VK_CHECK(vkCreateImageView(device, &viewInfo, nullptr, &view));
+
+  levelViews.resize(levelCount);
+  for (uint32_t level = 0; level < levelCount; ++level)
+  {
+    VkImageViewCreateInfo levelInfo = vkinit::image_view_create_info(VK_FORMAT_R32_SFLOAT, image.image, VK_IMAGE_ASPECT_COLOR_BIT);
+    levelInfo.subresourceRange.baseMipLevel = level;
+    VK_CHECK(vkCreateImageView(device, &levelInfo, nullptr, &levelViews[level]));
+  }
+
+  // Only texelFetch reads the pyramid, the sampler never filters
+  VkSamplerCreateInfo samplerInfo = vkinit::sampler_create_info(VK_FILTER_NEAREST, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+  VK_CHECK(vkCreateSampler(device, &samplerInfo, nullptr, &sampler));
+
+  VkDescriptorSetLayoutBinding bindings[2] = {
+    vkinit::descriptor_set_layout_binding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+    vkinit::descriptor_set_layout_binding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+  };
+
+  VkDescriptorSetLayoutCreateInfo setInfo{
+    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+    .pNext = nullptr,
+
+    .flags = 0,
+    .bindingCount = 2,
+    .pBindings = bindings,
+  };
+
+  VK_CHECK(vkCreateDescriptorSetLayout(device, &setInfo, nullptr, &setLayout));
+
+  VkDescriptorPoolSize poolSizes[2] = {
+    { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, levelCount },
+    { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, levelCount },
+  };
+
+  VkDescriptorPoolCreateInfo poolInfo{
+    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+    .pNext = nullptr,
+
+    .flags = 0,
+    .maxSets = levelCount,
+    .poolSizeCount = 2,
+    .pPoolSizes = poolSizes,
+  };
+
+  VK_CHECK(vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool));
+
+  levelSets.resize(levelCount);
+  for (uint32_t level = 0; level < levelCount; ++level)
+  {
+    VkDescriptorSetAllocateInfo setAllocInfo{
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+      .pNext = nullptr,
+
+      .descriptorPool = descriptorPool,
+      .descriptorSetCount = 1,
+      .pSetLayouts = &setLayout
+    };
+
+    VK_CHECK(vkAllocateDescriptorSets(device, &setAllocInfo, &levelSets[level]));
+
+    VkDescriptorImageInfo sourceInfo{
+      .sampler = sampler,
+      .imageView = level == 0 ? depthView : levelViews[level - 1],
+      .imageLayout = level == 0 ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL
+    };
+
+    VkDescriptorImageInfo destinationInfo{
+      .sampler = VK_NULL_HANDLE,
+      .imageView = levelViews[level],
+      .imageLayout = VK_IMAGE_LAYOUT_GENERAL
+    };
+
+    VkWriteDescriptorSet writes[2] = {
+      vkinit::write_descriptor_image(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, levelSets[level], &sourceInfo, 0),
+      vkinit::write_descriptor_image(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, levelSets[level], &destinationInfo, 1),
+    };
+
+    vkUpdateDescriptorSets(device, 2, writes, 0, nullptr);
+  }
+
+  auto layoutInfo = vkinit::pipeline_layout_create_info();
+  layoutInfo.pSetLayouts = &setLayout;
+  layoutInfo.setLayoutCount = 1;
+
+  VK_CHECK(vkCreatePipelineLayout(device, &layoutInfo, nullptr, &layout));
+
+  VkComputePipelineCreateInfo pipelineInfo{
+    .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+    .pNext = nullptr,
+
+    .flags = 0,
+    .stage = vkinit::shader_stage_create_info(VK_SHADER_STAGE_COMPUTE_BIT, pyramidShader),
+    .layout = layout,
+  };
+
+  VK_CHECK(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline));
+
+  vkDestroyShaderModule(device, pyramidShader, nullptr);
+
+  std::cout << fmt::format("Depth pyramid is {}x{} with {} levels\n", extent.width, extent.height, levelCount);
+  return true;
+}
+
+void DepthPyramid::record_clear(VkCommandBuffer cmd)
+{
+  const VkImageSubresourceRange levels{
+    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+    .baseMipLevel = 0,
+    .levelCount = levelCount,
+    .baseArrayLayer = 0,
+    .layerCount = 1,
+  };
+
+  VkImageMemoryBarrier toGeneral{
+    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+    .pNext = nullptr,
+
+    .srcAccessMask = 0,
+    .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+
+    .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+
+    .image = image.image,
+    .subresourceRange = levels
+  };
+
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &toGeneral);
+
+  const VkClearColorValue farPlane{ .float32 = { 1.f, 1.f, 1.f, 1.f } };
+  vkCmdClearColorImage(cmd, image.image, VK_IMAGE_LAYOUT_GENERAL, &farPlane, 1, &levels);
+
+  VkImageMemoryBarrier cleared = toGeneral;
+  cleared.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  cleared.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  cleared.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &cleared);
+}
+
+void DepthPyramid::build(VkCommandBuffer cmd)
+{
+  VkImageMemoryBarrier levelBarrier{
+    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+    .pNext = nullptr,
+
+    // Culling read the previous build, those reads have to finish before it is overwritten
+    .srcAccessMask = 0,
+    .dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+
+    .oldLayout = VK_IMAGE_LAYOUT_GENERAL,
+    .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+
+    .image = image.image,
+    .subresourceRange{
+      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .baseMipLevel = 0,
+      .levelCount = levelCount,
+      .baseArrayLayer = 0,
+      .layerCount = 1,
+    }
+  };
+
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &levelBarrier);
+
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+  // Every level reads the one written before it
+  levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  levelBarrier.subresourceRange.levelCount = 1;
+
+  for (uint32_t level = 0; level < levelCount; ++level)
+  {
+    const uint32_t width = std::max(extent.width >> level, 1u);
+    const uint32_t height = std::max(extent.height >> level, 1u);
+
+    // 8x8 matches the local size in depth_pyramid.comp
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, layout, 0, 1, &levelSets[level], 0, nullptr);
+    vkCmdDispatch(cmd, (width + 7) / 8, (height + 7) / 8, 1);
+
+    levelBarrier.subresourceRange.baseMipLevel = level;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &levelBarrier);
+  }
+}
+
+void DepthPyramid::cleanup()
+{
+  vkDestroyPipeline(device, pipeline, nullptr);
+  vkDestroyPipelineLayout(device, layout, nullptr);
+  vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+  vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+  vkDestroySampler(device, sampler, nullptr);
+
+  for (VkImageView levelView : levelViews)
+    vkDestroyImageView(device, levelView, nullptr);
+  levelViews.clear();
+
+  vkDestroyImageView(device, view, nullptr);
+  vmaDestroyImage(allocator, image.image, image.alloc);
+}
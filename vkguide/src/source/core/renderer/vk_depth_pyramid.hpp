@@ -0,0 +1,51 @@
+#pragma once
+
+#include "core/renderer/vk_types.hpp"
+
+// Mip chain over a depth image where every texel holds the farthest depth under it, built in compute. A sphere
+// whose nearest depth lies behind the pyramid texels its screen rectangle touches is hidden.
+// The pyramid is the depth image's size rounded down to a power of two and stays in VK_IMAGE_LAYOUT_GENERAL.
+// Only GpuCuller reads it, so occlusion culling covers whole draws. Meshlets are frustum and cone culled on the
+// CPU path alone, which never sees the pyramid.
+class DepthPyramid
+{
+public:
+  // Returns false without creating anything if the build shader is missing
+  [[nodiscard]]
+  bool init(VkDevice device, VmaAllocator allocator, VkImageView depthView, VkExtent2D depthExtent);
+
+  // Clears every level to the far plane so nothing counts as hidden before the first build
+  void record_clear(VkCommandBuffer cmd);
+
+  // Reads the depth image in VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, its writes have to be visible to
+  // compute already. Leaves the pyramid visible to compute shaders.
+  void build(VkCommandBuffer cmd);
+
+  [[nodiscard]]
+  VkImageView get_view() const { return view; }
+
+  [[nodiscard]]
+  VkSampler get_sampler() const { return sampler; }
+
+  [[nodiscard]]
+  uint32_t get_level_count() const { return levelCount; }
+
+  void cleanup();
+
+private:
+  VkDevice device;
+  VmaAllocator allocator;
+
+  AllocatedImage image;
+  VkImageView view;                    // Every level, read by culling
+  std::vector<VkImageView> levelViews; // One per level, written by the build and read by the next level
+  VkExtent2D extent;
+  uint32_t levelCount = 0;
+
+  VkSampler sampler;
+  VkDescriptorSetLayout setLayout;
+  VkDescriptorPool descriptorPool;
+  std::vector<VkDescriptorSet> levelSets;
+  VkPipelineLayout layout;
+  VkPipeline pipeline;
+};
@@ -0,0 +1,39 @@
+#include <pch.hpp>
+#include "vk_frustum.hpp"
+
+Frustum extract_frustum(const glm::mat4& viewproj)
+{
+  // Gribb/Hartmann, glm is column major so row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+  auto row = [&viewproj](int i) {
+    return glm::vec4{ viewproj[0][i], viewproj[1][i], viewproj[2][i], viewproj[3][i] };
+  };
+
+  const glm::vec4 r0 = row(0), r1 = row(1), r2 = row(2), r3 = row(3);
+
+  Frustum frustum{
+    .planes = {
+      r3 + r0, // left
+      r3 - r0, // right
+      r3 + r1, // bottom (top once y is flipped for vulkan, doesn't matter here)
+      r3 - r1, // top
+      r2,      // near, depth is 0..1
+      r3 - r2, // far
+    }
+  };
+
+  for (glm::vec4& plane : frustum.planes)
+    plane /= glm::length(glm::vec3{ plane.x, plane.y, plane.z });
+
+  return frustum;
+}
+
+bool sphere_in_frustum(const Frustum& frustum, const glm::vec3& center, float radius)
+{
+  for (const glm::vec4& plane : frustum.planes)
+  {
+    if (plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w < -radius)
+      return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+// Six planes (xyz normal pointing inwards, w distance), normalized so distances are in world units
+struct Frustum
+{
+  glm::vec4 planes[6];
+};
+
+// Extracts the frustum of a (model)viewproj matrix with a 0..1 depth range. Passing viewproj * model
+// yields the frustum in that model's object space.
+[[nodiscard]]
+Frustum extract_frustum(const glm::mat4& viewproj);
+
+[[nodiscard]]
+bool sphere_in_frustum(const Frustum& frustum, const glm::vec3& center, float radius);
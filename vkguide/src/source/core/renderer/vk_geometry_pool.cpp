@@ -0,0 +1,149 @@
+#include <pch.hpp>
+#include "vk_geometry_pool.hpp"
+
+void RangeAllocator::init(VkDeviceSize size)
+{
+  freeRanges.clear();
+  freeRanges.emplace(0, size);
+  freeBytes = size;
+}
+
+std::optional<VkDeviceSize> RangeAllocator::allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+  if (size == 0)
+    return std::nullopt;
+
+  for (auto iter = freeRanges.begin(); iter != freeRanges.end(); ++iter)
+  {
+    const auto [rangeOffset, rangeSize] = *iter;
+
+    const VkDeviceSize offset = (rangeOffset + alignment - 1) / alignment * alignment;
+    const VkDeviceSize padding = offset - rangeOffset;
+    if (padding + size > rangeSize)
+      continue;
+
+    // Split the range: the alignment padding stays free in front, the remainder behind
+    freeRanges.erase(iter);
+    if (padding > 0)
+      freeRanges.emplace(rangeOffset, padding);
+    if (padding + size < rangeSize)
+      freeRanges.emplace(offset + size, rangeSize - padding - size);
+
+    freeBytes -= size;
+    return offset;
+  }
+
+  return std::nullopt;
+}
+
+void RangeAllocator::free(VkDeviceSize offset, VkDeviceSize size)
+{
+  if (size == 0)
+    return;
+
+  freeBytes += size;
+
+  auto next = freeRanges.lower_bound(offset);
+
+  // Merge with the free range right behind
+  if (next != freeRanges.end() && offset + size == next->first)
+  {
+    size += next->second;
+    next = freeRanges.erase(next);
+  }
+
+  // And with the one right in front
+  if (next != freeRanges.begin())
+  {
+    auto prev = std::prev(next);
+    if (prev->first + prev->second == offset)
+    {
+      prev->second += size;
+      return;
+    }
+  }
+
+  freeRanges.emplace_hint(next, offset, size);
+}
+
+void GeometryPool::init(VmaAllocator allocator, VkDeviceSize vertexCapacity, VkDeviceSize indexCapacity, bool hostVisible)
+{
+  VmaAllocationCreateInfo gpuAllocInfo{
+    .flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT,
+    .usage = VMA_MEMORY_USAGE_AUTO
+  };
+
+  if (hostVisible)
+  {
+    gpuAllocInfo.flags |= VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+    gpuAllocInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+  }
+
+  VkBufferCreateInfo vertexBufferInfo{
+    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+    .pNext = nullptr,
+
+    .size = vertexCapacity,
+    .usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
+  };
+
+  VmaAllocationInfo vertexAllocation;
+  VK_CHECK(vmaCreateBuffer(allocator, &vertexBufferInfo, &gpuAllocInfo, &vertexBuffer.buffer, &vertexBuffer.alloc, &vertexAllocation));
+
+  VkBufferCreateInfo indexBufferInfo{
+    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+    .pNext = nullptr,
+
+    .size = indexCapacity,
+    .usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
+  };
+
+  VmaAllocationInfo indexAllocation;
+  VK_CHECK(vmaCreateBuffer(allocator, &indexBufferInfo, &gpuAllocInfo, &indexBuffer.buffer, &indexBuffer.alloc, &indexAllocation));
+
+  vertexData = (uint8_t*)vertexAllocation.pMappedData;
+  indexData = (uint8_t*)indexAllocation.pMappedData;
+
+  vertexRanges.init(vertexCapacity);
+  indexRanges.init(indexCapacity);
+}
+
+std::optional<GeometryRange> GeometryPool::allocate_vertices(VkDeviceSize size, VkDeviceSize stride)
+{
+  std::optional<VkDeviceSize> offset = vertexRanges.allocate(size, stride);
+  if (!offset)
+    return std::nullopt;
+
+  return GeometryRange{ .offset = *offset, .size = size };
+}
+
+std::optional<GeometryRange> GeometryPool::allocate_indices(VkDeviceSize size, VkDeviceSize indexSize)
+{
+  std::optional<VkDeviceSize> offset = indexRanges.allocate(size, indexSize);
+  if (!offset)
+    return std::nullopt;
+
+  return GeometryRange{ .offset = *offset, .size = size };
+}
+
+void GeometryPool::free_vertices(const GeometryRange& range)
+{
+  vertexRanges.free(range.offset, range.size);
+}
+
+void GeometryPool::free_indices(const GeometryRange& range)
+{
+  indexRanges.free(range.offset, range.size);
+}
+
+void GeometryPool::flush(VmaAllocator allocator, const GeometryRange& vertexRange, const GeometryRange& indexRange)
+{
+  vmaFlushAllocation(allocator, vertexBuffer.alloc, vertexRange.offset, vertexRange.size);
+  vmaFlushAllocation(allocator, indexBuffer.alloc, indexRange.offset, indexRange.size);
+}
+
+void GeometryPool::cleanup(VmaAllocator allocator)
+{
+  vmaDestroyBuffer(allocator, vertexBuffer.buffer, vertexBuffer.alloc);
+  vmaDestroyBuffer(allocator, indexBuffer.buffer, indexBuffer.alloc);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "core/renderer/vk_types.hpp"
+
+// Offset allocator over a fixed size range. First fit over the free ranges, which are kept sorted by
+// offset so freeing merges a range with its neighbours straight away.
+class RangeAllocator
+{
+public:
+  void init(VkDeviceSize size);
+
+  // Offset of size bytes aligned to alignment (any value, not just powers of two), nullopt if nothing fits
+  [[nodiscard]]
+  std::optional<VkDeviceSize> allocate(VkDeviceSize size, VkDeviceSize alignment);
+
+  void free(VkDeviceSize offset, VkDeviceSize size);
+
+  [[nodiscard]]
+  VkDeviceSize get_free_bytes() const { return freeBytes; }
+
+  [[nodiscard]]
+  size_t get_free_range_count() const { return freeRanges.size(); }
+
+private:
+  std::map<VkDeviceSize, VkDeviceSize> freeRanges; // offset -> size
+  VkDeviceSize freeBytes = 0;
+};
+
+// Byte range of a GeometryPool buffer
+struct GeometryRange
+{
+  VkDeviceSize offset = 0;
+  VkDeviceSize size = 0;
+};
+
+// One device local vertex buffer and one index buffer that every mesh is suballocated from, so drawing
+// any mesh needs no rebinding and the whole scene can go through indirect draws later on.
+// Vertex ranges are aligned to their stride and index ranges to their index size, so a range's offset
+// divided by those is the vertexOffset / firstIndex of a draw into the shared buffers.
+// With hostVisible the buffers are persistently mapped, meshes are then written into them straight from the CPU.
+class GeometryPool
+{
+public:
+  void init(VmaAllocator allocator, VkDeviceSize vertexCapacity, VkDeviceSize indexCapacity, bool hostVisible);
+
+  [[nodiscard]]
+  std::optional<GeometryRange> allocate_vertices(VkDeviceSize size, VkDeviceSize stride);
+
+  [[nodiscard]]
+  std::optional<GeometryRange> allocate_indices(VkDeviceSize size, VkDeviceSize indexSize);
+
+  void free_vertices(const GeometryRange& range);
+  void free_indices(const GeometryRange& range);
+
+  [[nodiscard]]
+  VkBuffer get_vertex_buffer() const { return vertexBuffer.buffer; }
+
+  [[nodiscard]]
+  VkBuffer get_index_buffer() const { return indexBuffer.buffer; }
+
+  // Mapped buffers, null unless the pool was created host visible
+  [[nodiscard]]
+  uint8_t* get_vertex_data() const { return vertexData; }
+
+  [[nodiscard]]
+  uint8_t* get_index_data() const { return indexData; }
+
+  // Makes CPU writes to the ranges visible to the device, no-op on host coherent memory
+  void flush(VmaAllocator allocator, const GeometryRange& vertexRange, const GeometryRange& indexRange);
+
+  void cleanup(VmaAllocator allocator);
+
+private:
+  AllocatedBuffer vertexBuffer;
+  AllocatedBuffer indexBuffer;
+  uint8_t* vertexData = nullptr;
+  uint8_t* indexData = nullptr;
+
+  RangeAllocator vertexRanges;
+  RangeAllocator indexRanges;
+};
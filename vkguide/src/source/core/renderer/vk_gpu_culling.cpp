@@ -0,0 +1,311 @@
+#include <pch.hpp>
+#include "vk_gpu_culling.hpp"
+
+#include "core/renderer/vk_initializers.hpp"
+
+bool GpuCuller::init(VkDevice device, VmaAllocator allocator, const std::vector<VkBuffer>& objectBuffers, VkImageView pyramidView, VkSampler pyramidSampler,
+  uint32_t maxDraws, uint32_t maxBatches)
+{
+  VkShaderModule cullShader;
+  if (!vkinit::load_shader_module("shaders/cull.comp.spv", device, cullShader))
+  {
+    std::cout << "Failed to build culling compute shader\n";
+    return false;
+  }
+
+  this->device = device;
+  this->allocator = allocator;
+  this->maxDraws = maxDraws;
+  this->maxBatches = maxBatches;
+
+  // Objects, draws, commands, counts, params, depth pyramid and occluded flags
+  VkDescriptorSetLayoutBinding bindings[7];
+  for (uint32_t i = 0; i < 7; ++i)
+    bindings[i] = vkinit::descriptor_set_layout_binding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, i);
+  bindings[4].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  bindings[5].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+  VkDescriptorSetLayoutCreateInfo setInfo{
+    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+    .pNext = nullptr,
+
+    .flags = 0,
+    .bindingCount = 7,
+    .pBindings = bindings,
+  };
+
+  VK_CHECK(vkCreateDescriptorSetLayout(device, &setInfo, nullptr, &setLayout));
+
+  const uint32_t frameCount = (uint32_t)objectBuffers.size();
+  VkDescriptorPoolSize poolSizes[3] = {
+    { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5 * frameCount },
+    { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, frameCount },
+    { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, frameCount },
+  };
+
+  VkDescriptorPoolCreateInfo poolInfo{
+    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+    .pNext = nullptr,
+
+    .flags = 0,
+    .maxSets = frameCount,
+    .poolSizeCount = 3,
+    .pPoolSizes = poolSizes,
+  };
+
+  VK_CHECK(vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool));
+
+  // The phase is all that changes between the two dispatches of a frame
+  auto layoutInfo = vkinit::pipeline_layout_create_info();
+  VkPushConstantRange pushConstant{
+    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+    .offset = 0,
+    .size = sizeof(uint32_t),
+  };
+  layoutInfo.pPushConstantRanges = &pushConstant;
+  layoutInfo.pushConstantRangeCount = 1;
+  layoutInfo.pSetLayouts = &setLayout;
+  layoutInfo.setLayoutCount = 1;
+
+  VK_CHECK(vkCreatePipelineLayout(device, &layoutInfo, nullptr, &layout));
+
+  VkComputePipelineCreateInfo pipelineInfo{
+    .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+    .pNext = nullptr,
+
+    .flags = 0,
+    .stage = vkinit::shader_stage_create_info(VK_SHADER_STAGE_COMPUTE_BIT, cullShader),
+    .layout = layout,
+  };
+
+  VK_CHECK(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline));
+
+  vkDestroyShaderModule(device, cullShader, nullptr);
+
+  // Returns the mapping for buffers created with VMA_ALLOCATION_CREATE_MAPPED_BIT
+  auto create_buffer = [&](VkDeviceSize size, VkBufferUsageFlags usage, VmaAllocationCreateFlags flags, AllocatedBuffer& buffer) {
+    VkBufferCreateInfo bufferInfo{
+      .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+      .pNext = nullptr,
+
+      .size = size,
+      .usage = usage
+    };
+
+    VmaAllocationCreateInfo allocInfo{
+      .flags = flags,
+      .usage = VMA_MEMORY_USAGE_AUTO,
+    };
+
+    VmaAllocationInfo allocation;
+    VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &buffer.buffer, &buffer.alloc, &allocation));
+    return allocation.pMappedData;
+  };
+
+  constexpr VmaAllocationCreateFlags HostWritten = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+  const VkDeviceSize countBytes = count_offset(CullPhase::Late, maxBatches);
+
+  frames.resize(frameCount);
+  for (uint32_t i = 0; i < frameCount; ++i)
+  {
+    Frame& frame = frames[i];
+
+    // Rewritten by the CPU only when the scene changes
+    frame.drawData = (uint8_t*)create_buffer(sizeof GPUDrawData * maxDraws, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, HostWritten, frame.draws);
+    frame.paramData = (GPUCullParams*)create_buffer(sizeof GPUCullParams, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, HostWritten, frame.params);
+
+    create_buffer(sizeof VkDrawIndexedIndirectCommand * maxDraws * 2, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, 0, frame.commands);
+    create_buffer(sizeof(uint32_t) * maxDraws, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, 0, frame.occluded);
+
+    // Read back on the CPU for the frame stats
+    frame.countData = (const uint8_t*)create_buffer(countBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT, frame.counts);
+
+    // Read before the frame's first cull ran
+    memset((void*)frame.countData, 0, countBytes);
+    vmaFlushAllocation(allocator, frame.counts.alloc, 0, VK_WHOLE_SIZE);
+
+    VkDescriptorSetAllocateInfo allocInfo{
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+      .pNext = nullptr,
+
+      .descriptorPool = descriptorPool,
+      .descriptorSetCount = 1,
+      .pSetLayouts = &setLayout
+    };
+
+    VK_CHECK(vkAllocateDescriptorSets(device, &allocInfo, &frame.set));
+
+    VkDescriptorBufferInfo bufferInfos[6] = {
+      { .buffer = objectBuffers[i], .offset = 0, .range = VK_WHOLE_SIZE },
+      { .buffer = frame.draws.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+      { .buffer = frame.commands.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+      { .buffer = frame.counts.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+      { .buffer = frame.params.buffer, .offset = 0, .range = sizeof GPUCullParams },
+      { .buffer = frame.occluded.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+    };
+
+    VkDescriptorImageInfo pyramidInfo{
+      .sampler = pyramidSampler,
+      .imageView = pyramidView,
+      .imageLayout = VK_IMAGE_LAYOUT_GENERAL
+    };
+
+    VkWriteDescriptorSet writes[7] = {
+      vkinit::write_descriptor_buffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frame.set, &bufferInfos[0], 0),
+      vkinit::write_descriptor_buffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frame.set, &bufferInfos[1], 1),
+      vkinit::write_descriptor_buffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frame.set, &bufferInfos[2], 2),
+      vkinit::write_descriptor_buffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frame.set, &bufferInfos[3], 3),
+      vkinit::write_descriptor_buffer(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, frame.set, &bufferInfos[4], 4),
+      vkinit::write_descriptor_image(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, frame.set, &pyramidInfo, 5),
+      vkinit::write_descriptor_buffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frame.set, &bufferInfos[5], 6),
+    };
+
+    vkUpdateDescriptorSets(device, 7, writes, 0, nullptr);
+  }
+
+  return true;
+}
+
+void GpuCuller::write_draws(uint32_t frame, const std::vector<GPUDrawData>& draws)
+{
+  const size_t count = std::min<size_t>(draws.size(), maxDraws);
+
+  memcpy(frames[frame].drawData, draws.data(), count * sizeof GPUDrawData);
+  vmaFlushAllocation(allocator, frames[frame].draws.alloc, 0, count * sizeof GPUDrawData);
+}
+
+void GpuCuller::write_params(uint32_t frame, const GPUCullParams& params)
+{
+  Frame& current = frames[frame];
+
+  current.drawCount = std::min(params.drawCount, maxDraws);
+
+  *current.paramData = params;
+  current.paramData->drawCount = current.drawCount;
+  current.paramData->commandStride = maxDraws;
+  current.paramData->countStride = maxBatches;
+  vmaFlushAllocation(allocator, current.params.alloc, 0, VK_WHOLE_SIZE);
+}
+
+void GpuCuller::record(VkCommandBuffer cmd, uint32_t frame, CullPhase phase)
+{
+  const Frame& current = frames[frame];
+
+  if (phase == CullPhase::Early)
+  {
+    vkCmdFillBuffer(cmd, current.counts.buffer, 0, VK_WHOLE_SIZE, 0);
+
+    VkBufferMemoryBarrier clearBarrier{
+      .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+      .pNext = nullptr,
+
+      .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+      .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+
+      .buffer = current.counts.buffer,
+      .offset = 0,
+      .size = VK_WHOLE_SIZE
+    };
+
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &clearBarrier, 0, nullptr);
+  }
+  else
+  {
+    // The late phase reads the early one's occluded flags and keeps adding to its stats
+    VkMemoryBarrier earlyBarrier{
+      .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+      .pNext = nullptr,
+
+      .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+      .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+    };
+
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &earlyBarrier, 0, nullptr, 0, nullptr);
+  }
+
+  const uint32_t phaseIndex = (uint32_t)phase;
+
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+  vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, layout, 0, 1, &current.set, 0, nullptr);
+  vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &phaseIndex);
+
+  // 64 matches local_size_x in cull.comp
+  if (current.drawCount > 0)
+    vkCmdDispatch(cmd, (current.drawCount + 63) / 64, 1, 1);
+
+  // Commands and counts are read by the indirect draws, the counts by the CPU once the frame is done
+  VkBufferMemoryBarrier cullBarriers[2] = {
+    {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+      .pNext = nullptr,
+
+      .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+      .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+
+      .buffer = current.commands.buffer,
+      .offset = 0,
+      .size = VK_WHOLE_SIZE
+    },
+    {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+      .pNext = nullptr,
+
+      .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+      .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT,
+
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+
+      .buffer = current.counts.buffer,
+      .offset = 0,
+      .size = VK_WHOLE_SIZE
+    },
+  };
+
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+    0, 0, nullptr, 2, cullBarriers, 0, nullptr);
+}
+
+GPUCullStats GpuCuller::read_stats(uint32_t frame, uint32_t& outDraws) const
+{
+  const Frame& current = frames[frame];
+
+  vmaInvalidateAllocation(allocator, current.counts.alloc, 0, VK_WHOLE_SIZE);
+
+  GPUCullStats stats;
+  memcpy(&stats, current.countData, sizeof GPUCullStats);
+
+  const uint32_t* counts = reinterpret_cast<const uint32_t*>(current.countData + count_offset(CullPhase::Early, 0));
+
+  outDraws = 0;
+  // Every count is cleared before the cull, ones past the last batch and of a skipped late phase stay zero
+  for (uint32_t batch = 0; batch < maxBatches * 2; ++batch)
+    outDraws += counts[batch];
+
+  return stats;
+}
+
+void GpuCuller::cleanup()
+{
+  for (Frame& frame : frames)
+  {
+    vmaDestroyBuffer(allocator, frame.draws.buffer, frame.draws.alloc);
+    vmaDestroyBuffer(allocator, frame.params.buffer, frame.params.alloc);
+    vmaDestroyBuffer(allocator, frame.commands.buffer, frame.commands.alloc);
+    vmaDestroyBuffer(allocator, frame.counts.buffer, frame.counts.alloc);
+    vmaDestroyBuffer(allocator, frame.occluded.buffer, frame.occluded.alloc);
+  }
+  frames.clear();
+
+  vkDestroyPipeline(device, pipeline, nullptr);
+  vkDestroyPipelineLayout(device, layout, nullptr);
+  vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+  vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "core/renderer/vk_mesh.hpp"
+#include "core/renderer/vk_types.hpp"
+
+// Cull data of one draw, in the same slot as its GPUObjectData. Laid out for std430, see shaders/cull.comp.
+struct GPUDrawData
+{
+  glm::vec4 sphere;             // Object space bounds, xyz center and w radius
+  uint32_t batch;               // The batch whose draw count the draw increments
+  uint32_t firstCommand;        // Where the batch's commands start
+  uint32_t lodCount;
+  int32_t vertexOffset;
+  glm::uvec4 lods[MaxMeshLods]; // x first index, y index count, z simplification error as float bits
+};
+
+// Uniform buffer of shaders/cull.comp, laid out for std140
+struct GPUCullParams
+{
+  glm::vec4 planes[6]; // World space frustum, see Frustum
+  glm::vec4 eye;       // xyz camera position, w pixels per unit at distance one
+  glm::mat4 viewproj;  // Projects bounds onto the depth pyramid
+  float lodErrorThreshold;
+  float nearPlane;
+  uint32_t drawCount;
+  uint32_t occlusion;     // Non zero tests draws against the depth pyramid
+  uint32_t commandStride; // Set by GpuCuller::write_params
+  uint32_t countStride;   // Set by GpuCuller::write_params
+};
+
+// Totals shaders/cull.comp adds up ahead of the draw counts, read back for the frame stats
+struct GPUCullStats
+{
+  uint32_t triangles;
+  uint32_t lodTriangles[MaxMeshLods];
+  uint32_t occluded;  // Inside the frustum but hidden in both phases
+  uint32_t lateDraws; // Hidden by the previous frame's depth but not by this one's
+  uint32_t pad;
+};
+
+// Culling runs in two phases, each followed by a render pass drawing what it let through
+enum class CullPhase : uint32_t
+{
+  // Every draw against the frustum and, with occlusion on, the depth pyramid the previous frame left
+  Early = 0,
+  // Draws the early phase found occluded, against a pyramid of the depth the early draws wrote
+  Late = 1,
+};
+
+// Frustum and occlusion culling plus LOD selection on the GPU. A compute pass tests every draw against the
+// camera and appends the ones that survive to the indirect commands of their batch, a run of draws sharing
+// state that the render pass issues with one vkCmdDrawIndexedIndirectCount. A batch's commands start at its
+// first draw's slot, so there is room for every draw it has. Each phase has its own commands and counts.
+// Buffers exist once per frame in flight, the draws only have to be written again when they change.
+class GpuCuller
+{
+public:
+  // objectBuffers holds each frame's GPUObjectData, in the same slots as the draws. The pyramid is read in
+  // VK_IMAGE_LAYOUT_GENERAL, see DepthPyramid. Returns false without creating anything if the culling shader is
+  // missing.
+  [[nodiscard]]
+  bool init(VkDevice device, VmaAllocator allocator, const std::vector<VkBuffer>& objectBuffers, VkImageView pyramidView, VkSampler pyramidSampler,
+    uint32_t maxDraws, uint32_t maxBatches);
+
+  void write_draws(uint32_t frame, const std::vector<GPUDrawData>& draws);
+
+  void write_params(uint32_t frame, const GPUCullParams& params);
+
+  // Dispatches the phase and makes its commands visible to indirect draws, the early phase clears the counts
+  // of both first. Records outside of a render pass.
+  void record(VkCommandBuffer cmd, uint32_t frame, CullPhase phase);
+
+  // Totals of the frame's last cull, only valid once the submission that ran it has finished. outDraws is the
+  // number of draws either phase let through.
+  [[nodiscard]]
+  GPUCullStats read_stats(uint32_t frame, uint32_t& outDraws) const;
+
+  [[nodiscard]]
+  VkBuffer get_command_buffer(uint32_t frame) const { return frames[frame].commands.buffer; }
+
+  [[nodiscard]]
+  VkBuffer get_count_buffer(uint32_t frame) const { return frames[frame].counts.buffer; }
+
+  [[nodiscard]]
+  VkDeviceSize command_offset(CullPhase phase, uint32_t firstCommand) const
+  {
+    return ((VkDeviceSize)phase * maxDraws + firstCommand) * sizeof(VkDrawIndexedIndirectCommand);
+  }
+
+  [[nodiscard]]
+  VkDeviceSize count_offset(CullPhase phase, uint32_t batch) const
+  {
+    return sizeof(GPUCullStats) + ((VkDeviceSize)phase * maxBatches + batch) * sizeof(uint32_t);
+  }
+
+  void cleanup();
+
+private:
+  struct Frame
+  {
+    AllocatedBuffer draws;
+    uint8_t* drawData = nullptr;
+    AllocatedBuffer params;
+    GPUCullParams* paramData = nullptr;
+    AllocatedBuffer commands;
+    AllocatedBuffer counts;
+    const uint8_t* countData = nullptr;
+    AllocatedBuffer occluded; // A flag per draw the early phase sets for the late one
+    VkDescriptorSet set = VK_NULL_HANDLE;
+    uint32_t drawCount = 0;
+  };
+
+  VkDevice device;
+  VmaAllocator allocator;
+  uint32_t maxDraws = 0;
+  uint32_t maxBatches = 0;
+
+  VkDescriptorSetLayout setLayout;
+  VkDescriptorPool descriptorPool;
+  VkPipelineLayout layout;
+  VkPipeline pipeline;
+
+  std::vector<Frame> frames;
+};
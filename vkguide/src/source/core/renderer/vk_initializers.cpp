@@ -142,7 +142,7 @@ namespace vkinit
     };
   }
 
-  VkImageCreateInfo image_create_info(VkFormat format, VkImageUsageFlags usageFlags, VkExtent3D extent)
+  VkImageCreateInfo image_create_info(VkFormat format, VkImageUsageFlags usageFlags, VkExtent3D extent, uint32_t mipLevels /*= 1*/)
   {
     return VkImageCreateInfo{
       .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
@@ -153,7 +153,7 @@ namespace vkinit
       .format = format,
       .extent = extent,
 
-      .mipLevels = 1,
+      .mipLevels = mipLevels,
       .arrayLayers = 1,
       .samples = VK_SAMPLE_COUNT_1_BIT,
       .tiling = VK_IMAGE_TILING_OPTIMAL,
@@ -161,7 +161,7 @@ namespace vkinit
     };
   }
 
-  VkImageViewCreateInfo image_view_create_info(VkFormat format, VkImage image, VkImageAspectFlags flags)
+  VkImageViewCreateInfo image_view_create_info(VkFormat format, VkImage image, VkImageAspectFlags flags, uint32_t mipLevels /*= 1*/)
   {
     return VkImageViewCreateInfo{
       .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
@@ -174,7 +174,7 @@ namespace vkinit
         .aspectMask = flags,
 
         .baseMipLevel = 0,
-        .levelCount = 1,
+        .levelCount = mipLevels,
         .baseArrayLayer = 0,
         .layerCount = 1,
       }
@@ -263,6 +263,7 @@ namespace vkinit
 	    .addressModeU = samplerAddressMode,
 	    .addressModeV = samplerAddressMode,
 	    .addressModeW = samplerAddressMode,
+	    .maxLod = VK_LOD_CLAMP_NONE,
     };
   }
 
@@ -35,10 +35,10 @@ namespace vkinit
   VkPipelineLayoutCreateInfo pipeline_layout_create_info();
 
   [[nodiscard]]
-  VkImageCreateInfo image_create_info(VkFormat format, VkImageUsageFlags usageFlags, VkExtent3D extent);
+  VkImageCreateInfo image_create_info(VkFormat format, VkImageUsageFlags usageFlags, VkExtent3D extent, uint32_t mipLevels = 1);
 
   [[nodiscard]]
-  VkImageViewCreateInfo image_view_create_info(VkFormat format, VkImage image, VkImageAspectFlags flags);
+  VkImageViewCreateInfo image_view_create_info(VkFormat format, VkImage image, VkImageAspectFlags flags, uint32_t mipLevels = 1);
 
   [[nodiscard]]
   VkPipelineDepthStencilStateCreateInfo depth_stencil_create_info(bool bDepthTest, bool bDepthWrite, VkCompareOp compareOp);
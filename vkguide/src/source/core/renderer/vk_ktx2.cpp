@@ -0,0 +1,273 @@
+#include <pch.hpp>
+#include "vk_ktx2.hpp"
+
+#include "core/filesystem/mapped_file.hpp"
+
+namespace
+{
+  constexpr uint8_t Ktx2Identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+  struct Ktx2Header
+  {
+    uint8_t identifier[12];
+    uint32_t vkFormat;
+    uint32_t typeSize;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t layerCount;
+    uint32_t faceCount;
+    uint32_t levelCount;
+    uint32_t supercompressionScheme;
+
+    uint32_t dfdByteOffset;
+    uint32_t dfdByteLength;
+    uint32_t kvdByteOffset;
+    uint32_t kvdByteLength;
+    uint64_t sgdByteOffset;
+    uint64_t sgdByteLength;
+  };
+
+  static_assert(sizeof(Ktx2Header) == 80, "KTX2 header is 80 bytes");
+
+  struct Ktx2LevelIndex
+  {
+    uint64_t byteOffset;
+    uint64_t byteLength;
+    uint64_t uncompressedByteLength;
+  };
+
+  // Khronos data format descriptor values for the formats the cooker writes
+  constexpr uint8_t DfModelRgbsda = 1;
+  constexpr uint8_t DfModelBc1a = 128;
+  constexpr uint8_t DfModelBc3 = 130;
+  constexpr uint8_t DfModelBc7 = 134;
+  constexpr uint8_t DfPrimariesBt709 = 1;
+  constexpr uint8_t DfTransferSrgb = 2;
+  constexpr uint8_t DfChannelColor = 0;
+  constexpr uint8_t DfChannelAlpha = 15;
+  constexpr uint8_t DfSampleLinear = 1 << 4;
+
+  struct DfdSample
+  {
+    uint16_t bitOffset;
+    uint8_t bitLength; // Minus one
+    uint8_t channelType;
+    uint8_t samplePosition[4];
+    uint32_t sampleLower;
+    uint32_t sampleUpper;
+  };
+
+  struct FormatDescription
+  {
+    uint8_t colorModel;
+    uint8_t blockSize; // Texels per side, 1 for uncompressed formats
+    uint8_t bytesPerBlock;
+    std::vector<DfdSample> samples;
+  };
+
+  std::optional<FormatDescription> describe_format(VkFormat format)
+  {
+    switch (format)
+    {
+    case VK_FORMAT_R8G8B8A8_SRGB:
+      return FormatDescription{ DfModelRgbsda, 1, 4, {
+        { 0, 7, 0, {}, 0, 255 },
+        { 8, 7, 1, {}, 0, 255 },
+        { 16, 7, 2, {}, 0, 255 },
+        { 24, 7, DfChannelAlpha | DfSampleLinear, {}, 0, 255 } } };
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+      return FormatDescription{ DfModelBc1a, 4, 8, { { 0, 63, DfChannelColor, {}, 0, UINT32_MAX } } };
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+      return FormatDescription{ DfModelBc3, 4, 16, {
+        { 0, 63, DfChannelAlpha | DfSampleLinear, {}, 0, UINT32_MAX },
+        { 64, 63, DfChannelColor, {}, 0, UINT32_MAX } } };
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+      return FormatDescription{ DfModelBc7, 4, 16, { { 0, 127, DfChannelColor, {}, 0, UINT32_MAX } } };
+    default:
+      return std::nullopt;
+    }
+  }
+
+  template<typename T>
+  void append(std::vector<uint8_t>& out, const T& value)
+  {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof value);
+  }
+
+  void pad_to(std::vector<uint8_t>& out, size_t alignment)
+  {
+    out.resize((out.size() + alignment - 1) / alignment * alignment, 0);
+  }
+
+  // Basic descriptor block, the only one KTX2 requires
+  std::vector<uint8_t> build_dfd(const FormatDescription& desc)
+  {
+    const uint16_t blockBytes = (uint16_t)(24 + 16 * desc.samples.size());
+
+    std::vector<uint8_t> dfd;
+    append(dfd, (uint32_t)(4 + blockBytes)); // dfdTotalSize
+    append(dfd, (uint32_t)0);                // vendorId and descriptorType (Khronos, basic)
+    append(dfd, (uint16_t)2);                // versionNumber
+    append(dfd, blockBytes);
+    append(dfd, desc.colorModel);
+    append(dfd, DfPrimariesBt709);
+    append(dfd, DfTransferSrgb);
+    append(dfd, (uint8_t)0);                 // flags, straight alpha
+
+    const uint8_t dimension = desc.blockSize - 1;
+    append(dfd, std::array<uint8_t, 4>{ dimension, dimension, 0, 0 });
+    append(dfd, std::array<uint8_t, 8>{ desc.bytesPerBlock, 0, 0, 0, 0, 0, 0, 0 });
+
+    for (const DfdSample& sample : desc.samples)
+      append(dfd, sample);
+
+    return dfd;
+  }
+}
+
+bool write_ktx2(const std::string& filePath, const Ktx2Texture& texture)
+{
+  std::optional<FormatDescription> desc = describe_format(texture.format);
+  if (!desc || texture.levels.empty())
+    return false;
+
+  const uint32_t levelCount = (uint32_t)texture.levels.size();
+
+  // Levels are aligned to lcm(texel block size, 4), both are powers of two
+  const size_t levelAlignment = std::max<size_t>(desc->bytesPerBlock, 4);
+
+  std::vector<uint8_t> dfd = build_dfd(*desc);
+
+  std::vector<uint8_t> kvd;
+  {
+    constexpr char Writer[] = "KTXwriter\0VkGuide texture cooker";
+    append(kvd, (uint32_t)sizeof Writer);
+    kvd.insert(kvd.end(), Writer, Writer + sizeof Writer);
+    pad_to(kvd, 4);
+  }
+
+  const size_t indexEnd = sizeof(Ktx2Header) + levelCount * sizeof(Ktx2LevelIndex);
+  const size_t dfdOffset = indexEnd;
+  const size_t kvdOffset = dfdOffset + dfd.size();
+
+  Ktx2Header header{
+    .vkFormat = (uint32_t)texture.format,
+    .typeSize = 1,
+    .pixelWidth = texture.width,
+    .pixelHeight = texture.height,
+    .pixelDepth = 0,
+    .layerCount = 0,
+    .faceCount = 1,
+    .levelCount = levelCount,
+    .supercompressionScheme = 0,
+
+    .dfdByteOffset = (uint32_t)dfdOffset,
+    .dfdByteLength = (uint32_t)dfd.size(),
+    .kvdByteOffset = (uint32_t)kvdOffset,
+    .kvdByteLength = (uint32_t)kvd.size(),
+    .sgdByteOffset = 0,
+    .sgdByteLength = 0,
+  };
+  memcpy(header.identifier, Ktx2Identifier, sizeof Ktx2Identifier);
+
+  // Mip data goes smallest level first, as the spec recommends for streaming
+  std::vector<Ktx2LevelIndex> levelIndex(levelCount);
+  size_t offset = kvdOffset + kvd.size();
+  for (uint32_t level = levelCount; level-- > 0;)
+  {
+    offset = (offset + levelAlignment - 1) / levelAlignment * levelAlignment;
+    levelIndex[level] = Ktx2LevelIndex{ .byteOffset = offset, .byteLength = texture.levels[level].size(), .uncompressedByteLength = texture.levels[level].size() };
+    offset += texture.levels[level].size();
+  }
+
+  std::vector<uint8_t> file;
+  file.reserve(offset);
+  append(file, header);
+  for (const Ktx2LevelIndex& index : levelIndex)
+    append(file, index);
+  file.insert(file.end(), dfd.begin(), dfd.end());
+  file.insert(file.end(), kvd.begin(), kvd.end());
+
+  for (uint32_t level = levelCount; level-- > 0;)
+  {
+    file.resize(levelIndex[level].byteOffset, 0);
+    file.insert(file.end(), texture.levels[level].begin(), texture.levels[level].end());
+  }
+
+  std::error_code ec;
+  std::filesystem::create_directories(std::filesystem::path(filePath).parent_path(), ec);
+
+  // Write to a temporary first so an interrupted cook never leaves a truncated file behind
+  const std::string tempPath = filePath + ".tmp";
+  {
+    std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+    if (!out)
+      return false;
+
+    out.write(reinterpret_cast<const char*>(file.data()), file.size());
+    if (!out)
+      return false;
+  }
+
+  std::filesystem::rename(tempPath, filePath, ec);
+  return !ec;
+}
+
+bool parse_ktx2(const MappedFile& file, VkFormat& outFormat, uint32_t& outWidth, uint32_t& outHeight, std::vector<Ktx2Level>& outLevels)
+{
+  if (file.size() < sizeof(Ktx2Header))
+    return false;
+
+  Ktx2Header header;
+  memcpy(&header, file.data(), sizeof header);
+
+  if (memcmp(header.identifier, Ktx2Identifier, sizeof Ktx2Identifier) != 0)
+    return false;
+
+  // 2D, single image, stored as is
+  if (header.pixelWidth == 0 || header.pixelHeight == 0 || header.pixelDepth != 0 || header.layerCount > 1 || header.faceCount != 1 || header.supercompressionScheme != 0)
+    return false;
+
+  // Only formats the cooker writes, their block sizes are what the level sizes are checked against
+  std::optional<FormatDescription> desc = describe_format((VkFormat)header.vkFormat);
+  if (!desc)
+    return false;
+
+  // A level count of 0 asks the loader to generate mips, we only load what is stored. More levels than the
+  // extent halves down to 1x1 in can't be valid.
+  const uint32_t levelCount = std::max(header.levelCount, 1u);
+  uint32_t maxLevelCount = 1;
+  for (uint32_t extent = std::max(header.pixelWidth, header.pixelHeight); extent > 1; extent >>= 1)
+    ++maxLevelCount;
+
+  if (levelCount > maxLevelCount)
+    return false;
+
+  if (file.size() < sizeof header + levelCount * sizeof(Ktx2LevelIndex))
+    return false;
+
+  outLevels.resize(levelCount);
+  for (uint32_t level = 0; level < levelCount; ++level)
+  {
+    Ktx2LevelIndex index;
+    memcpy(&index, file.data() + sizeof header + level * sizeof index, sizeof index);
+
+    if (index.byteOffset > file.size() || index.byteLength > file.size() - index.byteOffset)
+      return false;
+
+    // Uploads copy whole levels out of the data, anything but the exact size would read past it or leave texels unset
+    const uint64_t blocksX = (std::max(header.pixelWidth >> level, 1u) + desc->blockSize - 1) / desc->blockSize;
+    const uint64_t blocksY = (std::max(header.pixelHeight >> level, 1u) + desc->blockSize - 1) / desc->blockSize;
+    if (index.byteLength != blocksX * blocksY * desc->bytesPerBlock)
+      return false;
+
+    outLevels[level] = Ktx2Level{ .offset = index.byteOffset, .size = index.byteLength };
+  }
+
+  outFormat = (VkFormat)header.vkFormat;
+  outWidth = header.pixelWidth;
+  outHeight = header.pixelHeight;
+  return true;
+}
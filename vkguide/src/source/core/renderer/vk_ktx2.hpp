@@ -0,0 +1,31 @@
+#pragma once
+
+#include "core/renderer/vk_types.hpp"
+
+class MappedFile;
+
+// Single 2D image with a mip chain, the subset of KTX2 the texture cooker writes and the loader reads.
+// No supercompression, array layers, cube faces or depth.
+struct Ktx2Texture
+{
+  VkFormat format = VK_FORMAT_UNDEFINED;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  std::vector<std::vector<uint8_t>> levels; // levels[0] is full resolution
+};
+
+// Where a mip level's data sits in a mapped KTX2 file
+struct Ktx2Level
+{
+  uint64_t offset;
+  uint64_t size;
+};
+
+[[nodiscard]]
+bool write_ktx2(const std::string& filePath, const Ktx2Texture& texture);
+
+// Validates the header and level index of a mapped KTX2 file, the level data itself stays in the mapping.
+// Rejects formats write_ktx2 does not write, more levels than the extent has and levels whose size does not match
+// their extent and block size. outLevels[0] is full resolution.
+[[nodiscard]]
+bool parse_ktx2(const MappedFile& file, VkFormat& outFormat, uint32_t& outWidth, uint32_t& outHeight, std::vector<Ktx2Level>& outLevels);
@@ -1,8 +1,95 @@
 #include <pch.hpp>
 #include "vk_mesh.hpp"
 
-VertexInputDescription Vertex::get_vertex_description()
+#include "core/renderer/vk_mesh_cache.hpp"
+#include "core/renderer/vk_mesh_optimizer.hpp"
+#include "core/renderer/vk_mesh_simplifier.hpp"
+#include "core/renderer/vk_meshlet.hpp"
+#include "core/renderer/vk_obj_parser.hpp"
+
+namespace
 {
+  VertexInputDescription packed_vertex_description()
+  {
+    VertexInputDescription vid;
+
+    VkVertexInputBindingDescription vertBinding{
+      .binding = 0,
+      .stride = sizeof PackedVertex,
+      .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
+    };
+
+    vid.bindings = { vertBinding };
+
+    VkVertexInputAttributeDescription posAttrib{
+      .location = 0,
+      .binding = 0,
+      .format = VK_FORMAT_R16G16B16A16_SNORM,
+      .offset = offsetof(PackedVertex, position)
+    };
+
+    VkVertexInputAttributeDescription normalAttrib{
+      .location = 1,
+      .binding = 0,
+      .format = VK_FORMAT_R16G16_SNORM,
+      .offset = offsetof(PackedVertex, normal)
+    };
+
+    // No color attribute, location 2 is left unused
+    VkVertexInputAttributeDescription uvAttrib{
+      .location = 3,
+      .binding = 0,
+      .format = VK_FORMAT_R16G16_UNORM,
+      .offset = offsetof(PackedVertex, uv)
+    };
+
+    vid.attributes = {
+      posAttrib,
+      normalAttrib,
+      uvAttrib
+    };
+
+    return vid;
+  }
+
+  int16_t quantize_snorm16(float v)
+  {
+    return (int16_t)std::round(std::clamp(v, -1.f, 1.f) * 32767.f);
+  }
+
+  uint16_t quantize_unorm16(float v)
+  {
+    return (uint16_t)std::round(std::clamp(v, 0.f, 1.f) * 65535.f);
+  }
+
+  // Octahedral normal encoding, decoded by oct_decode in tri_mesh_packed.vert
+  glm::vec2 oct_encode(glm::vec3 n)
+  {
+    // OBJ files may hold zero length normals, they encode as +Z rather than NaN
+    const float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (!(l1 > 0.f) || !std::isfinite(l1))
+      return glm::vec2{ 0.f };
+
+    n /= l1;
+
+    glm::vec2 p{ n.x, n.y };
+    if (n.z < 0.f)
+    {
+      p = glm::vec2{
+        (1.f - std::abs(n.y)) * (n.x >= 0.f ? 1.f : -1.f),
+        (1.f - std::abs(n.x)) * (n.y >= 0.f ? 1.f : -1.f)
+      };
+    }
+
+    return p;
+  }
+}
+
+VertexInputDescription Vertex::get_vertex_description(VertexFormat format)
+{
+  if (format == VertexFormat::Packed)
+    return packed_vertex_description();
+
   VertexInputDescription vid;
 
   VkVertexInputAttributeDescription;
@@ -55,90 +142,335 @@ VertexInputDescription Vertex::get_vertex_description()
   return vid;
 }
 
-// TODO: Fix loading non-triangulated meshes
-// TODO: Fix loading materials
-// TODO: Hook up to logging once implemented
-Mesh load_from_obj(const std::string& filepath, const std::string& mtlDir)
+VkIndexType select_index_type(size_t vertexCount)
 {
-  std::cout << fmt::format("Loading mesh: {}\n", filepath);
-  const auto t1 = std::chrono::high_resolution_clock::now();
+  return vertexCount <= std::numeric_limits<uint16_t>::max() ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+}
 
-  Mesh m{};
+uint32_t vertex_stride(VertexFormat format)
+{
+  return format == VertexFormat::Packed ? sizeof PackedVertex : sizeof Vertex;
+}
 
-  tinyobj::attrib_t attrib;
-  std::vector<tinyobj::shape_t> shapes;
-  std::vector<tinyobj::material_t> materials;
-  
-  std::string warn, err;
+size_t vertex_count(const Mesh& mesh)
+{
+  return mesh.format == VertexFormat::Packed ? mesh.packedVertices.size() : mesh.vertices.size();
+}
+
+size_t index_count(const Mesh& mesh)
+{
+  return mesh.indexType == VK_INDEX_TYPE_UINT16 ? mesh.shortIndices.size() : mesh.indices.size();
+}
 
-	tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filepath.c_str(), mtlDir.c_str());
+void narrow_indices(Mesh& mesh)
+{
+  mesh.indexType = select_index_type(vertex_count(mesh));
+  if (mesh.indexType != VK_INDEX_TYPE_UINT16 || mesh.indices.empty())
+    return;
+
+  mesh.shortIndices.resize(mesh.indices.size());
+  for (size_t i = 0; i < mesh.indices.size(); ++i)
+    mesh.shortIndices[i] = (uint16_t)mesh.indices[i];
+
+  mesh.indices = {};
+}
 
-  if (!warn.empty())
+bool pack_vertices(Mesh& mesh)
+{
+  // Small slack for uvs written out as 1.000001 and the like
+  constexpr float UvEpsilon = 1e-4f;
+
+  for (const Vertex& v : mesh.vertices)
   {
-    std::cout << "WARN: " << warn << '\n';
+    if (v.uv.x < -UvEpsilon || v.uv.x > 1.f + UvEpsilon || v.uv.y < -UvEpsilon || v.uv.y > 1.f + UvEpsilon)
+    {
+      std::cout << "  uvs outside of [0, 1], only full precision vertices\n";
+      return false;
+    }
   }
 
-  if (!err.empty())
+  // Positions are stored relative to the bounds center, scaled by the largest half extent
+  const glm::vec3 halfExtents = (mesh.bounds.max - mesh.bounds.min) * .5f;
+  float scale = std::max(halfExtents.x, std::max(halfExtents.y, halfExtents.z));
+  if (scale <= 0.f)
+    scale = 1.f;
+
+  mesh.positionDequant = glm::vec4{ mesh.bounds.origin, scale };
+
+  mesh.packedVertices.resize(mesh.vertices.size());
+  for (size_t i = 0; i < mesh.vertices.size(); ++i)
   {
-    std::cerr << "ERROR: " << warn << '\n';
-    return m;
+    const Vertex& v = mesh.vertices[i];
+    PackedVertex& packed = mesh.packedVertices[i];
+
+    const glm::vec3 p = (v.position - mesh.bounds.origin) / scale;
+    packed.position[0] = quantize_snorm16(p.x);
+    packed.position[1] = quantize_snorm16(p.y);
+    packed.position[2] = quantize_snorm16(p.z);
+    packed.position[3] = 0;
+
+    const glm::vec2 n = oct_encode(v.normal);
+    packed.normal[0] = quantize_snorm16(n.x);
+    packed.normal[1] = quantize_snorm16(n.y);
+
+    packed.uv[0] = quantize_unorm16(v.uv.x);
+    packed.uv[1] = quantize_unorm16(v.uv.y);
   }
 
-  // Loop over shapes
-	for (size_t s = 0; s < shapes.size(); s++)
+  std::cout << fmt::format("  Packed vertices: {} -> {} bytes each, {} KB -> {} KB\n",
+    sizeof Vertex, sizeof PackedVertex,
+    mesh.vertices.size() * sizeof Vertex / 1024, mesh.packedVertices.size() * sizeof PackedVertex / 1024);
+
+  return true;
+}
+
+MeshBounds compute_bounds(const std::vector<Vertex>& vertices)
+{
+  MeshBounds bounds;
+
+  if (vertices.empty())
+    return bounds;
+
+  bounds.min = bounds.max = vertices[0].position;
+  for (const Vertex& v : vertices)
   {
-		// Loop over faces(polygon)
-		size_t index_offset = 0;
-		for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++)
+    bounds.min = glm::min(bounds.min, v.position);
+    bounds.max = glm::max(bounds.max, v.position);
+  }
+
+  bounds.origin = (bounds.min + bounds.max) * .5f;
+
+  for (const Vertex& v : vertices)
+    bounds.radius = std::max(bounds.radius, glm::length(v.position - bounds.origin));
+
+  return bounds;
+}
+
+namespace
+{
+  // Keeps only the vertices of the layout the mesh is uploaded in, the full ones if it has no packed ones
+  void select_vertex_format(Mesh& mesh, VertexFormat format)
+  {
+    if (format == VertexFormat::Packed && !mesh.packedVertices.empty())
+    {
+      mesh.format = VertexFormat::Packed;
+      mesh.vertices = {};
+    }
+    else
+    {
+      mesh.format = VertexFormat::Full;
+      mesh.packedVertices = {};
+    }
+  }
+
+  // Cluster triangles for less overdraw after the vertex cache pass, costs a little ACMR
+  constexpr bool ReduceMeshOverdraw = true;
+
+  // Reference path, three vertices per triangle in file order
+  bool load_obj_corners_tinyobj(const std::string& filepath, const std::string& mtlDir, std::vector<Vertex>& corners, ObjMaterials& objMaterials)
+  {
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    
+    std::string warn, err;
+
+	  tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filepath.c_str(), mtlDir.c_str());
+
+    if (!warn.empty())
+    {
+      std::cout << "WARN: " << warn << '\n';
+    }
+
+    if (!err.empty())
     {
-      //hardcode loading to triangles
-			int fv = 3;
+      std::cerr << "ERROR: " << warn << '\n';
+      return false;
+    }
+
+    std::unordered_map<std::string, uint32_t> slots;
 
-			// Loop over vertices in the face.
-			for (size_t v = 0; v < fv; v++)
+    // Loop over shapes
+	  for (size_t s = 0; s < shapes.size(); s++)
+    {
+		  // Loop over faces(polygon)
+		  size_t index_offset = 0;
+		  for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++)
       {
-				// access to vertex
-				tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
+        //hardcode loading to triangles
+			  int fv = 3;
+
+			  // Loop over vertices in the face.
+			  for (size_t v = 0; v < fv; v++)
+        {
+				  // access to vertex
+				  tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
+
+          //vertex position
+				  tinyobj::real_t vx = attrib.vertices[3ull * idx.vertex_index + 0];
+				  tinyobj::real_t vy = attrib.vertices[3ull * idx.vertex_index + 1];
+				  tinyobj::real_t vz = attrib.vertices[3ull * idx.vertex_index + 2];
+
+          //vertex normal
+          tinyobj::real_t nx = attrib.normals[3ull * idx.normal_index + 0];
+				  tinyobj::real_t ny = attrib.normals[3ull * idx.normal_index + 1];
+				  tinyobj::real_t nz = attrib.normals[3ull * idx.normal_index + 2];
+
+          //vertex normal
+          tinyobj::real_t ux = attrib.texcoords[2ull * idx.texcoord_index + 0];
+				  tinyobj::real_t uy = attrib.texcoords[2ull * idx.texcoord_index + 1];
+
+          //copy it into our vertex
+				  Vertex new_vert;
+				  new_vert.position.x = vx;
+				  new_vert.position.y = vy;
+				  new_vert.position.z = vz;
+
+				  new_vert.normal.x = nx;
+				  new_vert.normal.y = ny;
+          new_vert.normal.z = nz;
+
+          //we are setting the vertex color as the vertex normal. This is just for display purposes
+          //(it has to be deterministic too, otherwise identical corners would never deduplicate)
+          new_vert.color = new_vert.normal;
+
+          new_vert.uv.x = ux;
+          new_vert.uv.y = 1 - uy; // invert because Vulkan
+
+				  corners.push_back(new_vert);
+			  }
+
+			  index_offset += fv;
+
+        // Slots are numbered in order of first use, same as the parallel parser
+        const int materialId = shapes[s].mesh.material_ids[f];
+        const std::string& name = materialId >= 0 && materialId < (int)materials.size() ? materials[materialId].name : std::string{};
+
+        auto [iter, inserted] = slots.try_emplace(name, (uint32_t)objMaterials.names.size());
+        if (inserted)
+          objMaterials.names.push_back(name);
+
+        objMaterials.triangleSlots.push_back(iter->second);
+		  }
+	  }
+
+    // Names the .mtl does not define came back as "", the file itself still has them. Only trusted when its
+    // triangle count agrees with how tinyobjloader triangulated.
+    ObjMaterials scanned;
+    if (scan_obj_materials(filepath, scanned) && scanned.triangleSlots.size() == objMaterials.triangleSlots.size())
+      objMaterials = std::move(scanned);
+
+    return true;
+  }
+
+  // Deduplicates the triangle corners into the mesh's vertex and index lists
+  void build_indexed_mesh(const std::vector<Vertex>& corners, Mesh& m)
+  {
+    // Maps every vertex we have already emitted to its slot so shared corners are only stored once
+    std::unordered_map<Vertex, uint32_t> uniqueVertices;
+    uniqueVertices.reserve(corners.size() / 2);
+
+    m.indices.reserve(corners.size());
+
+    for (const Vertex& corner : corners)
+    {
+      auto [iter, inserted] = uniqueVertices.try_emplace(corner, (uint32_t)m.vertices.size());
+      if (inserted)
+        m.vertices.push_back(corner);
+
+      m.indices.push_back(iter->second);
+    }
+
+    // Load report: how much the index buffer saved us over emitting three vertices per triangle
+    const size_t indexSize = select_index_type(m.vertices.size()) == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+    const size_t flatBytes = corners.size() * sizeof Vertex;
+    const size_t indexedBytes = m.vertices.size() * sizeof Vertex + m.indices.size() * indexSize;
+    const double uniqueRatio = corners.empty() ? 1.0 : (double)m.vertices.size() / corners.size();
+
+    std::cout << fmt::format("  {} unique of {} vertices ({:.1f}%), {}-bit indices, {} KB -> {} KB ({} KB saved)\n",
+      m.vertices.size(), corners.size(), uniqueRatio * 100.0, indexSize * 8,
+      flatBytes / 1024, indexedBytes / 1024, ((int64_t)flatBytes - (int64_t)indexedBytes) / 1024);
+  }
+
+  // Groups the triangles by material slot, keeping their order within a slot, and makes a submesh of each group
+  void split_submeshes(const ObjMaterials& materials, Mesh& m)
+  {
+    const size_t triangleCount = m.indices.size() / 3;
+    const size_t slotCount = materials.names.size();
+
+    std::vector<uint32_t> slotStart(slotCount + 1, 0);
+    for (uint32_t slot : materials.triangleSlots)
+      ++slotStart[slot + 1];
+    std::partial_sum(slotStart.begin(), slotStart.end(), slotStart.begin());
+
+    std::vector<uint32_t> sorted(m.indices.size());
+    std::vector<uint32_t> cursor(slotStart.begin(), slotStart.end() - 1);
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+      const uint32_t dst = cursor[materials.triangleSlots[t]]++;
+      memcpy(&sorted[dst * 3ull], &m.indices[t * 3], 3 * sizeof(uint32_t));
+    }
+
+    m.indices = std::move(sorted);
+    m.materialNames = materials.names;
+
+    m.submeshes.clear();
+    for (uint32_t slot = 0; slot < slotCount; ++slot)
+    {
+      if (slotStart[slot + 1] == slotStart[slot])
+        continue;
 
-        //vertex position
-				tinyobj::real_t vx = attrib.vertices[3ull * idx.vertex_index + 0];
-				tinyobj::real_t vy = attrib.vertices[3ull * idx.vertex_index + 1];
-				tinyobj::real_t vz = attrib.vertices[3ull * idx.vertex_index + 2];
+      Submesh submesh{ .materialSlot = slot, .lodCount = 1 };
+      submesh.lods[0] = MeshLod{ .firstIndex = slotStart[slot] * 3, .indexCount = (slotStart[slot + 1] - slotStart[slot]) * 3, .error = 0.f };
+      m.submeshes.push_back(submesh);
+    }
+  }
+}
+
+// TODO: Fix loading non-triangulated meshes
+// TODO: Hook up to logging once implemented
+Mesh load_from_obj(const std::string& filepath, const std::string& mtlDir, VertexFormat format, ThreadPool* workers)
+{
+  std::cout << fmt::format("Loading mesh: {}\n", filepath);
+  const auto t1 = std::chrono::high_resolution_clock::now();
 
-        //vertex normal
-        tinyobj::real_t nx = attrib.normals[3ull * idx.normal_index + 0];
-				tinyobj::real_t ny = attrib.normals[3ull * idx.normal_index + 1];
-				tinyobj::real_t nz = attrib.normals[3ull * idx.normal_index + 2];
+  Mesh m{};
 
-        //vertex normal
-        tinyobj::real_t ux = attrib.texcoords[2ull * idx.texcoord_index + 0];
-				tinyobj::real_t uy = attrib.texcoords[2ull * idx.texcoord_index + 1];
+  if (load_cooked_mesh(filepath, format, m))
+  {
+    const auto t2 = std::chrono::high_resolution_clock::now();
+    std::cout << fmt::format("Successfully loaded cooked mesh [{}] in {:.4} seconds\n", filepath, std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count() / 1000000000.0);
+    return m;
+  }
 
-        //copy it into our vertex
-				Vertex new_vert;
-				new_vert.position.x = vx;
-				new_vert.position.y = vy;
-				new_vert.position.z = vz;
+  std::vector<Vertex> corners;
+  ObjMaterials materials;
 
-				new_vert.normal.x = nx;
-				new_vert.normal.y = ny;
-        new_vert.normal.z = nz;
+  if (!parse_obj_parallel(filepath, corners, materials, workers) && !load_obj_corners_tinyobj(filepath, mtlDir, corners, materials))
+    return m;
 
-        //we are setting the vertex color as the vertex normal. This is just for display purposes
-        new_vert.color = glm::vec3(new_vert.uv, 0.5f);
+  build_indexed_mesh(corners, m);
+  split_submeshes(materials, m);
 
-        new_vert.uv.x = ux;
-        new_vert.uv.y = 1 - uy; // invert because Vulkan
+  // Cooked together with the mesh, so cached loads get the optimized order for free
+  optimize_mesh(m, ReduceMeshOverdraw);
+  build_meshlets(m);
 
-				m.vertices.push_back(new_vert);
-			}
+  m.bounds = compute_bounds(m.vertices);
+  build_lods(m);
 
-			index_offset += fv;
-		}
-	}
+  // Both layouts are cooked, whichever format later loads ask for is a straight copy
+  pack_vertices(m);
+  // Cooked in the width they are uploaded in, so cached loads copy them as they are
+  narrow_indices(m);
   
     const auto t2 = std::chrono::high_resolution_clock::now();
     std::cout << fmt::format("Successfully loaded mesh [{}] in {:.4} seconds\n", filepath, std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count() / 1000000000.0);
 
+  if (!cook_mesh(filepath, m))
+    std::cout << fmt::format("WARN: Failed to write mesh cache for {}\n", filepath);
+
+  select_vertex_format(m, format);
+
   return m;
 }
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <core/renderer/vk_types.hpp>
+#include <core/renderer/vk_geometry_pool.hpp>
+
+class ThreadPool;
 
 struct VertexInputDescription
 {
@@ -10,6 +13,13 @@ struct VertexInputDescription
   VkPipelineVertexInputStateCreateFlags flags = 0;
 };
 
+// Layout a mesh's vertex buffer is uploaded in, picked per mesh at load time
+enum class VertexFormat : uint8_t
+{
+  Full,   // Vertex, 32 bit floats everywhere
+  Packed, // PackedVertex, quantized attributes for the tri_mesh_packed.vert permutation
+};
+
 struct Vertex
 {
   glm::vec3 position;
@@ -17,14 +27,144 @@ struct Vertex
   glm::vec3 color;
   glm::vec2 uv;
 
-  static VertexInputDescription get_vertex_description();
+  bool operator==(const Vertex& other) const
+  {
+    return position == other.position && normal == other.normal && color == other.color && uv == other.uv;
+  }
+
+  static VertexInputDescription get_vertex_description(VertexFormat format = VertexFormat::Full);
+};
+
+// Quantized vertex, 16 bytes instead of 44. The debug color is dropped, the packed shader derives it from the normal.
+struct PackedVertex
+{
+  int16_t position[4]; // snorm16, relative to the mesh's bounds (see Mesh::positionDequant), w unused
+  int16_t normal[2];   // snorm16, octahedral encoded
+  uint16_t uv[2];      // unorm16
+};
+
+namespace std
+{
+  template<> struct hash<Vertex>
+  {
+    size_t operator()(Vertex const& vertex) const
+    {
+      return ((hash<glm::vec3>()(vertex.position) ^
+              (hash<glm::vec3>()(vertex.normal) << 1)) >> 1) ^
+              (hash<glm::vec2>()(vertex.uv) << 1);
+    }
+  };
+}
+
+// Object space bounds, both as a box and as a sphere around the box center
+struct MeshBounds
+{
+  glm::vec3 min{ 0.f };
+  glm::vec3 max{ 0.f };
+  glm::vec3 origin{ 0.f };
+  float radius = 0.f;
+};
+
+// Cluster of at most MaxMeshletVertices vertices and MaxMeshletTriangles triangles (see vk_meshlet.hpp).
+// Its triangles are a contiguous range of the mesh's index buffer, so drawing one is a single indexed draw.
+// Laid out for std430 so the array uploads to Mesh::meshletBuffer as is.
+struct Meshlet
+{
+  glm::vec4 sphere;  // xyz center, w radius
+  glm::vec4 aabbMin; // w unused
+  glm::vec4 aabbMax; // w unused
+  glm::vec4 cone;    // xyz axis, w cutoff (> 1 if the meshlet can never be entirely back facing)
+
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  uint32_t vertexCount;
+  uint32_t pad;
+};
+
+static_assert(sizeof(Meshlet) == 80, "Meshlet must match the std430 layout");
+
+// Full detail plus up to three simplified levels (see vk_mesh_simplifier.hpp)
+constexpr uint32_t MaxMeshLods = 4;
+
+// Index range of one level of detail, all levels share the vertex buffer
+struct MeshLod
+{
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  float error; // Object space distance the simplification may be off by, 0 for full detail
+};
+
+// Triangles of a mesh that share a material. The full detail ranges of all submeshes come first in the
+// index buffer, back to back, the simplified levels follow them.
+struct Submesh
+{
+  uint32_t materialSlot; // Index into Mesh::materialNames
+  uint32_t firstMeshlet;
+  uint32_t meshletCount;
+  uint32_t lodCount;
+  MeshLod lods[MaxMeshLods]; // lods[0] is full detail
 };
 
 struct Mesh
 {
 	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+  // The indices as uploaded when indexType is VK_INDEX_TYPE_UINT16, indices is left empty then (see narrow_indices)
+  std::vector<uint16_t> shortIndices;
+
+  MeshBounds bounds;
+  std::vector<Meshlet> meshlets; // Grouped by submesh, they only cover the full detail level
+  std::vector<Submesh> submeshes;
+  // Material names from the OBJ, "" for triangles without one
+  std::vector<std::string> materialNames;
 
-	AllocatedBuffer vertexBuffer;
+  VertexFormat format = VertexFormat::Full;
+  // Only filled for VertexFormat::Packed, vertices is left empty then
+  std::vector<PackedVertex> packedVertices;
+  // Packed positions decode as xyz + position * w
+  glm::vec4 positionDequant{ 0.f, 0.f, 0.f, 1.f };
+
+  // Where the vertices and indices live in the renderer's GeometryPool
+  GeometryRange vertexRange;
+  GeometryRange indexRange;
+  // The same in vertices and indices of this mesh's format, what draws pass as vertexOffset and add to firstIndex
+  int32_t baseVertex = 0;
+  uint32_t baseIndex = 0;
+  // Storage buffer holding meshlets, only created for meshes that have them
+  AllocatedBuffer meshletBuffer{};
+  // 16 bit whenever every vertex can be addressed by one, set by narrow_indices
+  VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+  // Set once the upload finished, streamed meshes are not drawn before that
+  bool resident = false;
+  // Set when loading or uploading it failed, it never becomes resident
+  bool failed = false;
 };
 
-Mesh load_from_obj(const std::string& filepath, const std::string& mtlDir = "");
+[[nodiscard]]
+VkIndexType select_index_type(size_t vertexCount);
+
+[[nodiscard]]
+MeshBounds compute_bounds(const std::vector<Vertex>& vertices);
+
+[[nodiscard]]
+uint32_t vertex_stride(VertexFormat format);
+
+// Vertices in the mesh's format
+[[nodiscard]]
+size_t vertex_count(const Mesh& mesh);
+
+// Indices in either width
+[[nodiscard]]
+size_t index_count(const Mesh& mesh);
+
+// Picks the mesh's index type and moves 16 bit indices into shortIndices. Nothing left to do for meshes
+// that already went through it.
+void narrow_indices(Mesh& mesh);
+
+// Quantizes the mesh's vertices into packedVertices, leaving its format alone. Returns false without packing
+// if an attribute does not fit the packed ranges (uvs outside of [0, 1]).
+bool pack_vertices(Mesh& mesh);
+
+// Loads from the cooked mesh cache when it is up to date, otherwise parses the OBJ and cooks it. Parsing is
+// split over workers if any are given.
+Mesh load_from_obj(const std::string& filepath, const std::string& mtlDir = "", VertexFormat format = VertexFormat::Full, ThreadPool* workers = nullptr);
@@ -0,0 +1,290 @@
+#include <pch.hpp>
+#include "vk_mesh_cache.hpp"
+
+#include "core/filesystem/mapped_file.hpp"
+
+namespace
+{
+  constexpr uint32_t MeshCacheMagic = 'V' | ('K' << 8) | ('M' << 16) | ('S' << 24);
+
+  // File layout: header | vertices | packed vertices | indices | meshlets | submeshes | material names (each null terminated)
+  struct MeshCacheHeader
+  {
+    uint32_t magic;
+    uint32_t version;
+
+    // Source stamp, the cache is valid if the size matches and either the write time or the content hash does
+    uint64_t sourceSize;
+    int64_t sourceWriteTime;
+    uint64_t sourceHash;
+
+    uint32_t vertexStride;
+    uint32_t vertexCount;
+    uint32_t packedVertexCount; // vertexCount, or 0 if the mesh does not fit the packed ranges
+    uint32_t indexStride;       // 2 or 4, whatever select_index_type picks for vertexCount
+    uint32_t indexCount;
+    uint32_t meshletCount;
+    uint32_t submeshCount;
+    uint32_t materialNameBytes;
+
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    glm::vec3 boundsOrigin;
+    float boundsRadius;
+    glm::vec4 positionDequant;
+  };
+
+  static_assert(sizeof(MeshCacheHeader) % alignof(Vertex) == 0, "Vertex blob must stay aligned after the header");
+
+  // 64 bit FNV-1a, only used to tell a touched file from a modified one
+  uint64_t hash_bytes(const unsigned char* data, size_t size)
+  {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i)
+    {
+      hash ^= data[i];
+      hash *= 1099511628211ull;
+    }
+    return hash;
+  }
+
+  std::optional<uint64_t> hash_file(const std::string& filePath)
+  {
+    MappedFile file;
+    if (!file.open(filePath))
+      return std::nullopt;
+
+    return hash_bytes(file.data(), file.size());
+  }
+
+  int64_t write_time(const std::filesystem::path& filePath, std::error_code& ec)
+  {
+    return std::filesystem::last_write_time(filePath, ec).time_since_epoch().count();
+  }
+}
+
+std::filesystem::path cooked_mesh_path(const std::string& sourcePath)
+{
+  // Sources sharing a file name in different directories get their own cache, the name is only kept readable
+  std::error_code ec;
+  std::filesystem::path fullPath = std::filesystem::weakly_canonical(std::filesystem::absolute(sourcePath, ec), ec);
+  if (ec)
+    fullPath = std::filesystem::path(sourcePath).lexically_normal();
+
+  const std::string fullPathString = fullPath.generic_string();
+  const uint64_t pathHash = hash_bytes((const unsigned char*)fullPathString.data(), fullPathString.size());
+
+  std::filesystem::path fileName = std::filesystem::path(sourcePath).filename();
+  fileName += fmt::format("-{:016x}.vkmesh", pathHash);
+
+  return std::filesystem::current_path() / "cache" / fileName;
+}
+
+bool load_cooked_mesh(const std::string& sourcePath, VertexFormat format, Mesh& outMesh)
+{
+  const std::filesystem::path cookedPath = cooked_mesh_path(sourcePath);
+
+  MappedFile file;
+  if (!file.open(cookedPath.string()))
+    return false;
+
+  if (file.size() < sizeof(MeshCacheHeader))
+    return false;
+
+  MeshCacheHeader header;
+  memcpy(&header, file.data(), sizeof header);
+
+  if (header.magic != MeshCacheMagic || header.version != MeshCacheVersion || header.vertexStride != sizeof(Vertex))
+    return false;
+
+  if (header.packedVertexCount != 0 && header.packedVertexCount != header.vertexCount)
+    return false;
+
+  const VkIndexType indexType = select_index_type(header.vertexCount);
+  if (header.indexStride != (indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t)))
+    return false;
+
+  const size_t vertexBytes = (size_t)header.vertexCount * sizeof(Vertex);
+  const size_t packedVertexBytes = (size_t)header.packedVertexCount * sizeof(PackedVertex);
+  const size_t indexBytes = (size_t)header.indexCount * header.indexStride;
+  const size_t meshletBytes = (size_t)header.meshletCount * sizeof(Meshlet);
+  const size_t submeshBytes = (size_t)header.submeshCount * sizeof(Submesh);
+
+  if (file.size() != sizeof header + vertexBytes + packedVertexBytes + indexBytes + meshletBytes + submeshBytes + header.materialNameBytes)
+    return false;
+
+  // A missing source is fine, the cooked file is all we need to render
+  std::error_code ec;
+  const std::filesystem::path source{ sourcePath };
+  std::optional<int64_t> touchedWriteTime;
+  if (std::filesystem::exists(source, ec))
+  {
+    if (std::filesystem::file_size(source, ec) != header.sourceSize || ec)
+      return false;
+
+    const int64_t sourceWriteTime = write_time(source, ec);
+    if (ec)
+      return false;
+
+    if (sourceWriteTime != header.sourceWriteTime)
+    {
+      // Same size but touched since cooking, only hash the source if we really have to
+      std::optional<uint64_t> hash = hash_file(sourcePath);
+      if (!hash || *hash != header.sourceHash)
+        return false;
+
+      touchedWriteTime = sourceWriteTime;
+    }
+  }
+
+  // The blobs are already in the GPU layout, so this is a straight copy out of the mapping
+  const unsigned char* blob = file.data() + sizeof header;
+
+  // Only the layout that gets uploaded is copied, the other one stays in the file
+  if (format == VertexFormat::Packed && header.packedVertexCount > 0)
+  {
+    outMesh.format = VertexFormat::Packed;
+    outMesh.packedVertices.resize(header.packedVertexCount);
+    memcpy(outMesh.packedVertices.data(), blob + vertexBytes, packedVertexBytes);
+    outMesh.positionDequant = header.positionDequant;
+  }
+  else
+  {
+    outMesh.format = VertexFormat::Full;
+    outMesh.vertices.resize(header.vertexCount);
+    memcpy(outMesh.vertices.data(), blob, vertexBytes);
+  }
+  blob += vertexBytes + packedVertexBytes;
+
+  outMesh.indexType = indexType;
+  if (indexType == VK_INDEX_TYPE_UINT16)
+  {
+    outMesh.shortIndices.resize(header.indexCount);
+    memcpy(outMesh.shortIndices.data(), blob, indexBytes);
+  }
+  else
+  {
+    outMesh.indices.resize(header.indexCount);
+    memcpy(outMesh.indices.data(), blob, indexBytes);
+  }
+  blob += indexBytes;
+
+  outMesh.meshlets.resize(header.meshletCount);
+  memcpy(outMesh.meshlets.data(), blob, meshletBytes);
+  blob += meshletBytes;
+
+  outMesh.submeshes.resize(header.submeshCount);
+  memcpy(outMesh.submeshes.data(), blob, submeshBytes);
+  blob += submeshBytes;
+
+  outMesh.materialNames.clear();
+  for (const char* name = (const char*)blob; name < (const char*)blob + header.materialNameBytes; name += outMesh.materialNames.back().size() + 1)
+    outMesh.materialNames.emplace_back(name, strnlen(name, (const char*)blob + header.materialNameBytes - name));
+
+  outMesh.bounds = MeshBounds{
+    .min = header.boundsMin,
+    .max = header.boundsMax,
+    .origin = header.boundsOrigin,
+    .radius = header.boundsRadius
+  };
+
+  // The content still matches, stamping the new write time spares the next launch from hashing the source again.
+  // Failing to is harmless, the cache stays valid either way.
+  if (touchedWriteTime)
+  {
+    file.close();
+
+    std::fstream stamp(cookedPath, std::ios::binary | std::ios::in | std::ios::out);
+    if (stamp.is_open())
+    {
+      stamp.seekp(offsetof(MeshCacheHeader, sourceWriteTime));
+      stamp.write((const char*)&*touchedWriteTime, sizeof(int64_t));
+    }
+  }
+
+  return true;
+}
+
+bool cook_mesh(const std::string& sourcePath, const Mesh& mesh)
+{
+  std::error_code ec;
+  const std::filesystem::path source{ sourcePath };
+
+  const uint64_t sourceSize = std::filesystem::file_size(source, ec);
+  if (ec)
+    return false;
+
+  const int64_t sourceWriteTime = write_time(source, ec);
+  if (ec)
+    return false;
+
+  std::optional<uint64_t> sourceHash = hash_file(sourcePath);
+  if (!sourceHash)
+    return false;
+
+  // Written as narrow_indices left them, which has to agree with what loading picks for the vertex count
+  const uint32_t indexStride = mesh.indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+  if (mesh.indexType != select_index_type(mesh.vertices.size()))
+    return false;
+
+  uint32_t materialNameBytes = 0;
+  for (const std::string& name : mesh.materialNames)
+    materialNameBytes += (uint32_t)name.size() + 1;
+
+  MeshCacheHeader header{
+    .magic = MeshCacheMagic,
+    .version = MeshCacheVersion,
+
+    .sourceSize = sourceSize,
+    .sourceWriteTime = sourceWriteTime,
+    .sourceHash = *sourceHash,
+
+    .vertexStride = sizeof(Vertex),
+    .vertexCount = (uint32_t)mesh.vertices.size(),
+    .packedVertexCount = (uint32_t)mesh.packedVertices.size(),
+    .indexStride = indexStride,
+    .indexCount = (uint32_t)index_count(mesh),
+    .meshletCount = (uint32_t)mesh.meshlets.size(),
+    .submeshCount = (uint32_t)mesh.submeshes.size(),
+    .materialNameBytes = materialNameBytes,
+
+    .boundsMin = mesh.bounds.min,
+    .boundsMax = mesh.bounds.max,
+    .boundsOrigin = mesh.bounds.origin,
+    .boundsRadius = mesh.bounds.radius,
+    .positionDequant = mesh.positionDequant
+  };
+
+  const std::filesystem::path cookedPath = cooked_mesh_path(sourcePath);
+  std::filesystem::create_directories(cookedPath.parent_path(), ec);
+  if (ec)
+    return false;
+
+  // Write next to the final file and swap it in, so a crash never leaves a half written cache behind
+  std::filesystem::path tempPath = cookedPath;
+  tempPath += ".tmp";
+
+  {
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+      return false;
+
+    file.write((const char*)&header, sizeof header);
+    file.write((const char*)mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+    file.write((const char*)mesh.packedVertices.data(), mesh.packedVertices.size() * sizeof(PackedVertex));
+    if (mesh.indexType == VK_INDEX_TYPE_UINT16)
+      file.write((const char*)mesh.shortIndices.data(), mesh.shortIndices.size() * sizeof(uint16_t));
+    else
+      file.write((const char*)mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+    file.write((const char*)mesh.meshlets.data(), mesh.meshlets.size() * sizeof(Meshlet));
+    file.write((const char*)mesh.submeshes.data(), mesh.submeshes.size() * sizeof(Submesh));
+    for (const std::string& name : mesh.materialNames)
+      file.write(name.c_str(), name.size() + 1);
+
+    if (!file)
+      return false;
+  }
+
+  std::filesystem::rename(tempPath, cookedPath, ec);
+  return !ec;
+}
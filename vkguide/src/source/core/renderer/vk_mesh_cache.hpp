@@ -0,0 +1,22 @@
+#pragma once
+
+#include "core/renderer/vk_mesh.hpp"
+
+// Bump whenever the cooked layout or the processing baked into it changes, stale caches are then re-cooked
+constexpr uint32_t MeshCacheVersion = 7;
+
+// Path of the cooked .vkmesh file that caches the given source mesh
+[[nodiscard]]
+std::filesystem::path cooked_mesh_path(const std::string& sourcePath);
+
+// Memory maps the cooked mesh for sourcePath and copies its blobs into outMesh, only the vertices of the
+// requested format (the full ones if the mesh could not be packed). Fails if there is no cooked file or it
+// no longer matches the source file.
+[[nodiscard]]
+bool load_cooked_mesh(const std::string& sourcePath, VertexFormat format, Mesh& outMesh);
+
+// Writes the processed mesh for sourcePath so the next load can skip parsing. Both vertex layouts are written,
+// the mesh needs its full vertices and its packed ones if pack_vertices succeeded. Indices are written in the
+// width narrow_indices left them in.
+[[nodiscard]]
+bool cook_mesh(const std::string& sourcePath, const Mesh& mesh);
@@ -0,0 +1,279 @@
+#include <pch.hpp>
+#include "vk_mesh_optimizer.hpp"
+
+namespace
+{
+  constexpr uint32_t InvalidIndex = std::numeric_limits<uint32_t>::max();
+
+  // Tipsify's fallback when the current fan runs dry: a recently used vertex that still has
+  // triangles left, or else the next vertex in input order that does
+  int64_t skip_dead_end(std::vector<uint32_t>& deadEnd, const std::vector<uint32_t>& liveTriangles, size_t& cursor)
+  {
+    while (!deadEnd.empty())
+    {
+      const uint32_t v = deadEnd.back();
+      deadEnd.pop_back();
+
+      if (liveTriangles[v] > 0)
+        return v;
+    }
+
+    for (; cursor < liveTriangles.size(); ++cursor)
+    {
+      if (liveTriangles[cursor] > 0)
+        return cursor;
+    }
+
+    return -1;
+  }
+}
+
+VertexCacheStats analyze_vertex_cache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize)
+{
+  // Time each vertex last entered the FIFO, a vertex is cached while fewer than cacheSize others entered since
+  std::vector<uint64_t> entered(vertexCount, 0);
+  uint64_t time = cacheSize + 1;
+  uint64_t misses = 0;
+
+  for (size_t i = 0; i < indexCount; ++i)
+  {
+    const uint32_t v = indices[i];
+    if (time - entered[v] > cacheSize)
+    {
+      entered[v] = time++;
+      ++misses;
+    }
+  }
+
+  const size_t triangleCount = indexCount / 3;
+  return VertexCacheStats{
+    .acmr = triangleCount ? (float)misses / triangleCount : 0.f,
+    .atvr = vertexCount ? (float)misses / vertexCount : 0.f,
+  };
+}
+
+void optimize_vertex_cache(uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize, std::vector<uint32_t>* clusterStarts)
+{
+  const size_t triangleCount = indexCount / 3;
+  if (triangleCount == 0)
+    return;
+
+  // Vertex -> triangle adjacency, laid out as one array with per vertex offsets
+  std::vector<uint32_t> liveTriangles(vertexCount, 0);
+  for (size_t i = 0; i < indexCount; ++i)
+    ++liveTriangles[indices[i]];
+
+  std::vector<uint32_t> offsets(vertexCount + 1, 0);
+  for (size_t v = 0; v < vertexCount; ++v)
+    offsets[v + 1] = offsets[v] + liveTriangles[v];
+
+  std::vector<uint32_t> adjacency(indexCount);
+  {
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indexCount; ++i)
+      adjacency[fill[indices[i]]++] = (uint32_t)(i / 3);
+  }
+
+  std::vector<uint32_t> timestamps(vertexCount, 0);
+  std::vector<uint8_t> emitted(triangleCount, 0);
+  std::vector<uint32_t> deadEnd;
+  std::vector<uint32_t> candidates;
+  std::vector<uint32_t> output;
+  deadEnd.reserve(indexCount);
+  output.reserve(indexCount);
+
+  uint32_t time = cacheSize + 1;
+  size_t cursor = 0;
+
+  if (clusterStarts)
+    clusterStarts->clear();
+
+  int64_t fanning = skip_dead_end(deadEnd, liveTriangles, cursor);
+  while (fanning >= 0)
+  {
+    if (clusterStarts && (clusterStarts->empty() || candidates.empty()))
+      clusterStarts->push_back((uint32_t)(output.size() / 3));
+
+    // Emit every remaining triangle around the fanning vertex
+    candidates.clear();
+    for (uint32_t a = offsets[fanning]; a < offsets[fanning + 1]; ++a)
+    {
+      const uint32_t t = adjacency[a];
+      if (emitted[t])
+        continue;
+
+      for (int k = 0; k < 3; ++k)
+      {
+        const uint32_t v = indices[3 * t + k];
+
+        output.push_back(v);
+        deadEnd.push_back(v);
+        candidates.push_back(v);
+        --liveTriangles[v];
+
+        if (time - timestamps[v] > cacheSize)
+          timestamps[v] = time++;
+      }
+
+      emitted[t] = 1;
+    }
+
+    // Next fan: the candidate that will still be in the cache after emitting its triangles, oldest first
+    int64_t next = -1;
+    int64_t bestPriority = -1;
+    for (uint32_t v : candidates)
+    {
+      if (liveTriangles[v] == 0)
+        continue;
+
+      int64_t priority = 0;
+      if (time - timestamps[v] + 2 * liveTriangles[v] <= cacheSize)
+        priority = time - timestamps[v];
+
+      if (priority > bestPriority)
+      {
+        bestPriority = priority;
+        next = v;
+      }
+    }
+
+    if (next < 0)
+    {
+      next = skip_dead_end(deadEnd, liveTriangles, cursor);
+      // Clear the candidates so the next iteration opens a new cluster
+      candidates.clear();
+    }
+
+    fanning = next;
+  }
+
+  memcpy(indices, output.data(), indexCount * sizeof(uint32_t));
+}
+
+void optimize_overdraw(uint32_t* indices, size_t indexCount, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& clusterStarts)
+{
+  const size_t triangleCount = indexCount / 3;
+  const size_t clusterCount = clusterStarts.size();
+  if (clusterCount < 2)
+    return;
+
+  struct Cluster
+  {
+    glm::vec3 centroid{ 0.f };
+    glm::vec3 normal{ 0.f }; // Sum of the triangles' area weighted normals
+    float area = 0.f;
+  };
+
+  std::vector<Cluster> clusters(clusterCount);
+  glm::vec3 meshCentroid{ 0.f };
+  float meshArea = 0.f;
+
+  for (size_t c = 0; c < clusterCount; ++c)
+  {
+    const size_t begin = clusterStarts[c];
+    const size_t end = c + 1 < clusterCount ? clusterStarts[c + 1] : triangleCount;
+
+    Cluster& cluster = clusters[c];
+    for (size_t t = begin; t < end; ++t)
+    {
+      const glm::vec3& p0 = vertices[indices[3 * t + 0]].position;
+      const glm::vec3& p1 = vertices[indices[3 * t + 1]].position;
+      const glm::vec3& p2 = vertices[indices[3 * t + 2]].position;
+
+      const glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+      const float area = glm::length(n) * .5f;
+
+      cluster.centroid += (p0 + p1 + p2) * (area / 3.f);
+      cluster.normal += n;
+      cluster.area += area;
+    }
+
+    meshCentroid += cluster.centroid;
+    meshArea += cluster.area;
+
+    if (cluster.area > 0.f)
+      cluster.centroid /= cluster.area;
+  }
+
+  if (meshArea > 0.f)
+    meshCentroid /= meshArea;
+
+  // Occlusion potential: clusters far out along their own normal are likely in front of the rest
+  std::vector<float> potential(clusterCount, 0.f);
+  for (size_t c = 0; c < clusterCount; ++c)
+  {
+    const float normalLength = glm::length(clusters[c].normal);
+    if (normalLength > 0.f)
+      potential[c] = glm::dot(clusters[c].centroid - meshCentroid, clusters[c].normal / normalLength);
+  }
+
+  std::vector<uint32_t> order(clusterCount);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&potential](uint32_t a, uint32_t b) { return potential[a] > potential[b]; });
+
+  std::vector<uint32_t> output;
+  output.reserve(indexCount);
+  for (uint32_t c : order)
+  {
+    const size_t begin = clusterStarts[c];
+    const size_t end = c + 1 < clusterCount ? clusterStarts[c + 1] : triangleCount;
+    output.insert(output.end(), indices + 3 * begin, indices + 3 * end);
+  }
+
+  memcpy(indices, output.data(), indexCount * sizeof(uint32_t));
+}
+
+void optimize_vertex_fetch(Mesh& mesh)
+{
+  std::vector<uint32_t> remap(mesh.vertices.size(), InvalidIndex);
+  uint32_t next = 0;
+
+  for (uint32_t& index : mesh.indices)
+  {
+    if (remap[index] == InvalidIndex)
+      remap[index] = next++;
+
+    index = remap[index];
+  }
+
+  std::vector<Vertex> vertices(next);
+  for (size_t v = 0; v < mesh.vertices.size(); ++v)
+  {
+    if (remap[v] != InvalidIndex)
+      vertices[remap[v]] = mesh.vertices[v];
+  }
+
+  mesh.vertices = std::move(vertices);
+}
+
+void optimize_mesh(Mesh& mesh, bool reduceOverdraw)
+{
+  const auto t1 = std::chrono::high_resolution_clock::now();
+
+  const VertexCacheStats before = analyze_vertex_cache(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+
+  // Submeshes are reordered one by one so their triangles never mix
+  size_t clusterCount = 0;
+  for (const Submesh& submesh : mesh.submeshes)
+  {
+    uint32_t* indices = mesh.indices.data() + submesh.lods[0].firstIndex;
+    const size_t indexCount = submesh.lods[0].indexCount;
+
+    std::vector<uint32_t> clusterStarts;
+    optimize_vertex_cache(indices, indexCount, mesh.vertices.size(), VertexCacheSize, reduceOverdraw ? &clusterStarts : nullptr);
+
+    if (reduceOverdraw)
+      optimize_overdraw(indices, indexCount, mesh.vertices, clusterStarts);
+
+    clusterCount += clusterStarts.size();
+  }
+
+  optimize_vertex_fetch(mesh);
+
+  const VertexCacheStats after = analyze_vertex_cache(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+
+  const auto t2 = std::chrono::high_resolution_clock::now();
+  std::cout << fmt::format("  Vertex cache ({} entries): ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}, {} overdraw clusters, {:.4} seconds\n",
+    VertexCacheSize, before.acmr, after.acmr, before.atvr, after.atvr, clusterCount,
+    std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count() / 1000000000.0);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "core/renderer/vk_mesh.hpp"
+
+// Post transform cache size the optimizer targets and the analysis simulates (FIFO)
+constexpr uint32_t VertexCacheSize = 16;
+
+struct VertexCacheStats
+{
+  float acmr; // Average cache miss ratio, transformed vertices per triangle (0.5 is ideal, 3 is worst)
+  float atvr; // Average transformed vertex ratio, transformed vertices per vertex (1 is ideal)
+};
+
+[[nodiscard]]
+VertexCacheStats analyze_vertex_cache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = VertexCacheSize);
+
+// Reorders the triangles of an index range for post transform cache locality (Tipsify, Sander et al. 2007).
+// If clusterStarts is given it receives the first triangle of every run Tipsify emitted without hitting a dead end.
+void optimize_vertex_cache(uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = VertexCacheSize, std::vector<uint32_t>* clusterStarts = nullptr);
+
+// Reorders the clusters of a cache optimized index range so outward facing clusters draw first, which lets
+// the depth test reject more of what follows. Triangle order inside each cluster is kept.
+void optimize_overdraw(uint32_t* indices, size_t indexCount, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& clusterStarts);
+
+// Renumbers vertices in the order the index buffer first references them and drops unreferenced ones
+void optimize_vertex_fetch(Mesh& mesh);
+
+// Runs the whole pass over the full detail range of every submesh and prints ACMR/ATVR before and after
+void optimize_mesh(Mesh& mesh, bool reduceOverdraw = true);
@@ -0,0 +1,436 @@
+#include <pch.hpp>
+#include "vk_mesh_simplifier.hpp"
+
+#include "core/renderer/vk_mesh_optimizer.hpp"
+
+namespace
+{
+  // Open borders also get planes perpendicular to their triangle, weighted up so the outline does not shrink
+  constexpr double BorderWeight = 10.0;
+
+  // A level has to drop at least this fraction of the previous level's triangles to be worth storing
+  constexpr float MinLodReduction = 0.2f;
+  constexpr size_t MinLodTriangles = 16;
+
+  struct Quadric
+  {
+    // Upper triangle of the symmetric 4x4 matrix, doubles since big meshes accumulate a lot of planes
+    double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+    double a11 = 0, a12 = 0, a13 = 0;
+    double a22 = 0, a23 = 0;
+    double a33 = 0;
+    double weight = 0;
+
+    void add_plane(const glm::vec3& n, float d, double w)
+    {
+      const double x = n.x, y = n.y, z = n.z;
+      a00 += w * x * x; a01 += w * x * y; a02 += w * x * z; a03 += w * x * d;
+      a11 += w * y * y; a12 += w * y * z; a13 += w * y * d;
+      a22 += w * z * z; a23 += w * z * d;
+      a33 += w * d * d;
+      weight += w;
+    }
+
+    void add(const Quadric& q)
+    {
+      a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+      a11 += q.a11; a12 += q.a12; a13 += q.a13;
+      a22 += q.a22; a23 += q.a23;
+      a33 += q.a33;
+      weight += q.weight;
+    }
+
+    // Weighted mean squared distance of p to the accumulated planes
+    double error(const glm::vec3& p) const
+    {
+      const double x = p.x, y = p.y, z = p.z;
+      const double e =
+        a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x +
+        a11 * y * y + 2 * a12 * y * z + 2 * a13 * y +
+        a22 * z * z + 2 * a23 * z +
+        a33;
+
+      return weight > 0 ? std::abs(e) / weight : 0;
+    }
+  };
+
+  struct Collapse
+  {
+    uint32_t from;
+    uint32_t to;
+    double cost;
+  };
+
+  uint64_t edge_key(uint32_t a, uint32_t b)
+  {
+    return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+  }
+}
+
+std::vector<uint32_t> simplify_mesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+  size_t targetIndexCount, float maxError, float* outError)
+{
+  std::vector<uint32_t> result = indices;
+  if (outError)
+    *outError = 0.f;
+
+  const size_t vertexCount = vertices.size();
+  const float radius = compute_bounds(vertices).radius;
+  if (result.size() <= targetIndexCount || vertexCount == 0 || radius <= 0.f)
+    return result;
+
+  // Vertices split by normals or uvs share a position, collapses work on these position classes.
+  // A class is named after its lowest vertex, wedges are the vertices in it.
+  std::vector<uint32_t> order(vertexCount);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&vertices](uint32_t l, uint32_t r) {
+    const glm::vec3& a = vertices[l].position;
+    const glm::vec3& b = vertices[r].position;
+    return std::tie(a.x, a.y, a.z, l) < std::tie(b.x, b.y, b.z, r);
+  });
+
+  std::vector<uint32_t> classOf(vertexCount);
+  std::vector<uint32_t> wedgeFirst(vertexCount, 0), wedgeCount(vertexCount, 0);
+  // Classes whose wedges disagree on uvs, moving them would tear or smear the texture
+  std::vector<uint8_t> seam(vertexCount, 0);
+
+  for (size_t i = 0; i < vertexCount;)
+  {
+    size_t j = i + 1;
+    while (j < vertexCount && vertices[order[j]].position == vertices[order[i]].position)
+      ++j;
+
+    const uint32_t c = order[i];
+    wedgeFirst[c] = (uint32_t)i;
+    wedgeCount[c] = (uint32_t)(j - i);
+
+    for (size_t k = i; k < j; ++k)
+    {
+      classOf[order[k]] = c;
+      if (vertices[order[k]].uv != vertices[c].uv)
+        seam[c] = 1;
+    }
+
+    i = j;
+  }
+
+  auto position = [&vertices](uint32_t c) -> const glm::vec3& { return vertices[c].position; };
+
+  auto degenerate = [&classOf](uint32_t a, uint32_t b, uint32_t c) {
+    return classOf[a] == classOf[b] || classOf[b] == classOf[c] || classOf[a] == classOf[c];
+  };
+
+  // Triangles that already collapsed to a line in position space only get in the way of the flip test
+  size_t kept = 0;
+  for (size_t i = 0; i < result.size(); i += 3)
+  {
+    if (degenerate(result[i + 0], result[i + 1], result[i + 2]))
+      continue;
+
+    result[kept++] = result[i + 0];
+    result[kept++] = result[i + 1];
+    result[kept++] = result[i + 2];
+  }
+  result.resize(kept);
+
+  // Area weighted plane quadrics per class, plus border planes for edges only one triangle uses
+  std::vector<Quadric> quadrics(vertexCount);
+  std::vector<std::pair<uint64_t, uint32_t>> edges;
+  edges.reserve(result.size());
+
+  for (size_t t = 0; t < result.size() / 3; ++t)
+  {
+    const uint32_t c[3] = { classOf[result[t * 3 + 0]], classOf[result[t * 3 + 1]], classOf[result[t * 3 + 2]] };
+
+    glm::vec3 n = glm::cross(position(c[1]) - position(c[0]), position(c[2]) - position(c[0]));
+    const float length = glm::length(n);
+    if (length <= 0.f)
+      continue;
+
+    n /= length;
+    const float d = -glm::dot(n, position(c[0]));
+    for (uint32_t k = 0; k < 3; ++k)
+    {
+      quadrics[c[k]].add_plane(n, d, length * .5);
+      edges.emplace_back(edge_key(c[k], c[(k + 1) % 3]), (uint32_t)t);
+    }
+  }
+
+  std::sort(edges.begin(), edges.end());
+
+  for (size_t i = 0; i < edges.size();)
+  {
+    size_t j = i + 1;
+    while (j < edges.size() && edges[j].first == edges[i].first)
+      ++j;
+
+    if (j - i == 1)
+    {
+      const uint32_t a = (uint32_t)(edges[i].first >> 32), b = (uint32_t)edges[i].first;
+      const uint32_t* tri = &result[edges[i].second * 3];
+
+      const glm::vec3 n = glm::cross(vertices[tri[1]].position - vertices[tri[0]].position, vertices[tri[2]].position - vertices[tri[0]].position);
+      const glm::vec3 edge = position(b) - position(a);
+      const glm::vec3 borderNormal = glm::cross(edge, n);
+      const float length = glm::length(borderNormal);
+
+      if (length > 0.f)
+      {
+        const glm::vec3 plane = borderNormal / length;
+        const float d = -glm::dot(plane, position(a));
+        const double w = glm::dot(edge, edge) * BorderWeight;
+        quadrics[a].add_plane(plane, d, w);
+        quadrics[b].add_plane(plane, d, w);
+      }
+    }
+
+    i = j;
+  }
+
+  const double maxErrorSq = (double)maxError * radius * (double)maxError * radius;
+  double errorSq = 0;
+
+  std::vector<uint32_t> adjacencyStart(vertexCount + 1), adjacency;
+  std::vector<uint64_t> edgeKeys;
+  std::vector<Collapse> collapses;
+  std::vector<uint32_t> remap(vertexCount);
+  std::vector<uint8_t> touched(vertexCount);
+  std::vector<uint32_t> mark(vertexCount, 0);
+  uint32_t markStamp = 0;
+
+  // Every pass collapses the cheapest edges whose neighbourhoods do not overlap, then rebuilds the triangles
+  while (result.size() > targetIndexCount)
+  {
+    const size_t triangleCount = result.size() / 3;
+
+    // Triangles around every class
+    std::fill(adjacencyStart.begin(), adjacencyStart.end(), 0);
+    for (uint32_t index : result)
+      ++adjacencyStart[classOf[index] + 1];
+    std::partial_sum(adjacencyStart.begin(), adjacencyStart.end(), adjacencyStart.begin());
+
+    adjacency.resize(result.size());
+    std::vector<uint32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+    for (size_t i = 0; i < result.size(); ++i)
+      adjacency[fill[classOf[result[i]]]++] = (uint32_t)(i / 3);
+
+    // One candidate per edge, in whichever direction is cheaper. Seam classes only ever act as targets.
+    edgeKeys.clear();
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+      for (uint32_t k = 0; k < 3; ++k)
+        edgeKeys.push_back(edge_key(classOf[result[t * 3 + k]], classOf[result[t * 3 + (k + 1) % 3]]));
+    }
+
+    std::sort(edgeKeys.begin(), edgeKeys.end());
+    edgeKeys.erase(std::unique(edgeKeys.begin(), edgeKeys.end()), edgeKeys.end());
+
+    collapses.clear();
+    for (uint64_t key : edgeKeys)
+    {
+      const uint32_t a = (uint32_t)(key >> 32), b = (uint32_t)key;
+      if (seam[a] && seam[b])
+        continue;
+
+      Quadric q = quadrics[a];
+      q.add(quadrics[b]);
+
+      const double costAB = seam[a] ? std::numeric_limits<double>::max() : q.error(position(b));
+      const double costBA = seam[b] ? std::numeric_limits<double>::max() : q.error(position(a));
+
+      collapses.push_back(costAB <= costBA ? Collapse{ a, b, costAB } : Collapse{ b, a, costBA });
+    }
+
+    std::sort(collapses.begin(), collapses.end(), [](const Collapse& l, const Collapse& r) { return l.cost < r.cost; });
+
+    std::iota(remap.begin(), remap.end(), 0);
+    std::fill(touched.begin(), touched.end(), 0);
+
+    const size_t trianglesToRemove = std::max<size_t>((result.size() - targetIndexCount) / 3, 1);
+    size_t removed = 0;
+    size_t collapsed = 0;
+
+    for (const Collapse& collapse : collapses)
+    {
+      // Sorted, so nothing after this fits either
+      if (removed >= trianglesToRemove || collapse.cost > maxErrorSq)
+        break;
+
+      const uint32_t from = collapse.from, to = collapse.to;
+      if (touched[from] || touched[to])
+        continue;
+
+      // Reject collapses that flip a triangle or pinch the surface. The link condition: the classes around
+      // both ends may only meet at the far corners of the triangles on the collapsing edge.
+      markStamp += 2;
+      uint32_t sharedTriangles = 0;
+      bool valid = true;
+
+      for (uint32_t a = adjacencyStart[from]; a < adjacencyStart[from + 1] && valid; ++a)
+      {
+        const uint32_t* tri = &result[adjacency[a] * 3];
+        const uint32_t c[3] = { classOf[tri[0]], classOf[tri[1]], classOf[tri[2]] };
+
+        for (uint32_t k = 0; k < 3; ++k)
+          mark[c[k]] = markStamp;
+
+        if (c[0] == to || c[1] == to || c[2] == to)
+        {
+          ++sharedTriangles;
+          continue;
+        }
+
+        glm::vec3 before[3], after[3];
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+          before[k] = position(c[k]);
+          after[k] = c[k] == from ? position(to) : before[k];
+        }
+
+        const glm::vec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+        const glm::vec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+        valid = glm::dot(n0, n1) > 0.f;
+      }
+
+      if (!valid || sharedTriangles == 0)
+        continue;
+
+      uint32_t sharedNeighbours = 0;
+      for (uint32_t a = adjacencyStart[to]; a < adjacencyStart[to + 1]; ++a)
+      {
+        const uint32_t* tri = &result[adjacency[a] * 3];
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+          const uint32_t c = classOf[tri[k]];
+          if (c != from && c != to && mark[c] == markStamp)
+          {
+            // Count each neighbour once
+            mark[c] = markStamp + 1;
+            ++sharedNeighbours;
+          }
+        }
+      }
+
+      if (sharedNeighbours > sharedTriangles)
+        continue;
+
+      // Accept, lock the whole neighbourhood so later collapses in this pass see up to date geometry
+      for (uint32_t a = adjacencyStart[from]; a < adjacencyStart[from + 1]; ++a)
+      {
+        const uint32_t* tri = &result[adjacency[a] * 3];
+        for (uint32_t k = 0; k < 3; ++k)
+          touched[classOf[tri[k]]] = 1;
+      }
+      touched[to] = 1;
+
+      // Every wedge moves to the target wedge with the closest attributes
+      for (uint32_t w = wedgeFirst[from]; w < wedgeFirst[from] + wedgeCount[from]; ++w)
+      {
+        const Vertex& v = vertices[order[w]];
+
+        uint32_t best = to;
+        float bestScore = std::numeric_limits<float>::max();
+        for (uint32_t t = wedgeFirst[to]; t < wedgeFirst[to] + wedgeCount[to]; ++t)
+        {
+          const Vertex& target = vertices[order[t]];
+          const glm::vec2 uvDelta = target.uv - v.uv;
+          const float score = glm::dot(uvDelta, uvDelta) + (1.f - glm::dot(target.normal, v.normal));
+
+          if (score < bestScore)
+          {
+            best = order[t];
+            bestScore = score;
+          }
+        }
+
+        remap[order[w]] = best;
+      }
+
+      quadrics[to].add(quadrics[from]);
+      errorSq = std::max(errorSq, collapse.cost);
+      removed += sharedTriangles;
+      ++collapsed;
+    }
+
+    if (collapsed == 0)
+      break;
+
+    // Triangles across a collapsed edge come out degenerate
+    size_t write = 0;
+    for (size_t i = 0; i < result.size(); i += 3)
+    {
+      const uint32_t a = remap[result[i + 0]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+      if (degenerate(a, b, c))
+        continue;
+
+      result[write++] = a;
+      result[write++] = b;
+      result[write++] = c;
+    }
+
+    result.resize(write);
+  }
+
+  if (outError)
+    *outError = (float)(std::sqrt(errorSq) / radius);
+
+  return result;
+}
+
+void build_lods(Mesh& mesh)
+{
+  uint32_t levelTriangles[MaxMeshLods]{};
+  float levelErrors[MaxMeshLods]{};
+  uint32_t levelCount = 0;
+
+  // Submeshes simplify on their own, their shared outlines are held in place by the border planes
+  for (Submesh& submesh : mesh.submeshes)
+  {
+    submesh.lodCount = 1;
+    submesh.lods[0].error = 0.f;
+
+    // Each level is simplified from the previous one, so errors add up along the chain
+    const uint32_t* fullIndices = mesh.indices.data() + submesh.lods[0].firstIndex;
+    std::vector<uint32_t> source(fullIndices, fullIndices + submesh.lods[0].indexCount);
+    float error = 0.f;
+
+    while (submesh.lodCount < MaxMeshLods)
+    {
+      const size_t targetIndexCount = source.size() / 6 * 3;
+      if (targetIndexCount / 3 < MinLodTriangles)
+        break;
+
+      float lodError = 0.f;
+      std::vector<uint32_t> lod = simplify_mesh(mesh.vertices, source, targetIndexCount, MaxLodError - error, &lodError);
+      if (lod.empty() || lod.size() > source.size() * (1.f - MinLodReduction))
+        break;
+
+      error += lodError;
+      optimize_vertex_cache(lod.data(), lod.size(), mesh.vertices.size());
+
+      submesh.lods[submesh.lodCount++] = MeshLod{
+        .firstIndex = (uint32_t)mesh.indices.size(),
+        .indexCount = (uint32_t)lod.size(),
+        .error = error * mesh.bounds.radius
+      };
+
+      mesh.indices.insert(mesh.indices.end(), lod.begin(), lod.end());
+      source = std::move(lod);
+    }
+
+    // Submeshes that stopped early draw their last level for the coarser ones
+    levelCount = std::max(levelCount, submesh.lodCount);
+    for (uint32_t level = 0; level < MaxMeshLods; ++level)
+    {
+      const MeshLod& lod = submesh.lods[std::min(level, submesh.lodCount - 1)];
+      levelTriangles[level] += lod.indexCount / 3;
+      levelErrors[level] = std::max(levelErrors[level], lod.error);
+    }
+  }
+
+  std::string report;
+  for (uint32_t level = 0; level < levelCount; ++level)
+    report += fmt::format(" {} ({:.2f}%)", levelTriangles[level], mesh.bounds.radius > 0.f ? levelErrors[level] / mesh.bounds.radius * 100.f : 0.f);
+
+  std::cout << fmt::format("  {} LODs over {} submeshes, triangles (error):{}\n", levelCount, mesh.submeshes.size(), report);
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "core/renderer/vk_mesh.hpp"
+
+// Stop adding LODs once a level needs more error than this, relative to the mesh radius
+constexpr float MaxLodError = 0.1f;
+
+// Quadric error edge collapse (Garland & Heckbert 1997) over an index buffer into vertices.
+// Edges collapse onto one of their existing vertices, so the result indexes the same vertex buffer and
+// LODs can share it. Vertices on uv seams never move, attributes are otherwise not part of the error.
+// Stops at targetIndexCount or before the next collapse would exceed maxError (relative to the mesh radius),
+// outError receives the relative error of the result.
+[[nodiscard]]
+std::vector<uint32_t> simplify_mesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+  size_t targetIndexCount, float maxError, float* outError = nullptr);
+
+// Appends up to MaxMeshLods - 1 simplified levels per submesh behind the full detail indices and fills in
+// the submeshes' lods. Each level halves the triangle count of the previous one until it stops paying off
+// or MaxLodError is hit.
+void build_lods(Mesh& mesh);
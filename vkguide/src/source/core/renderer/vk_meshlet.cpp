@@ -0,0 +1,144 @@
+#include <pch.hpp>
+#include "vk_meshlet.hpp"
+
+namespace
+{
+  void compute_meshlet_bounds(const Mesh& mesh, Meshlet& meshlet)
+  {
+    const uint32_t* indices = mesh.indices.data() + meshlet.firstIndex;
+
+    glm::vec3 min = mesh.vertices[indices[0]].position;
+    glm::vec3 max = min;
+    glm::vec3 normalSum{ 0.f };
+
+    for (uint32_t i = 0; i < meshlet.indexCount; i += 3)
+    {
+      const glm::vec3& p0 = mesh.vertices[indices[i + 0]].position;
+      const glm::vec3& p1 = mesh.vertices[indices[i + 1]].position;
+      const glm::vec3& p2 = mesh.vertices[indices[i + 2]].position;
+
+      min = glm::min(min, glm::min(p0, glm::min(p1, p2)));
+      max = glm::max(max, glm::max(p0, glm::max(p1, p2)));
+
+      const glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+      const float length = glm::length(n);
+      if (length > 0.f)
+        normalSum += n / length;
+    }
+
+    const glm::vec3 center = (min + max) * .5f;
+    float radius = 0.f;
+    for (uint32_t i = 0; i < meshlet.indexCount; ++i)
+      radius = std::max(radius, glm::length(mesh.vertices[indices[i]].position - center));
+
+    meshlet.sphere = glm::vec4{ center, radius };
+    meshlet.aabbMin = glm::vec4{ min, 0.f };
+    meshlet.aabbMax = glm::vec4{ max, 0.f };
+
+    // Normal cone: axis is the average normal, the spread is the widest triangle normal around it
+    const float axisLength = glm::length(normalSum);
+    if (axisLength <= 0.f)
+    {
+      meshlet.cone = glm::vec4{ 0.f, 0.f, 1.f, 2.f };
+      return;
+    }
+
+    const glm::vec3 axis = normalSum / axisLength;
+    float minDot = 1.f;
+    for (uint32_t i = 0; i < meshlet.indexCount; i += 3)
+    {
+      const glm::vec3& p0 = mesh.vertices[indices[i + 0]].position;
+      const glm::vec3& p1 = mesh.vertices[indices[i + 1]].position;
+      const glm::vec3& p2 = mesh.vertices[indices[i + 2]].position;
+
+      const glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+      const float length = glm::length(n);
+      if (length > 0.f)
+        minDot = std::min(minDot, glm::dot(axis, n / length));
+    }
+
+    // With a spread of 90 degrees or more some triangle always faces the eye
+    const float cutoff = minDot <= 0.f ? 2.f : std::sqrt(1.f - minDot * minDot);
+    meshlet.cone = glm::vec4{ axis, cutoff };
+  }
+}
+
+void build_meshlets(Mesh& mesh)
+{
+  mesh.meshlets.clear();
+
+  // Id of the last meshlet each vertex was added to, tells us which vertices the current one already holds
+  std::vector<uint32_t> owner(mesh.vertices.size(), std::numeric_limits<uint32_t>::max());
+  uint32_t meshletId = 0;
+  uint32_t indexCount = 0;
+
+  // Meshlets never straddle two submeshes, each has to be drawable with its submesh's material
+  for (Submesh& submesh : mesh.submeshes)
+  {
+    const uint32_t first = submesh.lods[0].firstIndex;
+    const uint32_t end = first + submesh.lods[0].indexCount;
+
+    submesh.firstMeshlet = (uint32_t)mesh.meshlets.size();
+    indexCount += submesh.lods[0].indexCount;
+
+    if (first == end)
+    {
+      submesh.meshletCount = 0;
+      continue;
+    }
+
+    Meshlet current{ .firstIndex = first };
+
+    for (uint32_t i = first; i < end; i += 3)
+    {
+      const uint32_t a = mesh.indices[i + 0], b = mesh.indices[i + 1], c = mesh.indices[i + 2];
+
+      auto count_new = [&]() {
+        uint32_t newVertices = 0;
+        newVertices += owner[a] != meshletId;
+        newVertices += owner[b] != meshletId && b != a;
+        newVertices += owner[c] != meshletId && c != a && c != b;
+        return newVertices;
+      };
+
+      uint32_t newVertices = count_new();
+      if (current.vertexCount + newVertices > MaxMeshletVertices || current.indexCount / 3 + 1 > MaxMeshletTriangles)
+      {
+        mesh.meshlets.push_back(current);
+
+        current = Meshlet{ .firstIndex = i };
+        ++meshletId;
+        newVertices = count_new();
+      }
+
+      owner[a] = owner[b] = owner[c] = meshletId;
+      current.vertexCount += newVertices;
+      current.indexCount += 3;
+    }
+
+    mesh.meshlets.push_back(current);
+    ++meshletId;
+
+    submesh.meshletCount = (uint32_t)mesh.meshlets.size() - submesh.firstMeshlet;
+  }
+
+  if (mesh.meshlets.empty())
+    return;
+
+  for (Meshlet& meshlet : mesh.meshlets)
+    compute_meshlet_bounds(mesh, meshlet);
+
+  std::cout << fmt::format("  {} meshlets, {:.1f} triangles and {:.1f} vertices on average\n", mesh.meshlets.size(),
+    (double)indexCount / 3 / mesh.meshlets.size(),
+    std::accumulate(mesh.meshlets.begin(), mesh.meshlets.end(), 0.0, [](double sum, const Meshlet& m) { return sum + m.vertexCount; }) / mesh.meshlets.size());
+}
+
+bool meshlet_backfacing(const Meshlet& meshlet, const glm::vec3& eye)
+{
+  // Sphere conservative cone test, holds for every point of the meshlet rather than just its center
+  const glm::vec3 center{ meshlet.sphere.x, meshlet.sphere.y, meshlet.sphere.z };
+  const glm::vec3 axis{ meshlet.cone.x, meshlet.cone.y, meshlet.cone.z };
+  const glm::vec3 toCenter = center - eye;
+
+  return glm::dot(toCenter, axis) >= meshlet.cone.w * glm::length(toCenter) + meshlet.sphere.w;
+}
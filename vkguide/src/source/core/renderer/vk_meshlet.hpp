@@ -0,0 +1,18 @@
+#pragma once
+
+#include "core/renderer/vk_mesh.hpp"
+
+constexpr uint32_t MaxMeshletVertices = 64;
+constexpr uint32_t MaxMeshletTriangles = 124;
+
+// Meshes with fewer meshlets than this are cheaper to draw whole than to cull per meshlet
+constexpr uint32_t MinMeshletsForCulling = 16;
+
+// Builds meshlets over the full detail range of every submesh in its current triangle order (run it after
+// optimize_mesh so they inherit the cache friendly order). Every meshlet is a contiguous range of mesh.indices
+// inside one submesh, nothing gets reordered.
+void build_meshlets(Mesh& mesh);
+
+// Normal cone test: true if every triangle of the meshlet faces away from the eye (given in object space)
+[[nodiscard]]
+bool meshlet_backfacing(const Meshlet& meshlet, const glm::vec3& eye);
@@ -0,0 +1,478 @@
+#include <pch.hpp>
+#include "vk_obj_parser.hpp"
+
+#include "core/filesystem/mapped_file.hpp"
+#include "core/threading/thread_pool.hpp"
+
+namespace
+{
+  // Chunks smaller than this are not worth a worker
+  constexpr size_t MinChunkSize = 256 * 1024;
+
+  constexpr uint32_t InvalidSlot = std::numeric_limits<uint32_t>::max();
+
+  struct CornerIndex
+  {
+    uint32_t position, texcoord, normal;
+  };
+
+  // Everything one thread pulled out of its line aligned slice of the file
+  struct ObjChunk
+  {
+    const char* begin;
+    const char* end;
+
+    std::vector<float> positions;
+    std::vector<float> normals;
+    std::vector<float> texcoords;
+    std::vector<CornerIndex> corners;
+
+    // usemtl lines as (first triangle of the chunk they apply to, material name)
+    std::vector<std::pair<uint32_t, std::string>> materialSwitches;
+
+    bool supported = true;
+  };
+
+  bool is_space(char c) { return c == ' ' || c == '\t'; }
+  bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+  const char* skip_space(const char* p, const char* end)
+  {
+    while (p < end && is_space(*p))
+      ++p;
+    return p;
+  }
+
+  // End of the line with trailing whitespace trimmed
+  const char* trim_end(const char* p, const char* end)
+  {
+    while (end > p && (is_space(end[-1]) || end[-1] == '\r'))
+      --end;
+    return end;
+  }
+
+  // Same as strcspn(p, " \t\r") but bounded by the line end
+  const char* token_end(const char* p, const char* end)
+  {
+    while (p < end && *p != ' ' && *p != '\t' && *p != '\r')
+      ++p;
+    return p;
+  }
+
+  // Mirrors tinyobjloader's tryParseDouble step for step. It is not correctly rounded, so using
+  // from_chars/strtod here would change the last bit of some values compared to the old loader.
+  bool parse_double(const char* s, const char* sEnd, double& result)
+  {
+    if (s >= sEnd)
+      return false;
+
+    double mantissa = 0.0;
+    int exponent = 0;
+    char sign = '+';
+    char expSign = '+';
+    const char* curr = s;
+    int read = 0;
+    bool leadingDecimalDot = false;
+
+    if (*curr == '+' || *curr == '-')
+    {
+      sign = *curr;
+      ++curr;
+      if (curr != sEnd && *curr == '.')
+        leadingDecimalDot = true;
+    }
+    else if (*curr == '.')
+      leadingDecimalDot = true;
+    else if (!is_digit(*curr))
+      return false;
+
+    if (!leadingDecimalDot)
+    {
+      while (curr != sEnd && is_digit(*curr))
+      {
+        mantissa *= 10;
+        mantissa += static_cast<int>(*curr - '0');
+        ++curr;
+        ++read;
+      }
+
+      if (read == 0)
+        return false;
+    }
+
+    if (curr != sEnd && *curr == '.')
+    {
+      ++curr;
+      read = 1;
+      while (curr != sEnd && is_digit(*curr))
+      {
+        static const double powLut[] = { 1.0, 0.1, 0.01, 0.001, 0.0001, 0.00001, 0.000001, 0.0000001 };
+        constexpr int lutEntries = sizeof powLut / sizeof powLut[0];
+
+        mantissa += static_cast<int>(*curr - '0') * (read < lutEntries ? powLut[read] : std::pow(10.0, -read));
+        ++read;
+        ++curr;
+      }
+    }
+
+    if (curr != sEnd && (*curr == 'e' || *curr == 'E'))
+    {
+      ++curr;
+      if (curr != sEnd && (*curr == '+' || *curr == '-'))
+      {
+        expSign = *curr;
+        ++curr;
+      }
+      else if (curr == sEnd || !is_digit(*curr))
+        return false;
+
+      read = 0;
+      while (curr != sEnd && is_digit(*curr))
+      {
+        if (exponent > std::numeric_limits<int>::max() / 10)
+          return false;
+
+        exponent *= 10;
+        exponent += static_cast<int>(*curr - '0');
+        ++curr;
+        ++read;
+      }
+
+      exponent *= (expSign == '+' ? 1 : -1);
+      if (read == 0)
+        return false;
+    }
+
+    result = (sign == '+' ? 1 : -1) * (exponent ? std::ldexp(mantissa * std::pow(5.0, exponent), exponent) : mantissa);
+    return true;
+  }
+
+  float parse_real(const char*& p, const char* end)
+  {
+    p = skip_space(p, end);
+    const char* tokenEnd = token_end(p, end);
+
+    double value = 0.0;
+    parse_double(p, tokenEnd, value);
+
+    p = tokenEnd;
+    return static_cast<float>(value);
+  }
+
+  // atoi semantics, stops at the first non digit
+  int parse_int(const char*& p, const char* end)
+  {
+    int sign = 1;
+    if (p < end && (*p == '+' || *p == '-'))
+    {
+      sign = *p == '-' ? -1 : 1;
+      ++p;
+    }
+
+    int value = 0;
+    while (p < end && is_digit(*p))
+    {
+      value = value * 10 + (*p - '0');
+      ++p;
+    }
+
+    return sign * value;
+  }
+
+  // Parses one "v/vt/vn" face corner into zero based indices
+  bool parse_corner(const char*& p, const char* end, CornerIndex& out)
+  {
+    int indices[3];
+    for (int i = 0; i < 3; ++i)
+    {
+      indices[i] = parse_int(p, end);
+
+      // Only absolute indices, relative ones depend on how many vertices preceded the chunk
+      if (indices[i] <= 0)
+        return false;
+
+      if (i < 2)
+      {
+        if (p == end || *p != '/')
+          return false;
+        ++p;
+      }
+    }
+
+    if (p != end && !is_space(*p) && *p != '\r')
+      return false;
+
+    out = { (uint32_t)indices[0] - 1, (uint32_t)indices[1] - 1, (uint32_t)indices[2] - 1 };
+    return true;
+  }
+
+  void parse_chunk(ObjChunk& chunk)
+  {
+    const char* line = chunk.begin;
+    while (line < chunk.end && chunk.supported)
+    {
+      const char* lineEnd = static_cast<const char*>(memchr(line, '\n', chunk.end - line));
+      if (!lineEnd)
+        lineEnd = chunk.end;
+
+      const char* p = skip_space(line, lineEnd);
+      const size_t length = lineEnd - p;
+
+      if (length >= 2 && p[0] == 'v' && is_space(p[1]))
+      {
+        p += 2;
+        chunk.positions.push_back(parse_real(p, lineEnd));
+        chunk.positions.push_back(parse_real(p, lineEnd));
+        chunk.positions.push_back(parse_real(p, lineEnd));
+      }
+      else if (length >= 3 && p[0] == 'v' && p[1] == 'n' && is_space(p[2]))
+      {
+        p += 3;
+        chunk.normals.push_back(parse_real(p, lineEnd));
+        chunk.normals.push_back(parse_real(p, lineEnd));
+        chunk.normals.push_back(parse_real(p, lineEnd));
+      }
+      else if (length >= 3 && p[0] == 'v' && p[1] == 't' && is_space(p[2]))
+      {
+        p += 3;
+        chunk.texcoords.push_back(parse_real(p, lineEnd));
+        chunk.texcoords.push_back(parse_real(p, lineEnd));
+      }
+      else if (length >= 2 && p[0] == 'f' && is_space(p[1]))
+      {
+        p += 2;
+
+        int cornerCount = 0;
+        while (true)
+        {
+          while (p < lineEnd && (is_space(*p) || *p == '\r'))
+            ++p;
+
+          if (p == lineEnd)
+            break;
+
+          CornerIndex corner;
+          if (cornerCount == 3 || !parse_corner(p, lineEnd, corner))
+          {
+            chunk.supported = false;
+            break;
+          }
+
+          chunk.corners.push_back(corner);
+          ++cornerCount;
+        }
+
+        // Polygons get triangulated by tinyobjloader, leave those to it
+        if (cornerCount != 3)
+          chunk.supported = false;
+      }
+      else if (length >= 7 && memcmp(p, "usemtl", 6) == 0 && is_space(p[6]))
+      {
+        p = skip_space(p + 6, lineEnd);
+        chunk.materialSwitches.emplace_back((uint32_t)(chunk.corners.size() / 3), std::string(p, trim_end(p, lineEnd)));
+      }
+      // Anything else (comments, groups, smoothing, mtllib) does not affect the vertex stream
+
+      line = lineEnd + 1;
+    }
+  }
+
+  void run_parallel(size_t count, const std::function<void(uint32_t)>& func, ThreadPool* workers)
+  {
+    if (workers)
+    {
+      workers->parallel_for((uint32_t)count, func);
+      return;
+    }
+
+    for (uint32_t i = 0; i < count; ++i)
+      func(i);
+  }
+}
+
+bool parse_obj_parallel(const std::string& filePath, std::vector<Vertex>& outCorners, ObjMaterials& outMaterials, ThreadPool* workers)
+{
+  const auto t1 = std::chrono::high_resolution_clock::now();
+
+  MappedFile file;
+  if (!file.open(filePath))
+    return false;
+
+  const char* data = reinterpret_cast<const char*>(file.data());
+  const char* dataEnd = data + file.size();
+
+  // Split into line aligned chunks, one per worker and one for the calling thread
+  const size_t threadCount = workers ? workers->get_thread_count() + 1 : 1;
+  const size_t chunkCount = std::clamp<size_t>(file.size() / MinChunkSize, 1, threadCount);
+  const size_t chunkSize = file.size() / chunkCount;
+
+  std::vector<ObjChunk> chunks(chunkCount);
+  const char* chunkBegin = data;
+  for (size_t i = 0; i < chunkCount; ++i)
+  {
+    const char* chunkEnd = dataEnd;
+    if (i + 1 < chunkCount)
+    {
+      chunkEnd = std::max(chunkBegin, data + (i + 1) * chunkSize);
+      const char* newline = static_cast<const char*>(memchr(chunkEnd, '\n', dataEnd - chunkEnd));
+      chunkEnd = newline ? newline + 1 : dataEnd;
+    }
+
+    chunks[i].begin = chunkBegin;
+    chunks[i].end = chunkEnd;
+    chunkBegin = chunkEnd;
+  }
+
+  run_parallel(chunkCount, [&chunks](uint32_t i) { parse_chunk(chunks[i]); }, workers);
+
+  // Merge, face indices are absolute so the attribute arrays just get concatenated in file order
+  std::vector<float> positions, normals, texcoords;
+  std::vector<size_t> cornerOffsets(chunkCount);
+  size_t cornerCount = 0;
+  for (size_t i = 0; i < chunkCount; ++i)
+  {
+    const ObjChunk& chunk = chunks[i];
+    if (!chunk.supported)
+      return false;
+
+    positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+    normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+    texcoords.insert(texcoords.end(), chunk.texcoords.begin(), chunk.texcoords.end());
+
+    cornerOffsets[i] = cornerCount;
+    cornerCount += chunk.corners.size();
+  }
+
+  const size_t positionCount = positions.size() / 3;
+  const size_t normalCount = normals.size() / 3;
+  const size_t texcoordCount = texcoords.size() / 2;
+
+  std::vector<Vertex> corners(cornerCount);
+  std::vector<uint8_t> chunkValid(chunkCount, 1);
+
+  // Expand the corners into vertices, each chunk writes its own range of the output
+  run_parallel(chunkCount, [&](uint32_t i) {
+    Vertex* out = corners.data() + cornerOffsets[i];
+    for (const CornerIndex& idx : chunks[i].corners)
+    {
+      if (idx.position >= positionCount || idx.normal >= normalCount || idx.texcoord >= texcoordCount)
+      {
+        chunkValid[i] = 0;
+        return;
+      }
+
+      Vertex& v = *out++;
+      v.position = { positions[3ull * idx.position + 0], positions[3ull * idx.position + 1], positions[3ull * idx.position + 2] };
+      v.normal = { normals[3ull * idx.normal + 0], normals[3ull * idx.normal + 1], normals[3ull * idx.normal + 2] };
+      v.color = v.normal;
+      v.uv.x = texcoords[2ull * idx.texcoord + 0];
+      v.uv.y = 1 - texcoords[2ull * idx.texcoord + 1]; // invert because Vulkan
+    }
+  }, workers);
+
+  if (std::find(chunkValid.begin(), chunkValid.end(), 0) != chunkValid.end())
+    return false;
+
+  // Materials carry over chunk boundaries, so the slots are resolved serially
+  ObjMaterials materials;
+  materials.triangleSlots.resize(cornerCount / 3);
+
+  std::unordered_map<std::string, uint32_t> slots;
+  auto slot_of = [&](const std::string& name) {
+    auto [iter, inserted] = slots.try_emplace(name, (uint32_t)materials.names.size());
+    if (inserted)
+      materials.names.push_back(name);
+    return iter->second;
+  };
+
+  uint32_t currentSlot = InvalidSlot;
+  for (size_t i = 0; i < chunkCount; ++i)
+  {
+    const ObjChunk& chunk = chunks[i];
+    uint32_t* slotOut = materials.triangleSlots.data() + cornerOffsets[i] / 3;
+    const uint32_t triangleCount = (uint32_t)(chunk.corners.size() / 3);
+
+    uint32_t triangle = 0;
+    for (const auto& [firstTriangle, name] : chunk.materialSwitches)
+    {
+      if (firstTriangle > triangle && currentSlot == InvalidSlot)
+        currentSlot = slot_of("");
+
+      std::fill(slotOut + triangle, slotOut + firstTriangle, currentSlot);
+      triangle = firstTriangle;
+      currentSlot = slot_of(name);
+    }
+
+    if (triangle < triangleCount && currentSlot == InvalidSlot)
+      currentSlot = slot_of("");
+
+    std::fill(slotOut + triangle, slotOut + triangleCount, currentSlot);
+  }
+
+  outCorners = std::move(corners);
+  outMaterials = std::move(materials);
+
+  const auto t2 = std::chrono::high_resolution_clock::now();
+  const double seconds = std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count() / 1000000000.0;
+  const double megabytes = file.size() / (1024.0 * 1024.0);
+  std::cout << fmt::format("  Parsed {:.2f} MB on {} threads in {:.4} seconds ({:.1f} MB/s)\n", megabytes, chunkCount, seconds, megabytes / seconds);
+
+  return true;
+}
+
+bool scan_obj_materials(const std::string& filePath, ObjMaterials& outMaterials)
+{
+  MappedFile file;
+  if (!file.open(filePath))
+    return false;
+
+  const char* data = reinterpret_cast<const char*>(file.data());
+  const char* dataEnd = data + file.size();
+
+  ObjMaterials materials;
+
+  std::unordered_map<std::string, uint32_t> slots;
+  auto slot_of = [&](const std::string& name) {
+    auto [iter, inserted] = slots.try_emplace(name, (uint32_t)materials.names.size());
+    if (inserted)
+      materials.names.push_back(name);
+    return iter->second;
+  };
+
+  // Slots are handed out exactly like parse_obj_parallel does, so both agree on the numbering too
+  uint32_t currentSlot = InvalidSlot;
+  const char* line = data;
+  while (line < dataEnd)
+  {
+    const char* lineEnd = static_cast<const char*>(memchr(line, '\n', dataEnd - line));
+    if (!lineEnd)
+      lineEnd = dataEnd;
+
+    const char* p = skip_space(line, lineEnd);
+    const size_t length = lineEnd - p;
+
+    if (length >= 2 && p[0] == 'f' && is_space(p[1]))
+    {
+      uint32_t cornerCount = 0;
+      for (p = skip_space(p + 1, lineEnd); p < lineEnd && *p != '\r'; p = skip_space(token_end(p, lineEnd), lineEnd))
+        ++cornerCount;
+
+      if (cornerCount >= 3)
+      {
+        if (currentSlot == InvalidSlot)
+          currentSlot = slot_of("");
+        materials.triangleSlots.insert(materials.triangleSlots.end(), cornerCount - 2, currentSlot);
+      }
+    }
+    else if (length >= 7 && memcmp(p, "usemtl", 6) == 0 && is_space(p[6]))
+    {
+      p = skip_space(p + 6, lineEnd);
+      currentSlot = slot_of(std::string(p, trim_end(p, lineEnd)));
+    }
+
+    line = lineEnd + 1;
+  }
+
+  outMaterials = std::move(materials);
+  return true;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "core/renderer/vk_mesh.hpp"
+
+class ThreadPool;
+
+// Material assignment of an OBJ: a slot per triangle, slots are numbered in order of first use.
+// Slots are named after the usemtl line with surrounding whitespace trimmed, whether or not the .mtl defines it.
+// Triangles before the first usemtl get a slot named "".
+struct ObjMaterials
+{
+  std::vector<std::string> names;
+  std::vector<uint32_t> triangleSlots;
+};
+
+// Chunked OBJ ingest for the common case of triangulated meshes with positions, normals and uvs, the chunks
+// are split over workers if any are given. Writes three Vertex entries per triangle in file order, bit for bit
+// what the tinyobjloader path in load_from_obj produces. Returns false without touching the outputs if the file
+// uses anything this parser does not handle (polygons, relative or missing indices), callers then fall back to
+// tinyobjloader.
+[[nodiscard]]
+bool parse_obj_parallel(const std::string& filePath, std::vector<Vertex>& outCorners, ObjMaterials& outMaterials, ThreadPool* workers = nullptr);
+
+// Material assignment straight from the usemtl and f lines, polygons count as the fan of triangles they split into.
+// For loaders that resolve names against the .mtl and lose the ones it does not define.
+[[nodiscard]]
+bool scan_obj_materials(const std::string& filePath, ObjMaterials& outMaterials);
@@ -0,0 +1,105 @@
+#include <pch.hpp>
+#include "vk_render_queue.hpp"
+
+BindChanges BindTracker::update(VkPipeline pipeline, VkPipelineLayout layout, VkDescriptorSet texture, VkIndexType indexType)
+{
+  BindChanges changes;
+
+  if (pipeline != this->pipeline)
+  {
+    changes.pipeline = true;
+    this->pipeline = pipeline;
+    ++counts.pipelines;
+  }
+
+  // Sets bound under another layout can't be relied on, everything gets bound again
+  if (layout != this->layout)
+  {
+    changes.globalSets = true;
+    this->layout = layout;
+    this->texture = VK_NULL_HANDLE;
+    ++counts.descriptorSets;
+  }
+
+  if (texture != VK_NULL_HANDLE && texture != this->texture)
+  {
+    changes.texture = true;
+    this->texture = texture;
+    ++counts.descriptorSets;
+  }
+
+  if (indexType != this->indexType)
+  {
+    changes.indexBuffer = true;
+    this->indexType = indexType;
+    ++counts.indexBuffers;
+  }
+
+  return changes;
+}
+
+void RenderQueue::sort()
+{
+  if (items.size() < 2)
+    return;
+
+  // Histograms of all eight bytes in one sweep over the keys
+  uint32_t counts[8][256]{};
+  for (const DrawItem& item : items)
+  {
+    for (uint32_t byte = 0; byte < 8; ++byte)
+      ++counts[byte][(item.key >> (byte * 8)) & 0xff];
+  }
+
+  sorted.resize(items.size());
+
+  for (uint32_t byte = 0; byte < 8; ++byte)
+  {
+    const uint32_t shift = byte * 8;
+
+    // Every key has the same byte here, the pass would leave the order as is
+    if (counts[byte][(items[0].key >> shift) & 0xff] == items.size())
+      continue;
+
+    uint32_t offset = 0;
+    for (uint32_t& count : counts[byte])
+    {
+      const uint32_t bucket = count;
+      count = offset;
+      offset += bucket;
+    }
+
+    for (const DrawItem& item : items)
+      sorted[counts[byte][(item.key >> shift) & 0xff]++] = item;
+
+    items.swap(sorted);
+  }
+}
+
+uint32_t RenderQueue::get_pipeline_id(VkPipeline pipeline)
+{
+  return pipelineIds.try_emplace(pipeline, (uint32_t)pipelineIds.size()).first->second;
+}
+
+uint32_t RenderQueue::get_material_id(const Material* mat)
+{
+  return materialIds.try_emplace(mat, (uint32_t)materialIds.size()).first->second;
+}
+
+uint32_t RenderQueue::get_mesh_id(const Mesh* mesh)
+{
+  return meshIds.try_emplace(mesh, (uint32_t)meshIds.size()).first->second;
+}
+
+uint64_t RenderQueue::make_key(DrawPass pass, uint32_t pipeline, uint32_t material, VkIndexType indexType, uint32_t mesh, uint32_t submesh, float depth)
+{
+  const uint64_t depthBits = (uint64_t)(std::clamp(depth, 0.f, 1.f) * 0x7ff);
+
+  return (uint64_t)pass << 60
+    | (uint64_t)(pipeline & 0xfff) << 48
+    | (uint64_t)(material & 0xfff) << 36
+    | (uint64_t)(indexType == VK_INDEX_TYPE_UINT32) << 35
+    | (uint64_t)(mesh & 0xffff) << 19
+    | (uint64_t)(submesh & 0xff) << 11
+    | depthBits;
+}
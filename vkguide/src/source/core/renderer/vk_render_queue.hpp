@@ -0,0 +1,98 @@
+#pragma once
+
+#include "core/renderer/vk_types.hpp"
+
+struct Material;
+struct Mesh;
+
+// Order passes are drawn in, the top bits of a sort key
+enum class DrawPass : uint8_t
+{
+  Opaque = 0,
+};
+
+// One submesh of one object, object is its dense index in the SceneStore
+struct DrawItem
+{
+  uint64_t key;
+  Material* mat;
+  uint32_t object;
+  uint32_t submesh;
+};
+
+struct BindCounts
+{
+  uint32_t pipelines = 0;
+  uint32_t descriptorSets = 0;
+  uint32_t indexBuffers = 0;
+
+  [[nodiscard]]
+  uint32_t total() const { return pipelines + descriptorSets + indexBuffers; }
+};
+
+// Which binds a draw needs given what the previous draws bound
+struct BindChanges
+{
+  bool pipeline = false;
+  bool globalSets = false; // Scene and object sets, bound together whenever the pipeline layout changes
+  bool texture = false;
+  bool indexBuffer = false;
+};
+
+// State bound while recording, counts the binds the draws fed to it need
+class BindTracker
+{
+public:
+  BindChanges update(VkPipeline pipeline, VkPipelineLayout layout, VkDescriptorSet texture, VkIndexType indexType);
+
+  [[nodiscard]]
+  const BindCounts& get_counts() const { return counts; }
+
+private:
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  VkPipelineLayout layout = VK_NULL_HANDLE;
+  VkDescriptorSet texture = VK_NULL_HANDLE;
+  std::optional<VkIndexType> indexType;
+
+  BindCounts counts;
+};
+
+// Draws of a frame, sorted by a 64 bit key so draws sharing state end up next to each other. From the most
+// significant bits down the key holds:
+//   pass (4) | pipeline (12) | material (12) | index type (1) | mesh (16) | submesh (8) | depth (11)
+// Depth is the lowest priority, it only orders draws of the same submesh front to back. Those draws are
+// adjacent after sorting, which is what lets them become instances of one draw.
+class RenderQueue
+{
+public:
+  void clear() { items.clear(); }
+
+  void push(const DrawItem& item) { items.push_back(item); }
+
+  // Stable LSD radix sort over the key a byte at a time, bytes every key shares are skipped
+  void sort();
+
+  [[nodiscard]]
+  const std::vector<DrawItem>& get_items() const { return items; }
+
+  // Small ids for the key, handed out on first use and kept for the queue's lifetime. They wrap around once
+  // their field is full, which only costs some grouping.
+  [[nodiscard]]
+  uint32_t get_pipeline_id(VkPipeline pipeline);
+  [[nodiscard]]
+  uint32_t get_material_id(const Material* mat);
+  [[nodiscard]]
+  uint32_t get_mesh_id(const Mesh* mesh);
+
+  // depth is the distance from the camera over the far plane, clamped to 0..1
+  [[nodiscard]]
+  static uint64_t make_key(DrawPass pass, uint32_t pipeline, uint32_t material, VkIndexType indexType, uint32_t mesh, uint32_t submesh, float depth);
+
+private:
+  std::vector<DrawItem> items;
+  std::vector<DrawItem> sorted; // Scatter target of the sort passes, kept to not reallocate every frame
+
+  std::unordered_map<VkPipeline, uint32_t> pipelineIds;
+  std::unordered_map<const Material*, uint32_t> materialIds;
+  std::unordered_map<const Mesh*, uint32_t> meshIds;
+};
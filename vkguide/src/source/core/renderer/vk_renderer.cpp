@@ -1,7 +1,9 @@
 #include <pch.hpp>
 #include "core/renderer/vk_renderer.hpp"
 
+#include "core/renderer/vk_frustum.hpp"
 #include "core/renderer/vk_initializers.hpp"
+#include "core/renderer/vk_meshlet.hpp"
 #include "core/renderer/vk_textures.hpp"
 #include "core/filesystem/read_file.hpp"
 
@@ -41,7 +43,45 @@ void VulkanRenderer::init(const std::string& appName, const Window& window, bool
     .shaderDrawParameters = VK_TRUE,
   };
 
-  vkb::Device gpuDevice = vkb::DeviceBuilder{ selectedGpu }.add_pNext(&shaderDrawParamFeatures).build().value();
+  // Core since 1.2, uploads on the transfer queue signal a timeline semaphore the frames wait on.
+  // drawIndirectCount is enabled below when GPU culling is supported.
+  VkPhysicalDeviceVulkan12Features vulkan12Features{
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+    .pNext = nullptr,
+
+    .timelineSemaphore = VK_TRUE,
+  };
+
+  // Block compressed textures are optional, without them textures are uploaded as RGBA8
+  VkPhysicalDeviceFeatures supportedFeatures;
+  vkGetPhysicalDeviceFeatures(selectedGpu.physical_device, &supportedFeatures);
+  selectedGpu.features.textureCompressionBC = supportedFeatures.textureCompressionBC;
+  bcTextures = supportedFeatures.textureCompressionBC == VK_TRUE;
+
+  // Indirect draws need a first instance to index object data, GPU culling also writes the draw count. Without
+  // the count objects are culled on the CPU, without any of them the CPU draws them one call at a time.
+  VkPhysicalDeviceVulkan12Features supported12Features{
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+    .pNext = nullptr,
+  };
+
+  VkPhysicalDeviceFeatures2 supportedFeatures2{
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+    .pNext = &supported12Features,
+  };
+
+  vkGetPhysicalDeviceFeatures2(selectedGpu.physical_device, &supportedFeatures2);
+  indirectDrawsSupported = supportedFeatures.multiDrawIndirect && supportedFeatures.drawIndirectFirstInstance;
+  gpuCulling = indirectDrawsSupported && supported12Features.drawIndirectCount;
+  selectedGpu.features.multiDrawIndirect = indirectDrawsSupported;
+  selectedGpu.features.drawIndirectFirstInstance = indirectDrawsSupported;
+  vulkan12Features.drawIndirectCount = gpuCulling;
+
+  vkb::Device gpuDevice = vkb::DeviceBuilder{ selectedGpu }
+    .add_pNext(&shaderDrawParamFeatures)
+    .add_pNext(&vulkan12Features)
+    .build()
+    .value();
 
   gpu = selectedGpu.physical_device;
   gpuProperties = selectedGpu.properties;
@@ -52,6 +92,18 @@ void VulkanRenderer::init(const std::string& appName, const Window& window, bool
   graphicsQueue = gpuDevice.get_queue(vkb::QueueType::graphics).value();
   graphicsQueueFamily = gpuDevice.get_queue_index(vkb::QueueType::graphics).value();
 
+  // Uploads go to a queue family without graphics when there is one, preferably one that can only transfer
+  if (auto transferQueueFamily = gpuDevice.get_queue_index(vkb::QueueType::transfer); transferQueueFamily.has_value())
+  {
+    transfer.init(device, gpuDevice.get_queue(vkb::QueueType::transfer).value(), transferQueueFamily.value(), graphicsQueueFamily);
+    std::cout << fmt::format("Uploading on transfer queue family {}\n", transferQueueFamily.value());
+  }
+  else
+  {
+    transfer.init(device, graphicsQueue, graphicsQueueFamily, graphicsQueueFamily);
+    std::cout << "No separate transfer queue, uploading on the graphics queue\n";
+  }
+
   // init vma
   {
     VmaAllocatorCreateInfo allocInfo{
@@ -61,6 +113,24 @@ void VulkanRenderer::init(const std::string& appName, const Window& window, bool
     };
 
     vmaCreateAllocator(&allocInfo, &allocator);
+
+    // Resizable BAR or unified memory: device local memory the CPU can write, large enough to hold more than a
+    // few staging buffers. Discrete GPUs without resizable BAR only expose a 256 MB window of it.
+    const VkPhysicalDeviceMemoryProperties* memoryProperties;
+    vmaGetMemoryProperties(allocator, &memoryProperties);
+
+    constexpr VkMemoryPropertyFlags DirectFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+    for (uint32_t i = 0; i < memoryProperties->memoryTypeCount; ++i)
+    {
+      const VkMemoryType& type = memoryProperties->memoryTypes[i];
+      if ((type.propertyFlags & DirectFlags) == DirectFlags && memoryProperties->memoryHeaps[type.heapIndex].size >= DirectUploadMinHeapBytes)
+        directUploads = true;
+    }
+
+    std::cout << (directUploads ? "Device local memory is host visible, buffers are written directly\n" : "Uploading buffers through staging\n");
+
+    geometry.init(allocator, GeometryPoolVertexBytes, GeometryPoolIndexBytes, directUploads);
+    staging.init(device, allocator, StagingRingBytes);
   }
 
   // init swapchain
@@ -76,7 +146,8 @@ void VulkanRenderer::init(const std::string& appName, const Window& window, bool
 
     depthFormat = VK_FORMAT_D32_SFLOAT;
 
-    VkImageCreateInfo imageInfo = vkinit::image_create_info(depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, depthImageExtent);
+    // Sampled to build the depth pyramid occlusion culling tests against
+    VkImageCreateInfo imageInfo = vkinit::image_create_info(depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, depthImageExtent);
     VmaAllocationCreateInfo allocInfo{
       .usage = VMA_MEMORY_USAGE_GPU_ONLY,
       .requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
@@ -148,7 +219,7 @@ void VulkanRenderer::init(const std::string& appName, const Window& window, bool
       .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
 
       .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED, // Don't care about starting layout
-      .finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL // Final layout should be optimal for depth
+      .finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL // Read by the depth pyramid build
     };
 
     VkAttachmentReference depthAttachmentRef{
@@ -179,18 +250,31 @@ void VulkanRenderer::init(const std::string& appName, const Window& window, bool
       .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
     };
 
+    // The previous frame's depth pyramid build reads the depth attachment in compute
     VkSubpassDependency depthDep{
       .srcSubpass = VK_SUBPASS_EXTERNAL,
       .dstSubpass = 0,
 
-      .srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+      .srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
       .dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
 
       .srcAccessMask = 0,
       .dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
     };
 
-    VkSubpassDependency dependencies[2]{ colorDep, depthDep };
+    // Depth written in the pass is read by the depth pyramid build after it
+    VkSubpassDependency pyramidDep{
+      .srcSubpass = 0,
+      .dstSubpass = VK_SUBPASS_EXTERNAL,
+
+      .srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+      .dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+
+      .srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+      .dstAccessMask = VK_ACCESS_SHADER_READ_BIT
+    };
+
+    VkSubpassDependency dependencies[3]{ colorDep, depthDep, pyramidDep };
 
     VkRenderPassCreateInfo renderPassInfo{
       .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
@@ -202,11 +286,35 @@ void VulkanRenderer::init(const std::string& appName, const Window& window, bool
       .subpassCount = 1,
       .pSubpasses = &subpass,
 
-      .dependencyCount = 2,
+      .dependencyCount = 3,
       .pDependencies = dependencies
     };
 
     VK_CHECK(vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass));
+
+    // Draws what occlusion culling let through after the depth pyramid was rebuilt, on top of the first pass
+    if (gpuCulling)
+    {
+      attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+      attachments[0].initialLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+      attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+      attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+      attachments[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+      // Builds on the first pass's color and on depth the pyramid build just read
+      VkSubpassDependency lateColorDep = colorDep;
+      lateColorDep.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+      lateColorDep.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+      VkSubpassDependency lateDepthDep = depthDep;
+      lateDepthDep.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+      lateDepthDep.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+      VkSubpassDependency lateDependencies[3]{ lateColorDep, lateDepthDep, pyramidDep };
+      renderPassInfo.pDependencies = lateDependencies;
+
+      VK_CHECK(vkCreateRenderPass(device, &renderPassInfo, nullptr, &lateRenderPass));
+    }
   }
 
   // init framebuffers
@@ -260,15 +368,6 @@ void VulkanRenderer::init(const std::string& appName, const Window& window, bool
       VK_CHECK(vkCreateSemaphore(device, &semaphoreInfo, nullptr, &frame.present));
       VK_CHECK(vkCreateSemaphore(device, &semaphoreInfo, nullptr, &frame.render));
     }
-
-    VkFenceCreateInfo uploadFenceInfo{
-      .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-      .pNext = nullptr,
-
-      .flags = 0
-    };
-
-    VK_CHECK(vkCreateFence(device, &uploadFenceInfo, nullptr, &upload.upload));
   }
   
   // init descriptors
@@ -338,7 +437,7 @@ void VulkanRenderer::init(const std::string& appName, const Window& window, bool
     VK_CHECK(vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool));
 
     const auto sceneBufSize = MaxFramesInFlight * (pad_uniform_buffer_size(sizeof GPUCameraData + sizeof GPUSceneData));
-    sceneBuffer = create_buffer(sceneBufSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+    sceneBuffer = create_buffer(sceneBufSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, (void**)&sceneBufferData);
     
     VkDescriptorSetAllocateInfo allocInfo{
       .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
@@ -362,8 +461,10 @@ void VulkanRenderer::init(const std::string& appName, const Window& window, bool
 
     for (int i = 0; i < MaxFramesInFlight; ++i)
     {
-      constexpr int MaxObjects = 10000; // Small count but it's just for example.
-      frames[i].objectBuffer = create_buffer(sizeof GPUObjectData * MaxObjects, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+      frames[i].objectBuffer = create_buffer(sizeof GPUObjectData * MaxObjects, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, (void**)&frames[i].objectData);
+
+      if (indirectDrawsSupported)
+        frames[i].indirectBuffer = create_buffer(sizeof VkDrawIndexedIndirectCommand * MaxIndirectCommands, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, (void**)&frames[i].indirectData);
 
       VkDescriptorSetAllocateInfo objAllocInfo{
         .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
@@ -389,6 +490,35 @@ void VulkanRenderer::init(const std::string& appName, const Window& window, bool
 
       vkUpdateDescriptorSets(device, 2, writes, 0, nullptr);
     }
+
+    // The culling shader reads the pyramid, without either shader the draws fall back to being culled on the
+    // CPU, which has no occlusion culling and no late phase
+    if (gpuCulling && !depthPyramid.init(device, allocator, depthImageView, VkExtent2D{ window.get_width(), window.get_height() }))
+    {
+      vkDestroyRenderPass(device, lateRenderPass, nullptr);
+      gpuCulling = false;
+    }
+
+    if (gpuCulling)
+    {
+      immediate_submit([&](VkCommandBuffer cmd) { depthPyramid.record_clear(cmd); });
+
+      std::vector<VkBuffer> objectBuffers;
+      for (const FrameData& frame : frames)
+        objectBuffers.push_back(frame.objectBuffer.buffer);
+
+      if (!culler.init(device, allocator, objectBuffers, depthPyramid.get_view(), depthPyramid.get_sampler(), MaxObjects, MaxIndirectBatches))
+      {
+        depthPyramid.cleanup();
+        vkDestroyRenderPass(device, lateRenderPass, nullptr);
+        gpuCulling = false;
+      }
+    }
+
+    // Nothing builds a pyramid or runs a late phase without GPU culling
+    occlusionCulling = occlusionCulling && gpuCulling;
+
+    std::cout << (gpuCulling ? "Culling on the GPU with indirect draws\n" : "Culling on the CPU\n");
   }
 
   // init graphics pipelines
@@ -459,13 +589,6 @@ void VulkanRenderer::init(const std::string& appName, const Window& window, bool
     // Mesh Pipeline
     {
       auto meshPipelineLayoutInfo = vkinit::pipeline_layout_create_info();
-      VkPushConstantRange pushConstant{
-        .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
-        .offset = 0,
-        .size = sizeof MeshPushConstants,
-      };
-      meshPipelineLayoutInfo.pPushConstantRanges = &pushConstant;
-      meshPipelineLayoutInfo.pushConstantRangeCount = 1;
 
       VkDescriptorSetLayout setLayouts[] = { descriptorLayout, objectSetLayout };
 
@@ -497,7 +620,7 @@ void VulkanRenderer::init(const std::string& appName, const Window& window, bool
 
       meshPipeline = builder.build_pipeline(device, renderPass);
 
-      create_material(meshPipeline, meshPipelineLayout, "defaultmesh");
+      create_material(meshPipeline, meshPipelineLayout, "defaultmesh", builder.rasterizer.cullMode);
 
       vkDestroyShaderModule(device, meshVertShader, nullptr);
       vkDestroyShaderModule(device, meshFragShader, nullptr);
@@ -506,13 +629,6 @@ void VulkanRenderer::init(const std::string& appName, const Window& window, bool
     // Textured Mesh Pipeline
     {
       auto texturedPipelineLayoutInfo = vkinit::pipeline_layout_create_info();
-      VkPushConstantRange pushConstant{
-        .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
-        .offset = 0,
-        .size = sizeof MeshPushConstants,
-      };
-      texturedPipelineLayoutInfo.pPushConstantRanges = &pushConstant;
-      texturedPipelineLayoutInfo.pushConstantRangeCount = 1;
 
       VkDescriptorSetLayout setLayouts[] = { descriptorLayout, objectSetLayout, singleTextureSetLayout };
 
@@ -544,11 +660,59 @@ void VulkanRenderer::init(const std::string& appName, const Window& window, bool
 
       texturedPipeline = builder.build_pipeline(device, renderPass);
 
-      create_material(texturedPipeline, texturedPipelineLayout, "texturedmesh");
+      create_material(texturedPipeline, texturedPipelineLayout, "texturedmesh", builder.rasterizer.cullMode);
 
       vkDestroyShaderModule(device, textureVertShader, nullptr);
       vkDestroyShaderModule(device, textureFragShader, nullptr);
     }
+
+    // Packed vertex permutations of the mesh pipelines, same layouts and fragment shaders
+    {
+      VertexInputDescription vid = Vertex::get_vertex_description(VertexFormat::Packed);
+
+      builder.vertexInputInfo.vertexAttributeDescriptionCount = vid.attributes.size();
+      builder.vertexInputInfo.pVertexAttributeDescriptions = vid.attributes.data();
+      builder.vertexInputInfo.vertexBindingDescriptionCount = vid.bindings.size();
+      builder.vertexInputInfo.pVertexBindingDescriptions = vid.bindings.data();
+
+      VkShaderModule packedVertShader, meshFragShader, textureFragShader;
+
+      if (!vkinit::load_shader_module("shaders/tri_mesh_packed.vert.spv", device, packedVertShader))
+        std::cout << "Failed to build packed mesh vertex shader\n";
+
+      if (!vkinit::load_shader_module("shaders/default_lit.frag.spv", device, meshFragShader))
+        std::cout << "Failed to build mesh fragment shader\n";
+
+      if (!vkinit::load_shader_module("shaders/textured_lit.frag.spv", device, textureFragShader))
+        std::cout << "Failed to build textured mesh fragment shader\n";
+
+      builder.shaderStages = {
+        vkinit::shader_stage_create_info(VK_SHADER_STAGE_VERTEX_BIT, packedVertShader),
+        vkinit::shader_stage_create_info(VK_SHADER_STAGE_FRAGMENT_BIT, meshFragShader),
+      };
+      builder.pipelineLayout = meshPipelineLayout;
+
+      meshPackedPipeline = builder.build_pipeline(device, renderPass);
+
+      create_material(meshPackedPipeline, meshPipelineLayout, "defaultmesh_packed", builder.rasterizer.cullMode);
+
+      builder.shaderStages = {
+        vkinit::shader_stage_create_info(VK_SHADER_STAGE_VERTEX_BIT, packedVertShader),
+        vkinit::shader_stage_create_info(VK_SHADER_STAGE_FRAGMENT_BIT, textureFragShader),
+      };
+      builder.pipelineLayout = texturedPipelineLayout;
+
+      texturedPackedPipeline = builder.build_pipeline(device, renderPass);
+
+      create_material(texturedPackedPipeline, texturedPipelineLayout, "texturedmesh_packed", builder.rasterizer.cullMode);
+
+      get_material("defaultmesh")->packed = get_material("defaultmesh_packed");
+      get_material("texturedmesh")->packed = get_material("texturedmesh_packed");
+
+      vkDestroyShaderModule(device, packedVertShader, nullptr);
+      vkDestroyShaderModule(device, meshFragShader, nullptr);
+      vkDestroyShaderModule(device, textureFragShader, nullptr);
+    }
   }
 
   // init meshes
@@ -558,50 +722,52 @@ void VulkanRenderer::init(const std::string& appName, const Window& window, bool
       Vertex{.position{-1.f, 1.f, 0.f }, .color{ 0.f, 1.f, 0.f }},
       Vertex{.position{ 0.f,-1.f, 0.f }, .color{ 0.f, 1.f, 0.f }}
     };
+    triangleMesh.indices = { 0, 1, 2 };
 
-    std::filesystem::path p = std::filesystem::current_path() / "assets";
-    monkeyMesh = load_from_obj(p.string() + "\\monkey_smooth.obj", p.string());
-    thingMesh = load_from_obj(p.string() + "\\thing.obj", p.string());
-    auto empire = load_from_obj(p.string() + "\\lost_empire.obj", p.string());
-
-    upload_mesh(triangleMesh);
-    upload_mesh(monkeyMesh);
-    upload_mesh(thingMesh);
-    upload_mesh(empire);
-
-    // Note that we are copying them. 
-    // Eventually we will delete the hardcoded monkey and triangle meshes, so it's no problem now.
-    meshes["monkey"] = monkeyMesh;
+    // Note that we are copying it. 
+    // Eventually we will delete the hardcoded triangle mesh, so it's no problem now.
     meshes["triangle"] = triangleMesh;
-    meshes["thing"] = thingMesh;
-    meshes["empire"] = empire;
+
+    // Uploaded like the streamed meshes, the map entry is what becomes resident
+    upload_meshes({ &meshes["triangle"] });
+
+    // The rest streams in, the first frames go out without them. One core is left to this thread.
+    assetWorkers.init(std::max(AssetWorkerThreads, std::max(std::thread::hardware_concurrency(), 1u) - 1));
+
+    // Also there with GPU culling, cpuCulling switches over at runtime
+    cullWorkers.init(CullWorkerThreads);
+
+    std::filesystem::path p = std::filesystem::current_path() / "assets";
+    request_mesh("monkey", p.string() + "\\monkey_smooth.obj", p.string(), VertexFormat::Packed);
+    request_mesh("thing", p.string() + "\\thing.obj", p.string(), VertexFormat::Packed);
+    request_mesh("empire", p.string() + "\\lost_empire.obj", p.string(), VertexFormat::Packed);
   }
 
   // init textures
   {
-    Texture tex;
-    
-    if(!vkutil::load_image(*this, "assets\\lost_empire-RGBA.png", tex.image))
-      std::cout << "bruh\n";
+    // Texels stay blocky up close, blending between mips keeps the distance from shimmering
+    VkSamplerCreateInfo samplerInfo = vkinit::sampler_create_info(VK_FILTER_NEAREST);
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    vkCreateSampler(device, &samplerInfo, nullptr, &blockySampler);
+
+    // Sampled by every material whose texture is still streaming in
+    const DecodedImage grey{ .format = VK_FORMAT_R8G8B8A8_SRGB, .width = 1, .height = 1, .mipLevels = 1, .levels = { { 128, 128, 128, 255 } } };
 
-    auto imageInfo = vkinit::image_view_create_info(VK_FORMAT_R8G8B8A8_SRGB, tex.image.image, VK_IMAGE_ASPECT_COLOR_BIT);
-    vkCreateImageView(device, &imageInfo, nullptr, &tex.view);
+    UploadBatch batch;
+    placeholderTexture.image = vkutil::upload_decoded(*this, { grey }, batch)[0];
+    submit_uploads(batch);
 
-    textures["empire_diffuse"] = tex;
+    auto imageInfo = vkinit::image_view_create_info(placeholderTexture.image.format, placeholderTexture.image.image, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+    VK_CHECK(vkCreateImageView(device, &imageInfo, nullptr, &placeholderTexture.view));
+    placeholderTexture.resident = true;
+
+    // The rest streams in like the meshes
+    request_texture("empire_diffuse", "assets\\lost_empire-RGBA.png", TextureCodec::BC7);
   }
 
   // init scene
   {
-    RenderObject monkey{
-      .mesh = get_mesh("monkey"),
-      .mat = get_material("defaultmesh"),
-      .transform = glm::mat4{ 1.f }
-    };
-
-    if(monkey.mesh && monkey.mat)
-      objects.push_back(monkey);
-    else
-      std::cout << "mesh or mat not good lol\n";
+    add_object(get_mesh("monkey"), get_material("defaultmesh"), glm::mat4{ 1.f });
 
     for (int x = -20; x <= 20; ++x)
     {
@@ -610,61 +776,62 @@ void VulkanRenderer::init(const std::string& appName, const Window& window, bool
         auto t = glm::translate(glm::mat4{ 1.f }, glm::vec3{ x, 0.f, y });
         auto s = glm::scale(glm::mat4{ 1.f }, glm::vec3{ .2f, .2f, .2f });
 
-        RenderObject tri{
-          .mesh = get_mesh("thing"),
-          .mat = get_material("defaultmesh"),
-          .transform = t * s
-        };
-
-        if (tri.mesh && tri.mat)
-          objects.push_back(tri);
-        else
-          std::cout << "mesh or mat not good lol\n";
+        add_object(get_mesh("thing"), get_material("defaultmesh"), t * s);
       }
     }
 
-    RenderObject map{
-      .mesh = get_mesh("empire"),
-      .mat = get_material("texturedmesh"),
-      .transform = glm::translate(glm::vec3{ 5, -10, 0 })
-    };
+    Material* mat = get_material("texturedmesh");
+    add_object(get_mesh("empire"), mat, glm::translate(glm::vec3{ 5, -10, 0 }));
 
-    objects.push_back(map);
+    bind_texture(mat, &textures["empire_diffuse"]);
+  }
 
-    VkSamplerCreateInfo samplerInfo = vkinit::sampler_create_info(VK_FILTER_NEAREST);
-	  vkCreateSampler(device, &samplerInfo, nullptr, &blockySampler);
+  const UploadStats uploadStats = get_upload_stats();
+  std::cout << fmt::format("Startup uploads went out in {} submissions, {:.1f} MB written directly, {:.1f} MB staged\n", uploadSubmissions,
+    uploadStats.directBytes / (1024.0 * 1024.0), uploadStats.stagedBytes / (1024.0 * 1024.0));
+}
 
-    Material* mat = get_material("texturedmesh");
+void VulkanRenderer::draw(double dt)
+{
+  FrameData& frame = get_current_frame();
 
-    VkDescriptorSetAllocateInfo allocInfo{
-      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-      .pNext = nullptr,
+  VK_CHECK(vkWaitForFences(device, 1, &frame.fence, VK_TRUE, timeout));
+	VK_CHECK(vkResetFences(device, 1, &frame.fence));
 
-      .descriptorPool = descriptorPool,
-      .descriptorSetCount = 1,
-      .pSetLayouts = &singleTextureSetLayout
-    };
-    
-	  vkAllocateDescriptorSets(device, &allocInfo, &mat->texture);
+  update_streaming();
 
-    VkDescriptorImageInfo imageBufferInfo{
-      .sampler = blockySampler,
-      .imageView = textures["empire_diffuse"].view,
-      .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-    };
+  // Meshes that became resident give their objects bounds, moved objects updated theirs already
+  if (boundsLayoutVersion != sceneLayoutVersion)
+  {
+    sceneStore.refresh_bounds();
+    boundsLayoutVersion = sceneLayoutVersion;
+  }
+
+  const bool culledOnGpu = gpuCulling && !cpuCulling;
+
+  if (culledOnGpu)
+  {
+    if (builtSceneVersion != sceneVersion)
+      build_gpu_scene();
 
-    auto tex = vkinit::write_descriptor_image(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, mat->texture, &imageBufferInfo, 0);
+    // The frame's previous submission is done with its buffers, they only change along with the scene
+    if (frame.sceneVersion != builtSceneVersion)
+    {
+      memcpy(frame.objectData, gpuObjects.data(), gpuObjects.size() * sizeof GPUObjectData);
+      vmaFlushAllocation(allocator, frame.objectBuffer.alloc, 0, gpuObjects.size() * sizeof GPUObjectData);
 
-    vkUpdateDescriptorSets(device, 1, &tex, 0, nullptr);
+      culler.write_draws(frameNumber % MaxFramesInFlight, gpuDraws);
+      frame.sceneVersion = builtSceneVersion;
+    }
   }
-}
 
-void VulkanRenderer::draw(double dt)
-{
-  const FrameData& frame = get_current_frame();
+  const GPUCameraData cam = update_scene_buffer();
 
-  VK_CHECK(vkWaitForFences(device, 1, &frame.fence, VK_TRUE, timeout));
-	VK_CHECK(vkResetFences(device, 1, &frame.fence));
+  if (cullComparisonPending)
+  {
+    run_culling_comparison(extract_frustum(cam.viewproj));
+    cullComparisonPending = false;
+  }
 
   uint32_t swapchainImageIndex;
   VK_CHECK(vkAcquireNextImageKHR(device, swapchain.get_swap_chain(), timeout, frame.present, nullptr, &swapchainImageIndex));
@@ -672,6 +839,8 @@ void VulkanRenderer::draw(double dt)
   // Now that rendering is finished for last frame, we can begin our rendering commands
   VK_CHECK(vkResetCommandBuffer(frame.cmdBuffer, 0));
 
+  bool uploadedTextures = false;
+
   // Record our draw commands
   {
     VkCommandBufferBeginInfo cmdBegin{
@@ -684,6 +853,22 @@ void VulkanRenderer::draw(double dt)
 
     VK_CHECK(vkBeginCommandBuffer(frame.cmdBuffer, &cmdBegin));
     {
+      // Copies and mip blits of textures that finished decoding, ahead of every pass sampling them
+      if (!textureUploads.empty())
+      {
+        textureUploads.record(frame.cmdBuffer);
+        textureUploads = UploadBatch{};
+        uploadedTextures = true;
+      }
+
+      // Take the buffers of meshes that just became resident over from the transfer queue
+      if (!acquireBarriers.empty())
+      {
+        vkCmdPipelineBarrier(frame.cmdBuffer, GeometryReadStages, GeometryReadStages, 0, 0, nullptr,
+          (uint32_t)acquireBarriers.size(), acquireBarriers.data(), 0, nullptr);
+        acquireBarriers.clear();
+      }
+
       VkClearValue clearColor{
         .color = {{ 0.f, 0.f, std::abs(std::sin((float)t / 120.f)), 1.f }}
       };
@@ -709,24 +894,75 @@ void VulkanRenderer::draw(double dt)
         .pClearValues = clearValues,
       };
 
-      vkCmdBeginRenderPass(frame.cmdBuffer, &renderpassBegin, VK_SUBPASS_CONTENTS_INLINE);
+      const auto recordStart = std::chrono::high_resolution_clock::now();
+
+      if (!culledOnGpu)
+      {
+        vkCmdBeginRenderPass(frame.cmdBuffer, &renderpassBegin, VK_SUBPASS_CONTENTS_INLINE);
+        draw_objects(frame.cmdBuffer, cam);
+        vkCmdEndRenderPass(frame.cmdBuffer);
+
+        // draw_objects wrote over the GPU scene's object data, it is copied again once GPU culling is back
+        frame.sceneVersion = 0;
+      }
+      else
+      {
+        read_cull_stats();
+
+        // Culling is a compute pass, it has to be recorded outside of the render passes
+        write_cull_params(cam);
+        culler.record(frame.cmdBuffer, frameNumber % MaxFramesInFlight, CullPhase::Early);
+
+        BindTracker binds;
 
-      draw_objects(frame.cmdBuffer, objects.data(), objects.size());
+        vkCmdBeginRenderPass(frame.cmdBuffer, &renderpassBegin, VK_SUBPASS_CONTENTS_INLINE);
+        draw_objects_indirect(frame.cmdBuffer, CullPhase::Early, binds);
+        vkCmdEndRenderPass(frame.cmdBuffer);
 
-      vkCmdEndRenderPass(frame.cmdBuffer);
+        // What the previous frame's depth hid is tested again against the depth drawn so far, so objects coming
+        // into view show up this frame. The pyramid is what the next frame's early phase tests against.
+        if (occlusionCulling)
+        {
+          depthPyramid.build(frame.cmdBuffer);
+          culler.record(frame.cmdBuffer, frameNumber % MaxFramesInFlight, CullPhase::Late);
+
+          renderpassBegin.renderPass = lateRenderPass;
+          vkCmdBeginRenderPass(frame.cmdBuffer, &renderpassBegin, VK_SUBPASS_CONTENTS_INLINE);
+          draw_objects_indirect(frame.cmdBuffer, CullPhase::Late, binds);
+          vkCmdEndRenderPass(frame.cmdBuffer);
+        }
+
+        stats.binds = binds.get_counts();
+      }
+
+      stats.recordMs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - recordStart).count() / 1000000.0;
     }
     VK_CHECK(vkEndCommandBuffer(frame.cmdBuffer));
   }
 
-  VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  // Uploads made resident have already finished, waiting on their timeline value is what orders the copies
+  // before this frame's geometry reads. The value is ignored for the binary present semaphore.
+  VkSemaphore waitSemaphores[2] = { frame.present, transfer.get_semaphore() };
+  VkPipelineStageFlags waitStages[2] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, GeometryReadStages };
+  uint64_t waitValues[2] = { 0, transferWaitValue };
+
+  VkTimelineSemaphoreSubmitInfo timelineInfo{
+    .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+    .pNext = nullptr,
+
+    .waitSemaphoreValueCount = 2,
+    .pWaitSemaphoreValues = waitValues,
+    .signalSemaphoreValueCount = 0,
+    .pSignalSemaphoreValues = nullptr
+  };
 
   VkSubmitInfo submit{
     .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-    .pNext = nullptr,
+    .pNext = &timelineInfo,
 
-    .waitSemaphoreCount = 1,
-    .pWaitSemaphores = &frame.present,
-    .pWaitDstStageMask = &waitStage,
+    .waitSemaphoreCount = 2,
+    .pWaitSemaphores = waitSemaphores,
+    .pWaitDstStageMask = waitStages,
 
     .commandBufferCount = 1,
     .pCommandBuffers = &frame.cmdBuffer,
@@ -737,6 +973,10 @@ void VulkanRenderer::draw(double dt)
 
   VK_CHECK(vkQueueSubmit(graphicsQueue, 1, &submit, frame.fence));
 
+  // The staging of the texture uploads is reclaimed once the frame that copied it is done
+  if (uploadedTextures)
+    VK_CHECK(vkQueueSubmit(graphicsQueue, 0, nullptr, staging.submit()));
+
   VkPresentInfoKHR presentInfo{
     .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
     .pNext = nullptr,
@@ -763,6 +1003,15 @@ void VulkanRenderer::swap_pipeline()
 
 void VulkanRenderer::cleanup()
 {
+  // Lets loads that are already running finish, their results are dropped with loadedMeshes and loadedTextures
+  assetWorkers.cleanup();
+  cullWorkers.cleanup();
+
+  // Both wait for every upload still in flight
+  staging.cleanup();
+  transfer.cleanup();
+  pendingUploads.clear();
+
   for (int i = 0; i < MaxFramesInFlight; ++i)
   {
     vkWaitForFences(device, 1, &frames[i].fence, VK_TRUE, timeout);
@@ -774,19 +1023,25 @@ void VulkanRenderer::cleanup()
     vkDestroyCommandPool(device, frames[i].cmdPool, nullptr);
   }
 
-  // No need to wait since this is used for immediate pushes and is waited on immediately anyways
-  vkDestroyFence(device, upload.upload, nullptr);
-
   vkDestroyCommandPool(device, upload.pool, nullptr);
 
+  // Textures still streaming have null handles, destroying those does nothing
   for (const auto& [str, t] : textures)
   {
     vkDestroyImageView(device, t.view, nullptr);
     vmaDestroyImage(allocator, t.image.image, t.image.alloc);
   }
 
+  vkDestroyImageView(device, placeholderTexture.view, nullptr);
+  vmaDestroyImage(allocator, placeholderTexture.image.image, placeholderTexture.image.alloc);
+
   for (const auto& [str, m] : meshes)
-    vmaDestroyBuffer(allocator, m.vertexBuffer.buffer, m.vertexBuffer.alloc);
+  {
+    if (m.meshletBuffer.buffer != VK_NULL_HANDLE)
+      vmaDestroyBuffer(allocator, m.meshletBuffer.buffer, m.meshletBuffer.alloc);
+  }
+
+  geometry.cleanup(allocator);
 
   vkDestroyImageView(device, depthImageView, nullptr);
   vmaDestroyImage(allocator, depthImage.image, depthImage.alloc);
@@ -799,9 +1054,22 @@ void VulkanRenderer::cleanup()
   vkDestroyPipeline(device, redTrianglePipeline, nullptr);
   vkDestroyPipeline(device, meshPipeline, nullptr);
   vkDestroyPipeline(device, texturedPipeline, nullptr);
+  vkDestroyPipeline(device, meshPackedPipeline, nullptr);
+  vkDestroyPipeline(device, texturedPackedPipeline, nullptr);
+
+  if (gpuCulling)
+  {
+    culler.cleanup();
+    depthPyramid.cleanup();
+    vkDestroyRenderPass(device, lateRenderPass, nullptr);
+  }
 
   for (int i = 0; i < MaxFramesInFlight; ++i)
+  {
     vmaDestroyBuffer(allocator, frames[i].objectBuffer.buffer, frames[i].objectBuffer.alloc);
+    if (frames[i].indirectBuffer.buffer != VK_NULL_HANDLE)
+      vmaDestroyBuffer(allocator, frames[i].indirectBuffer.buffer, frames[i].indirectBuffer.alloc);
+  }
   vmaDestroyBuffer(allocator, sceneBuffer.buffer, sceneBuffer.alloc);
 
   vkDestroySampler(device, blockySampler, nullptr);
@@ -825,9 +1093,9 @@ void VulkanRenderer::cleanup()
   vkDestroyInstance(instance, nullptr);
 }
 
-Material* VulkanRenderer::create_material(VkPipeline pipeline, VkPipelineLayout layout, const std::string& name)
+Material* VulkanRenderer::create_material(VkPipeline pipeline, VkPipelineLayout layout, const std::string& name, VkCullModeFlags cullMode)
 {
-  auto [iter, success] = materials.insert({ name, { pipeline, layout } });
+  auto [iter, success] = materials.insert({ name, { .pipeline = pipeline, .layout = layout, .backfaceCulled = (cullMode & VK_CULL_MODE_BACK_BIT) != 0 } });
   if(success)
     return &iter->second;
   return nullptr;
@@ -847,197 +1115,1221 @@ Mesh* VulkanRenderer::get_mesh(const std::string& name)
   return nullptr;
 }
 
-void VulkanRenderer::upload_mesh(Mesh& mesh)
+Mesh* VulkanRenderer::request_mesh(const std::string& name, const std::string& path, const std::string& mtlDir, VertexFormat format)
 {
-  const uint32_t bufferSize = mesh.vertices.size() * sizeof Vertex;
+  auto [iter, inserted] = meshes.try_emplace(name);
+  if (!inserted)
+    return &iter->second;
 
-  VkBufferCreateInfo stagingBufferInfo{
-    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-    .pNext = nullptr,
+  // Map entries keep their address, so the entry doubles as the handle the loaded mesh is moved into
+  Mesh* handle = &iter->second;
 
-    .size = bufferSize,
-    .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT
-  };
+  assetWorkers.submit([this, handle, path, mtlDir, format] {
+    // Uncooked meshes are parsed in chunks over the other asset workers too
+    Mesh loaded = load_from_obj(path, mtlDir, format, &assetWorkers);
 
-  VmaAllocationCreateInfo stagingAllocInfo{
-    .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
-    .usage = VMA_MEMORY_USAGE_AUTO,
-  };
+    std::lock_guard lock{ loadedMeshesMutex };
+    loadedMeshes.emplace_back(handle, std::move(loaded));
+  });
 
-  AllocatedBuffer tempStagingBuffer;
-
-  // Create staging buffer
-  VK_CHECK(vmaCreateBuffer(
-    allocator,
-    &stagingBufferInfo,
-    &stagingAllocInfo,
-    &tempStagingBuffer.buffer,
-    &tempStagingBuffer.alloc,
-    nullptr
-  ));
-
-  // Now that we have a buffer, copy data over into that buffer
-  void* data;
-  vmaMapMemory(allocator, tempStagingBuffer.alloc, &data);
-  memcpy(data, mesh.vertices.data(), bufferSize);
-  vmaUnmapMemory(allocator, tempStagingBuffer.alloc);
-
-  // Now transfer data over to GPU buffer
-  VkBufferCreateInfo gpuBufferInfo{
-    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-    .pNext = nullptr,
+  return handle;
+}
 
-    .size = bufferSize,
-    .usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
-  };
+Texture* VulkanRenderer::request_texture(const std::string& name, const std::string& filePath, std::optional<TextureCodec> codec)
+{
+  auto [iter, inserted] = textures.try_emplace(name);
+  if (!inserted)
+    return &iter->second;
 
-  VmaAllocationCreateInfo gpuAllocInfo{
-    .flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT,
-    .usage = VMA_MEMORY_USAGE_AUTO
-  };
+  Texture* handle = &iter->second;
 
-  // Create staging buffer
-  VK_CHECK(vmaCreateBuffer(
-    allocator,
-    &gpuBufferInfo,
-    &gpuAllocInfo,
-    &mesh.vertexBuffer.buffer,
-    &mesh.vertexBuffer.alloc,
-    nullptr
-  ));
-
-  immediate_submit([=](VkCommandBuffer cmd){
-    VkBufferCopy copy{
-      .srcOffset = 0,
-      .dstOffset = 0,
-      .size = bufferSize,
-    };
+  assetWorkers.submit([this, handle, filePath, codec] {
+    // Cooking splits its blocks over the other asset workers too. A failed decode comes back empty.
+    DecodedImage decoded;
+    (void)vkutil::decode_image(*this, vkutil::TextureRequest{ .filePath = filePath, .codec = codec }, decoded, &assetWorkers);
 
-    vkCmdCopyBuffer(cmd, tempStagingBuffer.buffer, mesh.vertexBuffer.buffer, 1, &copy);
+    std::lock_guard lock{ loadedTexturesMutex };
+    loadedTextures.emplace_back(handle, std::move(decoded));
   });
 
-  vmaDestroyBuffer(allocator, tempStagingBuffer.buffer, tempStagingBuffer.alloc);
+  return handle;
 }
 
-void VulkanRenderer::draw_objects(VkCommandBuffer cmd, RenderObject* first, int count)
+void VulkanRenderer::bind_texture(Material* mat, Texture* texture)
 {
-  glm::mat4 view = glm::lookAt(camPos, camPos + camFwd, glm::vec3{ 0.f, 1.f, 0.f });
+  textureUsers.emplace_back(texture, mat);
+  write_texture_set(mat, texture->resident ? texture->view : placeholderTexture.view);
+}
 
-  glm::mat4 projection = glm::perspective(glm::radians(70.f), 1700.f / 900.f, 0.1f, 200.0f);
-  projection[1][1] *= -1; // flip y axis for vulkan
+void VulkanRenderer::write_texture_set(Material* mat, VkImageView view)
+{
+  // The replaced set is only given back along with the pool, a material is rebound once per texture
+  VkDescriptorSetAllocateInfo allocInfo{
+    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+    .pNext = nullptr,
 
-  GPUCameraData cam{
-    .view = view,
-    .proj = projection,
-    .viewproj = projection * view,
+    .descriptorPool = descriptorPool,
+    .descriptorSetCount = 1,
+    .pSetLayouts = &singleTextureSetLayout
   };
 
-	scene.ambientColor = { sin(t), 0.f, cos(t), 1.f };
-
-	int frameIndex = frameNumber % MaxFramesInFlight;
-
-  uint8_t* data;
-  vmaMapMemory(allocator, sceneBuffer.alloc, (void**)&data);
-
-  // Not sure at all how this needs to be offset but this works now
-  // (but so does using pad uniform buffer size...)
-
-  // cam + scene data = 272 bytes
-  // Cam Pad = 256
-  const int camData = pad_uniform_buffer_size(sizeof GPUCameraData);
-  // Scene Pad = 256
-  const int sceneData = pad_uniform_buffer_size(sizeof GPUSceneData);
-  // Cam + Scene Pad = 512
-  const int camAndSceneData = pad_uniform_buffer_size(sizeof GPUCameraData + sizeof GPUSceneData);
-  data += (sizeof GPUCameraData + sizeof GPUSceneData) * frameIndex;
-  memcpy(data, &cam, sizeof GPUCameraData);
-  
-  // Move ptr to Scene Data beginning
-	data += sizeof GPUCameraData;
-  memcpy(data, &scene, sizeof GPUSceneData);
+  VkDescriptorSet set;
+  VK_CHECK(vkAllocateDescriptorSets(device, &allocInfo, &set));
 
-	vmaUnmapMemory(allocator, sceneBuffer.alloc);
+  VkDescriptorImageInfo imageBufferInfo{
+    .sampler = blockySampler,
+    .imageView = view,
+    .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+  };
 
-  void* objectData;
-  vmaMapMemory(allocator, get_current_frame().objectBuffer.alloc, &objectData);
+  auto tex = vkinit::write_descriptor_image(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, set, &imageBufferInfo, 0);
+  vkUpdateDescriptorSets(device, 1, &tex, 0, nullptr);
 
-  GPUObjectData* objectSSBO = reinterpret_cast<GPUObjectData*>(objectData);
+  mat->texture = set;
+  if (mat->packed)
+    mat->packed->texture = set;
+}
 
-  for (int i = 0; i < count; ++i)
+std::optional<ObjectHandle> VulkanRenderer::add_object(Mesh* mesh, Material* mat, const glm::mat4& transform)
+{
+  if (!mesh || !mat)
   {
-    RenderObject& obj = first[i];
-    objectSSBO[i].model = obj.transform;
+    std::cout << "mesh or mat not good lol\n";
+    return std::nullopt;
   }
-  
-  Mesh* lastMesh = nullptr;
-  Material* lastMat = nullptr;
 
-  for (int i = 0; i < count; ++i)
-  {
-    RenderObject& obj = first[i];
+  // The GPU scene and the BVH are built again with it
+  ++sceneVersion;
+  ++sceneLayoutVersion;
 
-    if (!obj.mat && !obj.mesh)
-      continue;
+  const MaterialId matId = sceneStore.register_material(mat);
+  const ObjectHandle handle = sceneStore.add(sceneStore.register_mesh(mesh), matId, transform);
 
-    // Only bind pipeline if pipeline is not currently bound
-    if (obj.mat != lastMat)
-    {
-      vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, obj.mat->pipeline);
-      lastMat = obj.mat;
+  // Streaming meshes get theirs once they are resident
+  if (mesh->resident)
+    sceneStore.set_submesh_materials(handle, resolve_submesh_materials(*mesh));
 
-      // Bind descriptor set when changing pipelines
-      // Get uniform offset due to 1 dynamic descriptor set
-      uint32_t dynamicOffset = 0;
-      // Need to send 1 offset uint32_t for each dynamic descriptor we have
-      vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, obj.mat->layout, 0, 1, &sceneDescriptor, 1, &dynamicOffset);
+  return handle;
+}
 
-      vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, obj.mat->layout, 1, 1, &get_current_frame().objectDescriptor, 0, nullptr);
+bool VulkanRenderer::remove_object(ObjectHandle handle)
+{
+  if (!sceneStore.remove(handle))
+    return false;
 
-      if(obj.mat->texture != VK_NULL_HANDLE)
-        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, obj.mat->layout, 2, 1, &obj.mat->texture, 0, nullptr);
-    }
+  ++sceneVersion;
+  ++sceneLayoutVersion;
+  return true;
+}
 
-    MeshPushConstants constants{
-      .render_matrix = obj.transform
-    };
+void VulkanRenderer::set_object_transform(ObjectHandle handle, const glm::mat4& transform)
+{
+  if (sceneStore.index_of(handle) == UINT32_MAX)
+    return;
 
-    vkCmdPushConstants(cmd, obj.mat->layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof MeshPushConstants, &constants);
-    
-    if (obj.mesh != lastMesh)
+  // Only the GPU scene is built again, the BVH refits the moved objects and keeps its layout
+  sceneStore.set_transform(handle, transform);
+  ++sceneVersion;
+}
+
+std::vector<MaterialId> VulkanRenderer::resolve_submesh_materials(const Mesh& mesh)
+{
+  std::vector<MaterialId> mats(mesh.materialNames.size(), InvalidMaterialId);
+  bool named = false;
+  for (size_t slot = 0; slot < mats.size(); ++slot)
+  {
+    if (Material* mat = get_material(mesh.materialNames[slot]))
     {
-      VkDeviceSize offset = 0;
-      vkCmdBindVertexBuffers(cmd, 0, 1, &obj.mesh->vertexBuffer.buffer, &offset);
-      lastMesh = obj.mesh;
+      mats[slot] = sceneStore.register_material(mat);
+      named = true;
     }
-
-    // first instance is 'i' so that we get our gl_BaseInstance set in vertex shader
-    vkCmdDraw(cmd, obj.mesh->vertices.size(), 1, 0, i);
   }
 
-  vmaUnmapMemory(allocator, get_current_frame().objectBuffer.alloc);
+  if (!named)
+    mats.clear();
+  return mats;
 }
 
-FrameData& VulkanRenderer::get_current_frame()
+void VulkanRenderer::assign_submesh_materials(const Mesh* mesh)
 {
-  return frames[frameNumber % MaxFramesInFlight];
+  const std::vector<MaterialId> mats = resolve_submesh_materials(*mesh);
+  const std::vector<MeshId>& meshIds = sceneStore.get_mesh_ids();
+  for (uint32_t i = 0; i < sceneStore.size(); ++i)
+  {
+    if (sceneStore.get_mesh(meshIds[i]) == mesh)
+      sceneStore.set_submesh_materials(sceneStore.handle_at(i), mats);
+  }
 }
 
-AllocatedBuffer VulkanRenderer::create_buffer(size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage)
+void VulkanRenderer::set_benchmark_objects(uint32_t count)
 {
-  VkBufferCreateInfo bufInfo{
-    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-    .pNext = nullptr,
+  for (const ObjectHandle handle : benchmarkHandles)
+    remove_object(handle);
+  benchmarkHandles.clear();
 
-    .size = allocSize,
-    .usage = usage
-  };
+  // Every object needs a slot in the object buffers, submeshes past them are dropped from GPU culled frames
+  const uint32_t room = MaxObjects - std::min(MaxObjects, (uint32_t)sceneStore.size());
+  if (count > room)
+  {
+    std::cout << fmt::format("Only {} of {} benchmark objects fit within MaxObjects ({})\n", room, count, MaxObjects);
+    count = room;
+  }
 
-  VmaAllocationCreateInfo allocInfo{
-    .usage = memoryUsage
-  };
+  Mesh* mesh = get_mesh("thing");
+  Material* mat = get_material("defaultmesh");
+  if (!mesh || !mat)
+    return;
 
-  AllocatedBuffer buf;
-  VK_CHECK(vmaCreateBuffer(allocator, &bufInfo, &allocInfo, &buf.buffer, &buf.alloc, nullptr));
+  benchmarkHandles.reserve(count);
+
+  // A square grid above the scene, large enough that culling keeps part of it in every direction
+  const int side = (int)std::ceil(std::sqrt((double)count));
+  for (uint32_t i = 0; i < count; ++i)
+  {
+    auto t = glm::translate(glm::mat4{ 1.f }, glm::vec3{ (float)((int)i % side - side / 2), 4.f, (float)((int)i / side - side / 2) });
+    auto s = glm::scale(glm::mat4{ 1.f }, glm::vec3{ .2f, .2f, .2f });
+
+    if (std::optional<ObjectHandle> handle = add_object(mesh, mat, t * s))
+      benchmarkHandles.push_back(*handle);
+  }
+
+  std::cout << fmt::format("Scene holds {} objects, {} of them for benchmarking\n", sceneStore.size(), count);
+}
+
+void VulkanRenderer::update_streaming()
+{
+  std::vector<std::pair<Mesh*, Mesh>> loaded;
+  {
+    std::lock_guard lock{ loadedMeshesMutex };
+    loaded.swap(loadedMeshes);
+  }
+
+  std::vector<Mesh*> uploads;
+  for (auto& [handle, mesh] : loaded)
+  {
+    // load_from_obj already reported why, its objects stop counting as streaming
+    if (index_count(mesh) == 0)
+    {
+      handle->failed = true;
+      ++sceneVersion;
+      ++sceneLayoutVersion;
+      continue;
+    }
+
+    *handle = std::move(mesh);
+    uploads.push_back(handle);
+  }
+
+  // Everything the workers finished since the last frame shares one submission
+  if (!uploads.empty())
+    upload_meshes(uploads);
+
+  // Staged after the meshes were submitted, so the regions stay in the batch the frame recording the copies closes
+  std::vector<std::pair<Texture*, DecodedImage>> decodedTextures;
+  {
+    std::lock_guard lock{ loadedTexturesMutex };
+    decodedTextures.swap(loadedTextures);
+  }
+
+  if (!decodedTextures.empty())
+    upload_textures(decodedTextures);
+
+  staging.retire();
+  transfer.retire();
+
+  const uint64_t completed = transfer.get_completed_value();
+
+  std::erase_if(pendingUploads, [&](const PendingUpload& pending) {
+    if (pending.transferValue > completed)
+      return false;
+
+    if (transfer.needs_ownership_transfer())
+      append_mesh_barriers(acquireBarriers, *pending.mesh, 0, GeometryReadAccess);
+
+    transferWaitValue = std::max(transferWaitValue, pending.transferValue);
+
+    pending.mesh->resident = true;
+    assign_submesh_materials(pending.mesh);
+    ++sceneVersion;
+    ++sceneLayoutVersion;
+    return true;
+  });
+}
+
+void VulkanRenderer::upload_textures(std::vector<std::pair<Texture*, DecodedImage>>& decoded)
+{
+  std::vector<DecodedImage> images;
+  for (auto& [texture, image] : decoded)
+    images.push_back(std::move(image));
+
+  std::vector<AllocatedImage> uploaded = vkutil::upload_decoded(*this, images, textureUploads);
+
+  for (size_t i = 0; i < decoded.size(); ++i)
+  {
+    // decode_image already reported why, its materials keep the placeholder
+    if (uploaded[i].image == VK_NULL_HANDLE)
+      continue;
+
+    Texture* texture = decoded[i].first;
+    texture->image = uploaded[i];
+
+    auto imageInfo = vkinit::image_view_create_info(texture->image.format, texture->image.image, VK_IMAGE_ASPECT_COLOR_BIT, texture->image.mipLevels);
+    VK_CHECK(vkCreateImageView(device, &imageInfo, nullptr, &texture->view));
+
+    // The copies are recorded ahead of this frame's passes, so it can sample the texture already
+    texture->resident = true;
+    for (const auto& [user, mat] : textureUsers)
+    {
+      if (user == texture)
+        write_texture_set(mat, texture->view);
+    }
+  }
+
+  // Draw batches are split by texture set
+  ++sceneVersion;
+  std::cout << fmt::format("Uploading {} streamed textures\n", decoded.size());
+}
+
+void VulkanRenderer::upload_meshes(const std::vector<Mesh*>& uploads)
+{
+  UploadBatch batch;
+  std::vector<Mesh*> staged;
+  uint32_t written = 0;
+  for (Mesh* mesh : uploads)
+  {
+    const MeshUpload result = upload_mesh(*mesh, batch);
+    if (result == MeshUpload::Staged)
+      staged.push_back(mesh);
+    // Host writes are visible to every submission made after them, no need to wait for anything
+    else if (result == MeshUpload::Written)
+    {
+      mesh->resident = true;
+      assign_submesh_materials(mesh);
+      ++sceneVersion;
+      ++sceneLayoutVersion;
+      ++written;
+    }
+    // stage_mesh already reported why
+    else
+    {
+      mesh->failed = true;
+      ++sceneVersion;
+      ++sceneLayoutVersion;
+    }
+  }
+
+  if (staged.empty())
+  {
+    if (written > 0)
+      std::cout << fmt::format("Wrote {} meshes straight into device memory\n", written);
+    return;
+  }
+
+  const uint64_t transferValue = submit_uploads(batch);
+
+  for (Mesh* mesh : staged)
+    pendingUploads.push_back(PendingUpload{ .mesh = mesh, .transferValue = transferValue });
+
+  std::cout << fmt::format("Uploading {} meshes with {} copies in one submission\n", staged.size(), batch.get_copy_count());
+}
+
+MeshUpload VulkanRenderer::upload_mesh(Mesh& mesh, UploadBatch& batch)
+{
+  std::optional<StagingRegion> region;
+  if (!stage_mesh(mesh, region))
+    return MeshUpload::Failed;
+
+  if (!region)
+    return MeshUpload::Written;
+
+  record_mesh_upload(batch, mesh, *region);
+  return MeshUpload::Staged;
+}
+
+uint64_t VulkanRenderer::submit_uploads(const UploadBatch& batch)
+{
+  if (batch.empty())
+    return 0;
+
+  // Mesh buffers are released to the graphics family from the transfer queue, recorded on the graphics queue
+  // those releases would never match their acquires. Mixed batches send each part to its own queue.
+  if (batch.needs_graphics_queue() && batch.has_buffer_copies())
+  {
+    UploadBatch buffers = batch;
+    const UploadBatch images = buffers.split_graphics();
+
+    // The transfer submission takes every open staging region, immediate_submit waits for the images before
+    // anything could reclaim theirs
+    const uint64_t transferValue = submit_uploads(buffers);
+    submit_uploads(images);
+    return transferValue;
+  }
+
+  ++uploadSubmissions;
+
+  if (batch.needs_graphics_queue())
+  {
+    immediate_submit([&](VkCommandBuffer cmd) { batch.record(cmd); });
+    return 0;
+  }
+
+  VkCommandBuffer cmd = transfer.begin();
+  batch.record(cmd);
+
+  // The staging batch is retired by the same submission's fence
+  return transfer.submit(cmd, staging.submit());
+}
+
+bool VulkanRenderer::stage_mesh(Mesh& mesh, std::optional<StagingRegion>& outRegion)
+{
+  // Meshes built by hand come without submeshes, they are drawn whole with the object's material
+  if (mesh.submeshes.empty())
+  {
+    Submesh submesh{ .materialSlot = 0, .lodCount = 1 };
+    submesh.lods[0] = MeshLod{ .firstIndex = 0, .indexCount = (uint32_t)mesh.indices.size(), .error = 0.f };
+
+    mesh.submeshes.push_back(submesh);
+    mesh.materialNames = { "" };
+  }
+
+  // Loaded meshes come narrowed already, only the ones built by hand still have work to do
+  narrow_indices(mesh);
+
+  const size_t vertexCount = vertex_count(mesh);
+  const size_t indexCount = index_count(mesh);
+
+  const void* vertexData = mesh.format == VertexFormat::Packed ? (const void*)mesh.packedVertices.data() : (const void*)mesh.vertices.data();
+  const uint32_t vertexBufferSize = vertexCount * vertex_stride(mesh.format);
+  const uint32_t indexSize = mesh.indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+  const uint32_t indexBufferSize = indexCount * indexSize;
+
+  const uint32_t meshletBufferSize = mesh.meshlets.size() * sizeof(Meshlet);
+
+  // Vertices, indices and meshlets share one staging region, each section starts right after the previous one
+  const uint32_t meshletOffset = vertexBufferSize + indexBufferSize;
+  const uint32_t bufferSize = meshletOffset + meshletBufferSize;
+
+  // Vertices and indices go into the shared geometry pool
+  std::optional<GeometryRange> vertexRange = geometry.allocate_vertices(vertexBufferSize, vertex_stride(mesh.format));
+  std::optional<GeometryRange> indexRange = geometry.allocate_indices(indexBufferSize, indexSize);
+  if (!vertexRange || !indexRange)
+  {
+    if (vertexRange)
+      geometry.free_vertices(*vertexRange);
+    if (indexRange)
+      geometry.free_indices(*indexRange);
+
+    std::cout << fmt::format("Geometry pool is out of space for a mesh with {} vertices and {} indices, it will not be drawn\n", vertexCount, indexCount);
+    return false;
+  }
+
+  mesh.vertexRange = *vertexRange;
+  mesh.indexRange = *indexRange;
+  mesh.baseVertex = (int32_t)(vertexRange->offset / vertex_stride(mesh.format));
+  mesh.baseIndex = (uint32_t)(indexRange->offset / indexSize);
+
+  VmaAllocationCreateInfo gpuAllocInfo{
+    .usage = VMA_MEMORY_USAGE_AUTO
+  };
+
+  if (directUploads)
+  {
+    gpuAllocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+    gpuAllocInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+  }
+
+  VmaAllocationInfo meshletAllocation{};
+
+  // Meshlet bounds and cones, laid out for a culling shader to read straight from a storage buffer
+  if (meshletBufferSize > 0)
+  {
+    VkBufferCreateInfo gpuMeshletBufferInfo{
+      .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+      .pNext = nullptr,
+
+      .size = meshletBufferSize,
+      .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
+    };
+
+    VK_CHECK(vmaCreateBuffer(
+      allocator,
+      &gpuMeshletBufferInfo,
+      &gpuAllocInfo,
+      &mesh.meshletBuffer.buffer,
+      &mesh.meshletBuffer.alloc,
+      &meshletAllocation
+    ));
+  }
+
+  // Written where the device reads them when its memory is mapped, into staging otherwise
+  outRegion.reset();
+  uint8_t* vertexDst;
+  uint8_t* indexDst;
+  uint8_t* meshletDst;
+  if (directUploads)
+  {
+    vertexDst = geometry.get_vertex_data() + mesh.vertexRange.offset;
+    indexDst = geometry.get_index_data() + mesh.indexRange.offset;
+    meshletDst = (uint8_t*)meshletAllocation.pMappedData;
+  }
+  else
+  {
+    // Aligned for the 16 and 32 bit writes below
+    outRegion = staging.allocate(bufferSize, 16);
+
+    vertexDst = outRegion->data;
+    indexDst = outRegion->data + vertexBufferSize;
+    meshletDst = outRegion->data + meshletOffset;
+  }
+
+  memcpy(vertexDst, vertexData, vertexBufferSize);
+
+  const void* indexData = mesh.indexType == VK_INDEX_TYPE_UINT16 ? (const void*)mesh.shortIndices.data() : (const void*)mesh.indices.data();
+  memcpy(indexDst, indexData, indexBufferSize);
+
+  if (meshletBufferSize > 0)
+    memcpy(meshletDst, mesh.meshlets.data(), meshletBufferSize);
+
+  if (directUploads)
+  {
+    geometry.flush(allocator, mesh.vertexRange, mesh.indexRange);
+    if (meshletBufferSize > 0)
+      vmaFlushAllocation(allocator, mesh.meshletBuffer.alloc, 0, VK_WHOLE_SIZE);
+
+    directUploadBytes += bufferSize;
+  }
+
+  return true;
+}
+
+void VulkanRenderer::record_mesh_upload(UploadBatch& batch, const Mesh& mesh, const StagingRegion& region)
+{
+  // The region holds vertices | indices | meshlets, laid out by stage_mesh
+  VkBufferCopy vertexCopy{
+    .srcOffset = region.offset,
+    .dstOffset = mesh.vertexRange.offset,
+    .size = mesh.vertexRange.size,
+  };
+
+  batch.copy_buffer(region.buffer, geometry.get_vertex_buffer(), vertexCopy);
+
+  VkBufferCopy indexCopy{
+    .srcOffset = region.offset + mesh.vertexRange.size,
+    .dstOffset = mesh.indexRange.offset,
+    .size = mesh.indexRange.size,
+  };
+
+  batch.copy_buffer(region.buffer, geometry.get_index_buffer(), indexCopy);
+
+  if (mesh.meshletBuffer.buffer != VK_NULL_HANDLE)
+  {
+    VkBufferCopy meshletCopy{
+      .srcOffset = region.offset + mesh.vertexRange.size + mesh.indexRange.size,
+      .dstOffset = 0,
+      .size = mesh.meshlets.size() * sizeof Meshlet,
+    };
+
+    batch.copy_buffer(region.buffer, mesh.meshletBuffer.buffer, meshletCopy);
+  }
+
+  std::vector<VkBufferMemoryBarrier> barriers;
+
+  // Release to the graphics family, update_streaming queues the matching acquire once the upload is done
+  if (transfer.needs_ownership_transfer())
+  {
+    append_mesh_barriers(barriers, mesh, VK_ACCESS_TRANSFER_WRITE_BIT, 0);
+
+    for (const VkBufferMemoryBarrier& barrier : barriers)
+      batch.barrier_after_copies(barrier, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+  }
+  // Uploading on the graphics queue itself, make the copies visible to the draws of any later submission
+  else
+  {
+    append_mesh_barriers(barriers, mesh, VK_ACCESS_TRANSFER_WRITE_BIT, GeometryReadAccess);
+
+    for (const VkBufferMemoryBarrier& barrier : barriers)
+      batch.barrier_after_copies(barrier, GeometryReadStages);
+  }
+}
+
+void VulkanRenderer::append_mesh_barriers(std::vector<VkBufferMemoryBarrier>& barriers, const Mesh& mesh, VkAccessFlags srcAccess, VkAccessFlags dstAccess) const
+{
+  barriers.push_back(transfer.ownership_barrier(geometry.get_vertex_buffer(), mesh.vertexRange.offset, mesh.vertexRange.size, srcAccess, dstAccess));
+  barriers.push_back(transfer.ownership_barrier(geometry.get_index_buffer(), mesh.indexRange.offset, mesh.indexRange.size, srcAccess, dstAccess));
+
+  if (mesh.meshletBuffer.buffer != VK_NULL_HANDLE)
+    barriers.push_back(transfer.ownership_barrier(mesh.meshletBuffer.buffer, 0, VK_WHOLE_SIZE, srcAccess, dstAccess));
+}
+
+GPUCameraData VulkanRenderer::update_scene_buffer()
+{
+  glm::mat4 view = glm::lookAt(camPos, camPos + camFwd, glm::vec3{ 0.f, 1.f, 0.f });
+
+  glm::mat4 projection = glm::perspective(glm::radians(70.f), 1700.f / 900.f, NearPlane, FarPlane);
+  projection[1][1] *= -1; // flip y axis for vulkan
+
+  GPUCameraData cam{
+    .view = view,
+    .proj = projection,
+    .viewproj = projection * view,
+  };
+
+	scene.ambientColor = { sin(t), 0.f, cos(t), 1.f };
+
+	int frameIndex = frameNumber % MaxFramesInFlight;
+
+  uint8_t* data = sceneBufferData;
+
+  // Not sure at all how this needs to be offset but this works now
+  // (but so does using pad uniform buffer size...)
+
+  // cam + scene data = 272 bytes
+  // Cam Pad = 256
+  const int camData = pad_uniform_buffer_size(sizeof GPUCameraData);
+  // Scene Pad = 256
+  const int sceneData = pad_uniform_buffer_size(sizeof GPUSceneData);
+  // Cam + Scene Pad = 512
+  const int camAndSceneData = pad_uniform_buffer_size(sizeof GPUCameraData + sizeof GPUSceneData);
+  const size_t frameOffset = (sizeof GPUCameraData + sizeof GPUSceneData) * frameIndex;
+  data += frameOffset;
+  memcpy(data, &cam, sizeof GPUCameraData);
+  
+  // Move ptr to Scene Data beginning
+	data += sizeof GPUCameraData;
+  memcpy(data, &scene, sizeof GPUSceneData);
+
+  // Device local memory written directly is not always host coherent
+  vmaFlushAllocation(allocator, sceneBuffer.alloc, frameOffset, sizeof GPUCameraData + sizeof GPUSceneData);
+
+  return cam;
+}
+
+void VulkanRenderer::build_scene_bvh()
+{
+  const auto t1 = std::chrono::high_resolution_clock::now();
+
+  const std::vector<glm::mat4>& transforms = sceneStore.get_transforms();
+  const std::vector<MeshId>& meshIds = sceneStore.get_mesh_ids();
+  const std::vector<uint32_t>& flags = sceneStore.get_flags();
+
+  std::vector<BvhObject> bvhObjects;
+  bvhObjects.reserve(sceneStore.size());
+  bvhObjectsStreaming = 0;
+
+  for (uint32_t i = 0; i < sceneStore.size(); ++i)
+  {
+    if (flags[i] & (ObjectHidden | ObjectFailed))
+      continue;
+
+    // Streaming meshes have no bounds yet, they join once they are resident and bump sceneLayoutVersion
+    if (!(flags[i] & ObjectResident))
+    {
+      ++bvhObjectsStreaming;
+      continue;
+    }
+
+    const Mesh* mesh = sceneStore.get_mesh(meshIds[i]);
+    bvhObjects.push_back(BvhObject{ .bounds = transform_aabb(transforms[i], mesh->bounds.min, mesh->bounds.max), .object = sceneStore.handle_at(i).slot });
+  }
+
+  sceneBvh.build(std::move(bvhObjects));
+  bvhLayoutVersion = sceneLayoutVersion;
+  bvhObjectsRefit = 0;
+  sceneStore.clear_moved();
+
+  const auto t2 = std::chrono::high_resolution_clock::now();
+  std::cout << fmt::format("Built scene BVH over {} objects in {} nodes in {:.4} seconds\n", sceneBvh.get_object_count(), sceneBvh.get_node_count(),
+    std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count() / 1000000000.0);
+}
+
+void VulkanRenderer::refit_scene_bvh()
+{
+  const std::vector<glm::mat4>& transforms = sceneStore.get_transforms();
+  const std::vector<MeshId>& meshIds = sceneStore.get_mesh_ids();
+
+  // Objects outside the tree (streaming, hidden) are ignored by set_bounds
+  for (const uint32_t slot : sceneStore.get_moved_slots())
+  {
+    const uint32_t i = sceneStore.index_of_slot(slot);
+    if (i == UINT32_MAX)
+      continue;
+
+    const Mesh* mesh = sceneStore.get_mesh(meshIds[i]);
+    sceneBvh.set_bounds(slot, transform_aabb(transforms[i], mesh->bounds.min, mesh->bounds.max));
+  }
+
+  sceneBvh.refit();
+  bvhObjectsRefit += (uint32_t)sceneStore.get_moved_slots().size();
+  sceneStore.clear_moved();
+}
+
+void VulkanRenderer::update_scene_bvh()
+{
+  // Refits wear the tree down, once as many objects moved as it holds it is built again
+  if (bvhLayoutVersion != sceneLayoutVersion || bvhObjectsRefit + sceneStore.get_moved_slots().size() > sceneBvh.get_object_count())
+    build_scene_bvh();
+  else if (!sceneStore.get_moved_slots().empty())
+    refit_scene_bvh();
+}
+
+void VulkanRenderer::run_culling_comparison(const Frustum& frustum)
+{
+  update_scene_bvh();
+
+  // The bounds table as draw_objects fills it, over the same resident objects the BVH holds
+  const std::vector<glm::vec4>& bounds = sceneStore.get_bounds();
+  const std::vector<uint32_t>& flags = sceneStore.get_flags();
+
+  BoundsTable table;
+  for (uint32_t i = 0; i < sceneStore.size(); ++i)
+  {
+    if ((flags[i] & ObjectResident) && !(flags[i] & (ObjectHidden | ObjectFailed)))
+      table.push(glm::vec3{ bounds[i] }, bounds[i].w);
+  }
+
+  // Best of several runs, the first one also warms the caches
+  constexpr int Runs = 5;
+
+  auto time_best = [&](std::vector<uint32_t>& out, const std::function<void()>& cull) {
+    double best = std::numeric_limits<double>::max();
+    for (int run = 0; run < Runs; ++run)
+    {
+      out.clear();
+      const auto t1 = std::chrono::high_resolution_clock::now();
+      cull();
+      const auto t2 = std::chrono::high_resolution_clock::now();
+      best = std::min(best, std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count() / 1000000.0);
+    }
+    return best;
+  };
+
+  std::vector<uint32_t> bvhVisible, bruteVisible, tableVisible;
+  const double bvhMs = time_best(bvhVisible, [&] { sceneBvh.query_frustum(frustum, bvhVisible); });
+  const double bruteMs = time_best(bruteVisible, [&] { sceneBvh.query_frustum_brute_force(frustum, bruteVisible); });
+  const double tableMs = time_best(tableVisible, [&] { table.cull(frustum, tableVisible, &cullWorkers); });
+
+  // Both report slots in their own order
+  std::sort(bvhVisible.begin(), bvhVisible.end());
+  std::sort(bruteVisible.begin(), bruteVisible.end());
+
+  // The table tests spheres rather than boxes, so its count only roughly matches the other two
+  std::cout << fmt::format("Culled {} objects: BVH {:.3f}ms ({} visible), brute force boxes {:.3f}ms ({} visible), bounds table spheres {:.3f}ms ({} visible), BVH {} the brute force\n",
+    sceneBvh.get_object_count(), bvhMs, bvhVisible.size(), bruteMs, bruteVisible.size(), tableMs, tableVisible.size(),
+    bvhVisible == bruteVisible ? "matches" : "DIFFERS FROM");
+}
+
+void VulkanRenderer::draw_objects(VkCommandBuffer cmd, const GPUCameraData& cam)
+{
+  const std::vector<glm::mat4>& transforms = sceneStore.get_transforms();
+  const std::vector<MeshId>& meshIds = sceneStore.get_mesh_ids();
+  const std::vector<glm::vec4>& bounds = sceneStore.get_bounds();
+  const std::vector<uint32_t>& flags = sceneStore.get_flags();
+
+  // Pixels covered by one unit at distance one, turns object space LOD errors into screen space ones
+  const float pixelsPerUnit = std::abs(cam.proj[1][1]) * swapchain.get_extents().height * .5f;
+
+  GPUObjectData* objectSSBO = get_current_frame().objectData;
+
+  stats = {};
+
+  // Screen space error per unit of object space error, every submesh picks its LOD against it
+  std::vector<float> errorToPixels(sceneStore.size());
+
+  const Frustum cameraFrustum = extract_frustum(cam.viewproj);
+  const auto cullStart = std::chrono::high_resolution_clock::now();
+
+  visibleObjects.clear();
+
+  if (bvhCulling)
+  {
+    update_scene_bvh();
+    sceneBvh.query_frustum(cameraFrustum, visibleObjects);
+
+    // Slots stay put while other objects come and go, the passes below want dense indices
+    for (uint32_t& object : visibleObjects)
+      object = sceneStore.index_of_slot(object);
+
+    stats.objectsStreaming = bvhObjectsStreaming;
+    stats.cullTested = sceneBvh.get_object_count();
+  }
+  else
+  {
+    // World space bounds of every resident object go into one table, culled in a single pass. Only the flags and
+    // bounds arrays are read.
+    cullBounds.clear();
+    cullObjects.clear();
+
+    for (uint32_t i = 0; i < sceneStore.size(); ++i)
+    {
+      if (flags[i] & (ObjectHidden | ObjectFailed))
+        continue;
+
+      if (!(flags[i] & ObjectResident))
+      {
+        ++stats.objectsStreaming;
+        continue;
+      }
+
+      cullBounds.push(glm::vec3{ bounds[i] }, bounds[i].w);
+      cullObjects.push_back(i);
+    }
+
+    visibleBounds.clear();
+    cullBounds.cull(cameraFrustum, visibleBounds, &cullWorkers);
+
+    for (const uint32_t bounds : visibleBounds)
+      visibleObjects.push_back(cullObjects[bounds]);
+
+    stats.cullTested = cullBounds.size();
+  }
+
+  stats.cullVisible = (uint32_t)visibleObjects.size();
+  stats.cullMs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - cullStart).count() / 1000000.0;
+
+  // Every submesh of every visible object becomes an item, sorted so draws sharing state are recorded together
+  renderQueue.clear();
+
+  for (const uint32_t i : visibleObjects)
+  {
+    const glm::mat4& transform = transforms[i];
+    const Mesh& mesh = *sceneStore.get_mesh(meshIds[i]);
+
+    const float scale = std::max({ glm::length(glm::vec3{ transform[0] }), glm::length(glm::vec3{ transform[1] }), glm::length(glm::vec3{ transform[2] }) });
+    const float distance = std::max(glm::length(glm::vec3{ bounds[i] } - camPos) - bounds[i].w, NearPlane);
+    errorToPixels[i] = scale / distance * pixelsPerUnit;
+
+    const uint32_t meshId = renderQueue.get_mesh_id(&mesh);
+
+    for (uint32_t s = 0; s < mesh.submeshes.size(); ++s)
+    {
+      Material* mat = sceneStore.get_submesh_material(i, mesh.submeshes[s].materialSlot);
+      if (mesh.format == VertexFormat::Packed && mat->packed)
+        mat = mat->packed;
+
+      renderQueue.push(DrawItem{
+        .key = RenderQueue::make_key(DrawPass::Opaque, renderQueue.get_pipeline_id(mat->pipeline), renderQueue.get_material_id(mat), mesh.indexType, meshId, s, distance / FarPlane),
+        .mat = mat,
+        .object = i,
+        .submesh = s
+      });
+    }
+  }
+
+  // What recording the items in scene order would have bound
+  {
+    BindTracker unsorted;
+    for (const DrawItem& item : renderQueue.get_items())
+      unsorted.update(item.mat->pipeline, item.mat->layout, item.mat->texture, sceneStore.get_mesh(meshIds[item.object])->indexType);
+    stats.unsortedBinds = unsorted.get_counts();
+  }
+
+  renderQueue.sort();
+
+  const std::vector<DrawItem>& items = renderQueue.get_items();
+
+  // Object data is laid out in draw order, one slot per item, so the instances of a draw read consecutive slots
+  // starting at its first instance. Items past MaxObjects are not drawn.
+  const uint32_t drawCount = (uint32_t)std::min<size_t>(items.size(), MaxObjects);
+  if (drawCount < items.size())
+  {
+    stats.drawsDropped = (uint32_t)(items.size() - drawCount);
+    if (!droppedDrawsReported)
+    {
+      std::cout << fmt::format("{} visible submeshes do not fit the {} object slots, the rest are not drawn\n", items.size(), MaxObjects);
+      droppedDrawsReported = true;
+    }
+  }
+  for (uint32_t slot = 0; slot < drawCount; ++slot)
+  {
+    const uint32_t object = items[slot].object;
+    objectSSBO[slot].model = transforms[object];
+    objectSSBO[slot].positionDequant = sceneStore.get_mesh(meshIds[object])->positionDequant;
+  }
+
+  // Coarsest LOD whose simplification error stays under lodErrorThreshold pixels on screen
+  auto select_lod = [&](const Submesh& submesh, uint32_t object) {
+    uint32_t lod = 0;
+    while (lod + 1 < submesh.lodCount && submesh.lods[lod + 1].error * errorToPixels[object] <= lodErrorThreshold)
+      ++lod;
+    return lod;
+  };
+
+  // Every mesh lives in the geometry pool, so the vertex buffer is bound once
+  VkDeviceSize vertexBufferOffset = 0;
+  VkBuffer vertexBuffer = geometry.get_vertex_buffer();
+  vkCmdBindVertexBuffers(cmd, 0, 1, &vertexBuffer, &vertexBufferOffset);
+
+  BindTracker binds;
+
+  // With indirect draws the commands of a run of draws sharing state are written to the frame's buffer and
+  // issued with one vkCmdDrawIndexedIndirect once the state changes
+  const bool indirect = indirectDrawsSupported && indirectDraws;
+  const AllocatedBuffer& indirectBuffer = get_current_frame().indirectBuffer;
+  VkDrawIndexedIndirectCommand* commands = nullptr;
+  uint32_t commandCount = 0;
+  uint32_t runStart = 0;
+  const Material* runMat = nullptr;
+  VkIndexType runIndexType = VK_INDEX_TYPE_UINT32;
+
+  if (indirect)
+    commands = get_current_frame().indirectData;
+
+  auto flush_run = [&]() {
+    if (commandCount == runStart)
+      return;
+
+    vkCmdDrawIndexedIndirect(cmd, indirectBuffer.buffer, runStart * sizeof VkDrawIndexedIndirectCommand, commandCount - runStart, sizeof VkDrawIndexedIndirectCommand);
+    ++stats.drawCalls;
+    runStart = commandCount;
+  };
+
+  // Only computed once a submesh actually culls meshlets, for the object it was computed for
+  std::optional<Frustum> frustum;
+  glm::vec3 eye;
+  uint32_t frustumObject = UINT32_MAX;
+
+  for (uint32_t slot = 0; slot < drawCount;)
+  {
+    const DrawItem& item = items[slot];
+    const glm::mat4& transform = transforms[item.object];
+    const Mesh& mesh = *sceneStore.get_mesh(meshIds[item.object]);
+    const Submesh& submesh = mesh.submeshes[item.submesh];
+    Material* mat = item.mat;
+
+    // Binding has to wait for the run recorded so far, it was written against the previous state
+    if (indirect && (!runMat || mat->pipeline != runMat->pipeline || mat->texture != runMat->texture || mesh.indexType != runIndexType))
+    {
+      flush_run();
+      runMat = mat;
+      runIndexType = mesh.indexType;
+    }
+
+    bind_material(cmd, binds, mat, mesh.indexType);
+
+    const uint32_t lod = select_lod(submesh, item.object);
+    const uint32_t firstInstance = slot;
+
+    // The shaders index object data with gl_InstanceIndex, which starts at the first instance
+    auto draw_range = [&](uint32_t firstIndex, uint32_t indexCount, uint32_t instanceCount) {
+      if (indirect && commandCount < MaxIndirectCommands)
+      {
+        commands[commandCount++] = VkDrawIndexedIndirectCommand{
+          .indexCount = indexCount,
+          .instanceCount = instanceCount,
+          .firstIndex = mesh.baseIndex + firstIndex,
+          .vertexOffset = mesh.baseVertex,
+          .firstInstance = firstInstance
+        };
+      }
+      else
+      {
+        // The run so far has to go out first to keep the draw order
+        if (indirect)
+          flush_run();
+        vkCmdDrawIndexed(cmd, indexCount, instanceCount, mesh.baseIndex + firstIndex, mesh.baseVertex, firstInstance);
+        ++stats.drawCalls;
+      }
+
+      stats.instances += instanceCount;
+      stats.triangles += (uint64_t)indexCount / 3 * instanceCount;
+      stats.lodTriangles[lod] += (uint64_t)indexCount / 3 * instanceCount;
+    };
+
+    // Meshlets only cover the full detail level
+    if (lod > 0 || submesh.meshletCount < MinMeshletsForCulling)
+    {
+      // The items after this one drawing the same submesh at the same LOD become its instances
+      uint32_t instanceCount = 1;
+      while (slot + instanceCount < drawCount)
+      {
+        const DrawItem& next = items[slot + instanceCount];
+        if (next.mat != mat || meshIds[next.object] != meshIds[item.object] || next.submesh != item.submesh || select_lod(submesh, next.object) != lod)
+          break;
+        ++instanceCount;
+      }
+
+      draw_range(submesh.lods[lod].firstIndex, submesh.lods[lod].indexCount, instanceCount);
+      if (lod == 0)
+      {
+        stats.meshletsTotal += submesh.meshletCount * instanceCount;
+        stats.meshletsVisible += submesh.meshletCount * instanceCount;
+      }
+
+      slot += instanceCount;
+      continue;
+    }
+
+    // Meshlets are culled per object, these draws stay single instances
+    ++slot;
+
+    stats.meshletsTotal += submesh.meshletCount;
+
+    // Cull meshlets in object space, so neither the bounds nor the cones need transforming
+    if (frustumObject != item.object)
+    {
+      frustum = extract_frustum(cam.viewproj * transform);
+      eye = glm::vec3{ glm::inverse(transform) * glm::vec4{ camPos, 1.f } };
+      frustumObject = item.object;
+    }
+
+    // Meshlets are contiguous index ranges, so runs of visible ones go out as a single draw
+    uint32_t runFirst = 0, runCount = 0;
+    for (uint32_t m = submesh.firstMeshlet; m < submesh.firstMeshlet + submesh.meshletCount; ++m)
+    {
+      const Meshlet& meshlet = mesh.meshlets[m];
+      if (sphere_in_frustum(*frustum, glm::vec3{ meshlet.sphere }, meshlet.sphere.w) && !(mat->backfaceCulled && meshlet_backfacing(meshlet, eye)))
+      {
+        if (runCount == 0)
+          runFirst = meshlet.firstIndex;
+        runCount += meshlet.indexCount;
+        ++stats.meshletsVisible;
+        continue;
+      }
+
+      if (runCount > 0)
+      {
+        draw_range(runFirst, runCount, 1);
+        runCount = 0;
+      }
+    }
+
+    if (runCount > 0)
+      draw_range(runFirst, runCount, 1);
+  }
+
+  stats.binds = binds.get_counts();
+
+  if (indirect)
+  {
+    flush_run();
+    vmaFlushAllocation(allocator, indirectBuffer.alloc, 0, commandCount * sizeof VkDrawIndexedIndirectCommand);
+  }
+
+  vmaFlushAllocation(allocator, get_current_frame().objectBuffer.alloc, 0, drawCount * sizeof GPUObjectData);
+}
+
+void VulkanRenderer::bind_material(VkCommandBuffer cmd, BindTracker& binds, Material* mat, VkIndexType indexType)
+{
+  const BindChanges changes = binds.update(mat->pipeline, mat->layout, mat->texture, indexType);
+
+  if (changes.pipeline)
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mat->pipeline);
+
+  if (changes.globalSets)
+  {
+    // Get uniform offset due to 1 dynamic descriptor set, only the scene set has one
+    uint32_t dynamicOffset = 0;
+    VkDescriptorSet globalSets[] = { sceneDescriptor, get_current_frame().objectDescriptor };
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mat->layout, 0, 2, globalSets, 1, &dynamicOffset);
+  }
+
+  if (changes.texture)
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, mat->layout, 2, 1, &mat->texture, 0, nullptr);
+
+  if (changes.indexBuffer)
+    vkCmdBindIndexBuffer(cmd, geometry.get_index_buffer(), 0, indexType);
+}
+
+void VulkanRenderer::build_gpu_scene()
+{
+  const std::vector<glm::mat4>& transforms = sceneStore.get_transforms();
+  const std::vector<MeshId>& meshIds = sceneStore.get_mesh_ids();
+  const std::vector<uint32_t>& flags = sceneStore.get_flags();
+
+  renderQueue.clear();
+  gpuObjectsStreaming = 0;
+
+  for (uint32_t i = 0; i < sceneStore.size(); ++i)
+  {
+    if (flags[i] & (ObjectHidden | ObjectFailed))
+      continue;
+
+    if (!(flags[i] & ObjectResident))
+    {
+      ++gpuObjectsStreaming;
+      continue;
+    }
+
+    const Mesh& mesh = *sceneStore.get_mesh(meshIds[i]);
+    const uint32_t meshId = renderQueue.get_mesh_id(&mesh);
+
+    for (uint32_t s = 0; s < mesh.submeshes.size(); ++s)
+    {
+      Material* mat = sceneStore.get_submesh_material(i, mesh.submeshes[s].materialSlot);
+      if (mesh.format == VertexFormat::Packed && mat->packed)
+        mat = mat->packed;
+
+      // Built once for every camera, so depth is left out of the key
+      renderQueue.push(DrawItem{
+        .key = RenderQueue::make_key(DrawPass::Opaque, renderQueue.get_pipeline_id(mat->pipeline), renderQueue.get_material_id(mat), mesh.indexType, meshId, s, 0.f),
+        .mat = mat,
+        .object = i,
+        .submesh = s
+      });
+    }
+  }
+
+  {
+    BindTracker unsorted;
+    for (const DrawItem& item : renderQueue.get_items())
+      unsorted.update(item.mat->pipeline, item.mat->layout, item.mat->texture, sceneStore.get_mesh(meshIds[item.object])->indexType);
+    gpuUnsortedBinds = unsorted.get_counts();
+  }
+
+  renderQueue.sort();
+
+  indirectBatches.clear();
+  gpuObjects.clear();
+  gpuDraws.clear();
+
+  // Draws past MaxObjects or MaxIndirectBatches are not drawn
+  for (const DrawItem& item : renderQueue.get_items())
+  {
+    if (gpuDraws.size() == MaxObjects)
+      break;
+
+    const Mesh& mesh = *sceneStore.get_mesh(meshIds[item.object]);
+    const Submesh& submesh = mesh.submeshes[item.submesh];
+    const uint32_t slot = (uint32_t)gpuDraws.size();
+
+    if (indirectBatches.empty() || indirectBatches.back().mat != item.mat || indirectBatches.back().indexType != mesh.indexType)
+    {
+      if (indirectBatches.size() == MaxIndirectBatches)
+        break;
+
+      indirectBatches.push_back(IndirectBatch{ .mat = item.mat, .indexType = mesh.indexType, .firstCommand = slot, .commandCount = 0 });
+    }
+
+    IndirectBatch& batch = indirectBatches.back();
+    ++batch.commandCount;
+
+    GPUDrawData draw{
+      .sphere = glm::vec4{ mesh.bounds.origin, mesh.bounds.radius },
+      .batch = (uint32_t)indirectBatches.size() - 1,
+      .firstCommand = batch.firstCommand,
+      .lodCount = submesh.lodCount,
+      .vertexOffset = mesh.baseVertex,
+    };
+
+    for (uint32_t lod = 0; lod < submesh.lodCount; ++lod)
+    {
+      const MeshLod& level = submesh.lods[lod];
+      draw.lods[lod] = glm::uvec4{ mesh.baseIndex + level.firstIndex, level.indexCount, glm::floatBitsToUint(level.error), 0 };
+    }
+
+    gpuDraws.push_back(draw);
+    gpuObjects.push_back(GPUObjectData{ .model = transforms[item.object], .positionDequant = mesh.positionDequant });
+  }
+
+  builtSceneVersion = sceneVersion;
+
+  gpuDrawsDropped = (uint32_t)(renderQueue.get_items().size() - gpuDraws.size());
+  if (gpuDrawsDropped > 0 && !droppedDrawsReported)
+  {
+    std::cout << fmt::format("{} of {} submeshes do not fit the {} object slots and {} indirect batches, they are not drawn\n",
+      gpuDrawsDropped, renderQueue.get_items().size(), MaxObjects, MaxIndirectBatches);
+    droppedDrawsReported = true;
+  }
+
+  std::cout << fmt::format("GPU scene holds {} draws in {} indirect batches\n", gpuDraws.size(), indirectBatches.size());
+}
+
+void VulkanRenderer::write_cull_params(const GPUCameraData& cam)
+{
+  const Frustum frustum = extract_frustum(cam.viewproj);
+
+  GPUCullParams params{
+    // Pixels covered by one unit at distance one, as in draw_objects
+    .eye = glm::vec4{ camPos, std::abs(cam.proj[1][1]) * swapchain.get_extents().height * .5f },
+    .viewproj = cam.viewproj,
+    .lodErrorThreshold = lodErrorThreshold,
+    .nearPlane = NearPlane,
+    .drawCount = (uint32_t)gpuDraws.size(),
+    .occlusion = occlusionCulling,
+  };
+
+  std::copy(std::begin(frustum.planes), std::end(frustum.planes), params.planes);
+
+  culler.write_params(frameNumber % MaxFramesInFlight, params);
+}
+
+void VulkanRenderer::read_cull_stats()
+{
+  // Nothing is read back per draw, the counts left by this frame's previous cull only feed the stats
+  uint32_t drawsVisible;
+  const GPUCullStats cullStats = culler.read_stats(frameNumber % MaxFramesInFlight, drawsVisible);
+
+  stats = {};
+  stats.instances = drawsVisible;
+  stats.triangles = cullStats.triangles;
+  for (uint32_t lod = 0; lod < MaxMeshLods; ++lod)
+    stats.lodTriangles[lod] = cullStats.lodTriangles[lod];
+  stats.objectsStreaming = gpuObjectsStreaming;
+  stats.drawsDropped = gpuDrawsDropped;
+  stats.cullTested = (uint32_t)gpuDraws.size();
+  stats.cullVisible = drawsVisible;
+  stats.cullOccluded = cullStats.occluded;
+  stats.lateDraws = cullStats.lateDraws;
+  stats.unsortedBinds = gpuUnsortedBinds;
+}
+
+void VulkanRenderer::draw_objects_indirect(VkCommandBuffer cmd, CullPhase phase, BindTracker& binds)
+{
+  const uint32_t frameIndex = frameNumber % MaxFramesInFlight;
+
+  VkDeviceSize vertexBufferOffset = 0;
+  VkBuffer vertexBuffer = geometry.get_vertex_buffer();
+  vkCmdBindVertexBuffers(cmd, 0, 1, &vertexBuffer, &vertexBufferOffset);
+
+  const VkBuffer commands = culler.get_command_buffer(frameIndex);
+  const VkBuffer counts = culler.get_count_buffer(frameIndex);
+
+  // One draw per batch no matter how many objects there are, the compute pass decided how many commands it runs
+  for (uint32_t b = 0; b < indirectBatches.size(); ++b)
+  {
+    const IndirectBatch& batch = indirectBatches[b];
+
+    bind_material(cmd, binds, batch.mat, batch.indexType);
+
+    vkCmdDrawIndexedIndirectCount(cmd, commands, culler.command_offset(phase, batch.firstCommand), counts, culler.count_offset(phase, b),
+      batch.commandCount, sizeof VkDrawIndexedIndirectCommand);
+    ++stats.drawCalls;
+  }
+}
+
+FrameData& VulkanRenderer::get_current_frame()
+{
+  return frames[frameNumber % MaxFramesInFlight];
+}
+
+AllocatedBuffer VulkanRenderer::create_buffer(size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage, void** outMapped)
+{
+  VkBufferCreateInfo bufInfo{
+    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+    .pNext = nullptr,
+
+    .size = allocSize,
+    .usage = usage
+  };
+
+  VmaAllocationCreateInfo allocInfo{
+    .flags = outMapped ? VMA_ALLOCATION_CREATE_MAPPED_BIT : 0u,
+    .usage = memoryUsage
+  };
+
+  // Buffers the CPU writes every frame go where the GPU reads them fastest
+  if (memoryUsage == VMA_MEMORY_USAGE_CPU_TO_GPU && directUploads)
+  {
+    allocInfo.flags |= VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+    allocInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+  }
+
+  AllocatedBuffer buf;
+  VmaAllocationInfo allocation;
+  VK_CHECK(vmaCreateBuffer(allocator, &bufInfo, &allocInfo, &buf.buffer, &buf.alloc, &allocation));
+
+  if (outMapped)
+    *outMapped = allocation.pMappedData;
 
   return buf;
 }
@@ -1067,10 +2359,12 @@ void VulkanRenderer::immediate_submit(std::function<void(VkCommandBuffer)>&& fun
 
   auto submit = vkinit::submit_info(&cmd);
 
-  VK_CHECK(vkQueueSubmit(graphicsQueue, 1, &submit, upload.upload));
+  uint64_t batch;
+  VkFence fence = staging.submit(&batch);
+
+  VK_CHECK(vkQueueSubmit(graphicsQueue, 1, &submit, fence));
 
-  vkWaitForFences(device, 1, &upload.upload, VK_TRUE, timeout);
-  vkResetFences(device, 1, &upload.upload);
+  staging.wait(batch);
 
   vkResetCommandPool(device, upload.pool, 0);
 }
@@ -1,37 +1,73 @@
 #pragma once
 
 #include "core/window/window.hpp"
+#include "core/renderer/vk_bounds_table.hpp"
+#include "core/renderer/vk_depth_pyramid.hpp"
+#include "core/renderer/vk_scene_bvh.hpp"
+#include "core/renderer/vk_scene_store.hpp"
+#include "core/renderer/vk_gpu_culling.hpp"
 #include "core/renderer/vk_mesh.hpp"
 #include "core/renderer/vk_pipeline.hpp"
+#include "core/renderer/vk_render_queue.hpp"
+#include "core/renderer/vk_staging_ring.hpp"
+#include "core/renderer/vk_transfer_queue.hpp"
+#include "core/renderer/vk_upload_batch.hpp"
 #include "core/renderer/vk_swapchain.hpp"
+#include "core/renderer/vk_texture_cooker.hpp"
+#include "core/threading/thread_pool.hpp"
 
 constexpr uint32_t MaxFramesInFlight = 2;
 
-// Camera data
-struct MeshPushConstants
-{
-	glm::vec4 data;
-	glm::mat4 render_matrix;
-};
+// Capacity of the shared buffers every mesh's vertices and indices are suballocated from
+constexpr VkDeviceSize GeometryPoolVertexBytes = 128ull * 1024 * 1024;
+constexpr VkDeviceSize GeometryPoolIndexBytes = 64ull * 1024 * 1024;
+
+// Persistently mapped staging memory every mesh and texture upload goes through
+constexpr VkDeviceSize StagingRingBytes = 64ull * 1024 * 1024;
+
+// Smallest host visible device local heap buffers are written into directly, see VulkanRenderer::supports_direct_uploads
+constexpr VkDeviceSize DirectUploadMinHeapBytes = 512ull * 1024 * 1024;
+
+// Object data slots per frame, one per submesh drawn
+constexpr uint32_t MaxObjects = 100000;
+
+// Indirect commands draw_objects writes per frame, objects culling meshlets can take several. Draws past it are
+// recorded directly.
+constexpr uint32_t MaxIndirectCommands = MaxObjects * 2;
+
+// Runs of draws sharing a material the GPU culled path issues with one indirect draw each
+constexpr uint32_t MaxIndirectBatches = 256;
+
+constexpr float NearPlane = 0.1f;
+constexpr float FarPlane = 200.f;
+
+// Fewest threads loading streamed assets in the background, machines with more cores get one less than they have
+constexpr uint32_t AssetWorkerThreads = 2;
+
+// Threads helping the calling one frustum cull large scenes on the CPU, see BoundsTable
+constexpr uint32_t CullWorkerThreads = 3;
+
+// Stages reading uploaded geometry, where frames wait for the transfer queue and acquire what it released
+constexpr VkPipelineStageFlags GeometryReadStages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT;
+constexpr VkAccessFlags GeometryReadAccess = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
 
 struct Material
 {
   VkPipeline pipeline;
   VkPipelineLayout layout;
   VkDescriptorSet texture = VK_NULL_HANDLE;
+  // Permutation drawing VertexFormat::Packed meshes, picked per mesh at draw time
+  Material* packed = nullptr;
+  // Meshlet cone culling only matches what gets drawn when the pipeline drops back faces too
+  bool backfaceCulled = false;
 };
 
 struct Texture
 {
-  AllocatedImage image;
-  VkImageView view;
-};
-
-struct RenderObject
-{
-  Mesh* mesh;
-  Material* mat;
-  glm::mat4 transform;
+  AllocatedImage image{ .image = VK_NULL_HANDLE, .alloc = nullptr };
+  VkImageView view = VK_NULL_HANDLE;
+  // Set once its upload is recorded, materials sample the renderer's placeholder until then
+  bool resident = false;
 };
 
 struct GPUCameraData
@@ -53,6 +89,37 @@ struct GPUSceneData
 struct GPUObjectData
 {
 	alignas(16) glm::mat4 model;
+	alignas(16) glm::vec4 positionDequant; // Mesh::positionDequant, only read for packed vertices
+};
+
+// Counters for the last recorded frame
+// With GPU culling the counts the compute pass wrote are read back, so they trail the recorded frame by
+// MaxFramesInFlight frames and meshlets are not culled
+struct FrameStats
+{
+  uint32_t drawCalls = 0;
+  uint32_t instances = 0; // Submeshes drawn, several per draw call when instanced
+  uint64_t triangles = 0;
+  uint32_t meshletsVisible = 0;
+  uint32_t meshletsTotal = 0;
+  uint64_t lodTriangles[MaxMeshLods]{};
+  uint32_t objectsStreaming = 0; // Skipped since their mesh is not resident yet
+  uint32_t cullTested = 0;       // Objects tested against the frustum, submesh draws with GPU culling
+  uint32_t cullVisible = 0;
+  uint32_t cullOccluded = 0;     // Inside the frustum but hidden behind the depth pyramid, GPU culling only
+  uint32_t lateDraws = 0;        // Hidden by the previous frame's depth but not by this one's
+  uint32_t drawsDropped = 0;     // Past what the object and batch buffers hold, never drawn
+  BindCounts binds;
+  BindCounts unsortedBinds; // What the same draws would have bound in scene order
+  double recordMs = 0.0;    // CPU time spent recording the scene's draws
+  double cullMs = 0.0;      // CPU time spent frustum culling objects, part of recordMs
+};
+
+// Bytes uploaded since init, by whether they were written straight into device memory or copied from staging
+struct UploadStats
+{
+  uint64_t directBytes = 0;
+  uint64_t stagedBytes = 0;
 };
 
 struct FrameData
@@ -64,16 +131,47 @@ struct FrameData
   VkCommandBuffer cmdBuffer;
 
   AllocatedBuffer objectBuffer;
+  GPUObjectData* objectData = nullptr; // Persistently mapped
   VkDescriptorSet objectDescriptor;
+
+  // VkDrawIndexedIndirectCommands draw_objects writes, see MaxIndirectCommands
+  AllocatedBuffer indirectBuffer;
+  VkDrawIndexedIndirectCommand* indirectData = nullptr; // Persistently mapped
+
+  // Version of the GPU culled scene the object buffer and culling draws hold
+  uint64_t sceneVersion = 0;
 };
 
 struct UploadContext
 {
-  VkFence upload;
   VkCommandPool pool;
   VkCommandBuffer buffer;
 };
 
+// Draws of one material and index type, issued with a single vkCmdDrawIndexedIndirectCount. Its commands and
+// draws start at the same slot.
+struct IndirectBatch
+{
+  Material* mat;
+  VkIndexType indexType;
+  uint32_t firstCommand;
+  uint32_t commandCount;
+};
+
+// Mesh upload in flight on the transfer queue, the mesh becomes resident once the timeline reaches transferValue
+enum class MeshUpload
+{
+  Staged,  // Copies enqueued, resident once the transfer queue is done with them
+  Written, // Went straight into device memory, resident right away
+  Failed,  // No room left in the geometry pool, stays non-resident
+};
+
+struct PendingUpload
+{
+  Mesh* mesh;
+  uint64_t transferValue;
+};
+
 class VulkanRenderer
 {
 public:
@@ -84,24 +182,152 @@ public:
   void swap_pipeline();
 
   void cleanup();
+
+  // Returns the mesh registered under name straight away and loads it on the asset workers. It is drawn
+  // once Mesh::resident is set, objects using it are skipped until then.
+  Mesh* request_mesh(const std::string& name, const std::string& path, const std::string& mtlDir = "", VertexFormat format = VertexFormat::Full);
+
+  // Returns the texture registered under name straight away and decodes it on the asset workers, block
+  // compressed through the texture cache if a codec is given. Materials bound to it with bind_texture sample a
+  // 1x1 placeholder until update_streaming has uploaded it.
+  Texture* request_texture(const std::string& name, const std::string& filePath, std::optional<TextureCodec> codec = std::nullopt);
+
+  // Points the material's texture set at texture, or at the placeholder while it is not resident yet
+  void bind_texture(Material* mat, Texture* texture);
   
 ////
-  AllocatedBuffer create_buffer(size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage);
+  // Buffers given outMapped stay mapped for their whole lifetime, writes to them still need a vmaFlushAllocation
+  AllocatedBuffer create_buffer(size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage, void** outMapped = nullptr);
 
+  // Submits on the graphics queue and waits, staging regions allocated before the call are reclaimed with it
   void immediate_submit(std::function<void(VkCommandBuffer)>&& func);
 
+  // Records the whole batch into one command buffer and submits it once. Buffer only batches go to the transfer
+  // queue without waiting and the timeline value signaled once they are done is returned, batches needing the
+  // graphics queue go through immediate_submit and return 0. Batches holding both are split, their buffers go to
+  // the transfer queue and its timeline value is returned.
+  uint64_t submit_uploads(const UploadBatch& batch);
+
+  [[nodiscard]]
+  StagingRing& get_staging() { return staging; }
+
+  // Shared by everything loading assets, jobs split their own work over it with ThreadPool::parallel_for
+  [[nodiscard]]
+  ThreadPool& get_asset_workers() { return assetWorkers; }
+
+  const FrameStats& get_stats() const { return stats; }
+
+  [[nodiscard]]
+  UploadStats get_upload_stats() const { return UploadStats{ .directBytes = directUploadBytes, .stagedBytes = staging.get_allocated_bytes() }; }
+
+  // Device local memory is host visible (resizable BAR or unified memory), so mesh data and the CPU_TO_GPU
+  // buffers from create_buffer live in it and are written without a transfer
+  [[nodiscard]]
+  bool supports_direct_uploads() const { return directUploads; }
+
+  [[nodiscard]]
+  VkPhysicalDevice get_gpu() const { return gpu; }
+
+  [[nodiscard]]
+  bool supports_bc_textures() const { return bcTextures; }
+
+  // Frustum culling and LOD selection run in a compute pass feeding indirect draws, otherwise draw_objects
+  // does both on the CPU
+  [[nodiscard]]
+  bool supports_gpu_culling() const { return gpuCulling; }
+
+  // Indirect draws with a first instance, draw_objects then issues one multi-draw per run of shared state
+  [[nodiscard]]
+  bool supports_indirect_draws() const { return indirectDrawsSupported; }
+
+  // Adds the object to the scene, nothing if the mesh or material is missing
+  std::optional<ObjectHandle> add_object(Mesh* mesh, Material* mat, const glm::mat4& transform);
+
+  // Returns false for stale handles
+  bool remove_object(ObjectHandle handle);
+
+  // Moves the object, the BVH refits its bounds instead of being built again. Nothing for stale handles.
+  void set_object_transform(ObjectHandle handle, const glm::mat4& transform);
+
+  // Replaces the objects added by the previous call with a grid of count more, for comparing recording times.
+  // 0 leaves the scene as init made it. Clamped so the scene stays within MaxObjects.
+  void set_benchmark_objects(uint32_t count);
+
+  // Culls the next frame's camera with the scene BVH, with every object's box tested in turn and with the bounds
+  // table, then logs how long each took and whether the BVH kept exactly what the brute force test did
+  void compare_culling() { cullComparisonPending = true; }
+
   VmaAllocator allocator;
 
   glm::vec3 camPos{ 0.f, -6.f, -10.f };
   glm::vec3 camFwd{ 0.f, 0.f, -1.f };
 
+  // Largest simplification error in pixels the LOD selection accepts, 0 always draws full detail
+  float lodErrorThreshold = 1.f;
+
+  // Tests draws against the depth of the previous frame and of the draws that passed, only with GPU culling.
+  // Whole draws are tested, meshlets are not. Off for good when GPU culling is unsupported.
+  bool occlusionCulling = true;
+
+  // Records CPU culled draws as multi-draw indirect instead of one vkCmdDrawIndexed each, when supported
+  bool indirectDraws = true;
+
+  // Culls and draws on the CPU even where GPU culling is supported, to compare the two or benchmark the CPU path
+  bool cpuCulling = false;
+
+  // Frustum culls CPU drawn objects by walking the scene BVH instead of testing every one in the bounds table
+  bool bvhCulling = true;
+
 private:
-  Material* create_material(VkPipeline pipeline, VkPipelineLayout layout, const std::string& name);
+  Material* create_material(VkPipeline pipeline, VkPipelineLayout layout, const std::string& name, VkCullModeFlags cullMode = VK_CULL_MODE_NONE);
   Material* get_material(const std::string& name);
   Mesh* get_mesh(const std::string& name);
-  void upload_mesh(Mesh& mesh);
-
-  void draw_objects(VkCommandBuffer cmd, RenderObject* first, int count);
+  // Material per slot of the mesh's materialNames, InvalidMaterialId for slots without a material of that name.
+  // Empty when no slot has one, those objects draw everything with their own material.
+  std::vector<MaterialId> resolve_submesh_materials(const Mesh& mesh);
+  // Gives every object drawing the mesh the materials its slots are named after, once they are known
+  void assign_submesh_materials(const Mesh* mesh);
+  // Uploads every mesh in one transfer queue submission without waiting, update_streaming makes them resident
+  // once it is done. Meshes written directly are resident straight away.
+  void upload_meshes(const std::vector<Mesh*>& uploads);
+  // Stages the mesh and enqueues its copies for the caller to submit
+  MeshUpload upload_mesh(Mesh& mesh, UploadBatch& batch);
+  // Allocates the mesh's geometry pool ranges and meshlet buffer and writes its data. outRegion is the staging
+  // region holding it, nothing if it went straight into device memory. Returns false if the pool is out of space.
+  bool stage_mesh(Mesh& mesh, std::optional<StagingRegion>& outRegion);
+  void record_mesh_upload(UploadBatch& batch, const Mesh& mesh, const StagingRegion& region);
+  // Submits uploads for meshes the asset workers finished and makes the ones the transfer queue is done with
+  // resident, queueing their acquire barriers for the frame
+  void update_streaming();
+  // Stages textures the asset workers finished into textureUploads and rebinds the materials sampling them
+  void upload_textures(std::vector<std::pair<Texture*, DecodedImage>>& decoded);
+  // Frames in flight may still read the material's current set, so it gets a new one instead of an update
+  void write_texture_set(Material* mat, VkImageView view);
+  // Barriers over every buffer range record_mesh_upload writes
+  void append_mesh_barriers(std::vector<VkBufferMemoryBarrier>& barriers, const Mesh& mesh, VkAccessFlags srcAccess, VkAccessFlags dstAccess) const;
+
+  // Writes the frame's camera and scene data and returns the camera
+  GPUCameraData update_scene_buffer();
+  // Builds sceneBvh over the resident objects, its queries report their slots
+  void build_scene_bvh();
+  // Builds sceneBvh again or refits it, whichever the changes since it was built call for
+  void update_scene_bvh();
+  // See compare_culling
+  void run_culling_comparison(const Frustum& frustum);
+  // Gives the objects moved since the BVH was built or refit their new boxes and refits it
+  void refit_scene_bvh();
+  void draw_objects(VkCommandBuffer cmd, const GPUCameraData& cam);
+
+  // Sorts every resident submesh into indirect batches and fills the object data and culling draws frames copy
+  // once their sceneVersion is stale
+  void build_gpu_scene();
+  void write_cull_params(const GPUCameraData& cam);
+  // Fills the stats from what this frame's previous submission culled
+  void read_cull_stats();
+  // Issues the batches with the commands the phase wrote
+  void draw_objects_indirect(VkCommandBuffer cmd, CullPhase phase, BindTracker& binds);
+  // Binds what the material and index type need that the previous draws did not bind yet
+  void bind_material(VkCommandBuffer cmd, BindTracker& binds, Material* mat, VkIndexType indexType);
 
   FrameData& get_current_frame();
   size_t pad_uniform_buffer_size(size_t originalSize) const;
@@ -111,6 +337,11 @@ private:
   VkDevice device;
   VkSurfaceKHR surface;
   VkPhysicalDeviceProperties gpuProperties;
+  bool bcTextures = false;
+  bool directUploads = false;
+  uint64_t directUploadBytes = 0;
+  bool gpuCulling = false;
+  bool indirectDrawsSupported = false;
 
   VulkanSwapchain swapchain;
 
@@ -122,9 +353,12 @@ private:
   VkQueue graphicsQueue;
   uint32_t graphicsQueueFamily;
 
+  TransferQueue transfer;
+
   // Should this couple with swapchain? Need the imageviews to sync with framebuffers count
   // Or maybe its own render pass class that handles that stuff when we need to remake etc
   VkRenderPass renderPass;
+  VkRenderPass lateRenderPass; // Loads what renderPass drew, for the late culling phase
   std::vector<VkFramebuffer> framebuffers;
 
   FrameData frames[MaxFramesInFlight];
@@ -132,6 +366,7 @@ private:
   // Buffer that holds a GPUCameraData for use when rendering
   GPUSceneData scene;
   AllocatedBuffer sceneBuffer;
+  uint8_t* sceneBufferData = nullptr; // Persistently mapped
   VkDescriptorSet sceneDescriptor;
   
 	VkSampler blockySampler;
@@ -145,24 +380,85 @@ private:
 	VkPipeline redTrianglePipeline;
   VkPipeline meshPipeline;
   VkPipeline texturedPipeline;
+  VkPipeline meshPackedPipeline;
+  VkPipeline texturedPackedPipeline;
   Mesh triangleMesh;
-  Mesh monkeyMesh;
-  Mesh thingMesh;
   VkPipelineLayout pipelineLayout;
 	VkPipelineLayout meshPipelineLayout;
 	VkPipelineLayout texturedPipelineLayout;
 
-  std::vector<RenderObject> objects;
+  GeometryPool geometry;
+  StagingRing staging;
+
+  SceneStore sceneStore;
+  uint64_t boundsLayoutVersion = 0; // sceneLayoutVersion the store's bounds were last refreshed at
   std::unordered_map<std::string, Material> materials;
   std::unordered_map<std::string, Mesh> meshes;
   std::unordered_map<std::string, Texture> textures;
 
   UploadContext upload;
 
+  ThreadPool assetWorkers;
+  std::mutex loadedMeshesMutex;
+  std::vector<std::pair<Mesh*, Mesh>> loadedMeshes; // Filled by the asset workers
+  std::vector<PendingUpload> pendingUploads;
+  std::mutex loadedTexturesMutex;
+  std::vector<std::pair<Texture*, DecodedImage>> loadedTextures; // Filled by the asset workers
+  // Copies and mip blits of the textures uploaded since the last frame, recorded ahead of its passes
+  UploadBatch textureUploads;
+  // Materials each texture was bound to, rebound once it is resident
+  std::vector<std::pair<Texture*, Material*>> textureUsers;
+  Texture placeholderTexture;
+  // Acquire half of the ownership transfers of uploads finished since the last frame was recorded
+  std::vector<VkBufferMemoryBarrier> acquireBarriers;
+  // Timeline value of the latest upload made resident, every frame waits on it
+  uint64_t transferWaitValue = 0;
+  uint32_t uploadSubmissions = 0;
+
   VkDebugUtilsMessengerEXT debugMessenger; // Vulkan debug output handle
   
   const uint64_t timeout = 1000000000; // 1 second
 
+  FrameStats stats;
+  RenderQueue renderQueue;
+
+  // What set_benchmark_objects added last
+  std::vector<ObjectHandle> benchmarkHandles;
+
+  // CPU culling, the bounds of resident objects and which object each entry belongs to. Either way of culling
+  // leaves what it kept in visibleObjects.
+  BoundsTable cullBounds;
+  std::vector<uint32_t> cullObjects;
+  std::vector<uint32_t> visibleBounds;
+  std::vector<uint32_t> visibleObjects;
+  ThreadPool cullWorkers;
+
+  // CPU culling through the hierarchy over object slots. Built again whenever sceneLayoutVersion changes, refit
+  // for objects that only moved.
+  SceneBvh sceneBvh;
+  uint64_t bvhLayoutVersion = 0;
+  uint32_t bvhObjectsStreaming = 0;
+  uint32_t bvhObjectsRefit = 0; // Since it was built
+  bool cullComparisonPending = false;
+
+  GpuCuller culler;
+  DepthPyramid depthPyramid;
+  // Bumped whenever a mesh becomes resident or the objects change, the GPU scene is built again once it changed
+  uint64_t sceneVersion = 1;
+  // Bumped along with sceneVersion when objects are added or removed or their meshes become resident or fail,
+  // but not when they only move
+  uint64_t sceneLayoutVersion = 1;
+  uint64_t builtSceneVersion = 0;
+  std::vector<IndirectBatch> indirectBatches;
+  std::vector<GPUObjectData> gpuObjects;
+  std::vector<GPUDrawData> gpuDraws;
+  uint32_t gpuObjectsStreaming = 0;
+  uint32_t gpuDrawsDropped = 0;
+  BindCounts gpuUnsortedBinds;
+
+  // Running out of object or batch space is only logged the first time, FrameStats::drawsDropped has the rest
+  bool droppedDrawsReported = false;
+
   uint64_t frameNumber = 0;
   double t = 0;
 
@@ -0,0 +1,386 @@
+#include <pch.hpp>
+#include "vk_scene_bvh.hpp"
+
+namespace
+{
+  enum Overlap : uint32_t
+  {
+    Outside = 0,
+    Intersecting = 1,
+    Inside = 2,
+  };
+
+  Overlap classify_frustum(const Frustum& frustum, const Aabb& box)
+  {
+    const glm::vec3 center = box.center();
+    const glm::vec3 extent = box.max - center;
+
+    Overlap overlap = Inside;
+    for (const glm::vec4& plane : frustum.planes)
+    {
+      // Distance of the center and how far the box reaches towards the plane's normal
+      const float distance = glm::dot(glm::vec3{ plane }, center) + plane.w;
+      const float reach = glm::dot(glm::abs(glm::vec3{ plane }), extent);
+
+      if (distance < -reach)
+        return Outside;
+      if (distance < reach)
+        overlap = Intersecting;
+    }
+
+    return overlap;
+  }
+
+  Overlap classify_sphere(const glm::vec3& center, float radius, const Aabb& box)
+  {
+    // Closest point of the box decides whether they touch, the farthest corner whether the box is inside
+    const glm::vec3 closest = glm::clamp(center, box.min, box.max) - center;
+    if (glm::dot(closest, closest) > radius * radius)
+      return Outside;
+
+    const glm::vec3 farthest = glm::max(glm::abs(box.min - center), glm::abs(box.max - center));
+    return glm::dot(farthest, farthest) <= radius * radius ? Inside : Intersecting;
+  }
+
+  Overlap classify_aabb(const Aabb& query, const Aabb& box)
+  {
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      if (box.max[axis] < query.min[axis] || box.min[axis] > query.max[axis])
+        return Outside;
+    }
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+      if (box.min[axis] < query.min[axis] || box.max[axis] > query.max[axis])
+        return Intersecting;
+    }
+
+    return Inside;
+  }
+
+  // Distance along the ray where it enters the box, nothing if it misses it before maxDistance
+  std::optional<float> intersect_ray(const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance, const Aabb& box)
+  {
+    const glm::vec3 t1 = (box.min - origin) * inverseDirection;
+    const glm::vec3 t2 = (box.max - origin) * inverseDirection;
+    const glm::vec3 tNear = glm::min(t1, t2);
+    const glm::vec3 tFar = glm::max(t1, t2);
+
+    const float enter = std::max({ tNear.x, tNear.y, tNear.z, 0.f });
+    const float exit = std::min({ tFar.x, tFar.y, tFar.z, maxDistance });
+
+    if (enter > exit)
+      return std::nullopt;
+
+    return enter;
+  }
+}
+
+Aabb transform_aabb(const glm::mat4& transform, const glm::vec3& min, const glm::vec3& max)
+{
+  // The center moves with the transform, the extent grows by how much each axis leans into each other one
+  const glm::vec3 center{ transform * glm::vec4{ (min + max) * .5f, 1.f } };
+  const glm::vec3 extent = (max - min) * .5f;
+
+  const glm::vec3 worldExtent = glm::abs(glm::vec3{ transform[0] }) * extent.x + glm::abs(glm::vec3{ transform[1] }) * extent.y
+    + glm::abs(glm::vec3{ transform[2] }) * extent.z;
+
+  return Aabb{ .min = center - worldExtent, .max = center + worldExtent };
+}
+
+void SceneBvh::build(std::vector<BvhObject> buildObjects)
+{
+  clear();
+
+  objects = std::move(buildObjects);
+  if (objects.empty())
+    return;
+
+  // A balanced tree has about two nodes per leaf
+  nodes.reserve(objects.size() / MaxBvhLeafObjects * 2 + 1);
+  build_node(0, (uint32_t)objects.size(), 0);
+
+  uint32_t maxObject = 0;
+  for (const BvhObject& object : objects)
+    maxObject = std::max(maxObject, object.object);
+
+  objectSlots.assign(maxObject + 1, UINT32_MAX);
+  for (uint32_t slot = 0; slot < objects.size(); ++slot)
+    objectSlots[objects[slot].object] = slot;
+}
+
+void SceneBvh::clear()
+{
+  nodes.clear();
+  objects.clear();
+  objectSlots.clear();
+}
+
+uint32_t SceneBvh::build_node(uint32_t first, uint32_t count, uint32_t depth)
+{
+  const uint32_t nodeIndex = (uint32_t)nodes.size();
+
+  Aabb bounds, centroidBounds;
+  for (uint32_t i = first; i < first + count; ++i)
+  {
+    bounds.grow(objects[i].bounds);
+
+    const glm::vec3 centroid = objects[i].bounds.center();
+    centroidBounds.grow(Aabb{ .min = centroid, .max = centroid });
+  }
+
+  nodes.push_back(Node{ .bounds = bounds, .firstObject = first, .objectCount = count, .rightChild = 0 });
+
+  if (count == 1 || depth + 1 >= MaxBvhDepth)
+    return nodeIndex;
+
+  // Split along the axis the centroids spread the most over
+  const glm::vec3 centroidSize = centroidBounds.max - centroidBounds.min;
+  const int axis = centroidSize.x >= centroidSize.y && centroidSize.x >= centroidSize.z ? 0 : (centroidSize.y >= centroidSize.z ? 1 : 2);
+  const float axisMin = centroidBounds.min[axis];
+  const float axisSize = centroidSize[axis];
+
+  uint32_t leftCount = 0;
+
+  if (axisSize > 0.f)
+  {
+    const float binScale = BvhSahBins / axisSize;
+    auto bin_of = [&](const BvhObject& object) {
+      return std::min(BvhSahBins - 1, (uint32_t)((object.bounds.center()[axis] - axisMin) * binScale));
+    };
+
+    Aabb binBounds[BvhSahBins];
+    uint32_t binCounts[BvhSahBins]{};
+    for (uint32_t i = first; i < first + count; ++i)
+    {
+      const uint32_t bin = bin_of(objects[i]);
+      binBounds[bin].grow(objects[i].bounds);
+      ++binCounts[bin];
+    }
+
+    // Cost of every split between bins, the area of both sides weighted by how many objects they hold
+    float rightCosts[BvhSahBins]{};
+    Aabb right;
+    uint32_t rightCount = 0;
+    for (uint32_t bin = BvhSahBins - 1; bin > 0; --bin)
+    {
+      right.grow(binBounds[bin]);
+      rightCount += binCounts[bin];
+      rightCosts[bin] = rightCount > 0 ? right.half_area() * rightCount : 0.f;
+    }
+
+    float bestCost = std::numeric_limits<float>::max();
+    uint32_t bestSplit = 0;
+    Aabb left;
+    uint32_t leftSum = 0;
+    for (uint32_t split = 1; split < BvhSahBins; ++split)
+    {
+      left.grow(binBounds[split - 1]);
+      leftSum += binCounts[split - 1];
+
+      if (leftSum == 0 || leftSum == count)
+        continue;
+
+      const float cost = left.half_area() * leftSum + rightCosts[split];
+      if (cost < bestCost)
+      {
+        bestCost = cost;
+        bestSplit = split;
+      }
+    }
+
+    // A traversal step costs about as much as testing an object, small nodes stay leaves when splitting does
+    // not save more than that
+    const float leafCost = (float)count;
+    const float splitCost = 1.f + bestCost / std::max(bounds.half_area(), std::numeric_limits<float>::min());
+    if (count <= MaxBvhLeafObjects && (bestSplit == 0 || splitCost >= leafCost))
+      return nodeIndex;
+
+    if (bestSplit > 0)
+    {
+      const auto middle = std::partition(objects.begin() + first, objects.begin() + first + count,
+        [&](const BvhObject& object) { return bin_of(object) < bestSplit; });
+      leftCount = (uint32_t)(middle - (objects.begin() + first));
+    }
+  }
+  else if (count <= MaxBvhLeafObjects)
+  {
+    return nodeIndex;
+  }
+
+  // Every centroid in the same spot, halves by count so leaves stay small
+  if (leftCount == 0 || leftCount == count)
+    leftCount = count / 2;
+
+  // The left child is built right after its parent, nodes may reallocate so nothing refers into them meanwhile
+  build_node(first, leftCount, depth + 1);
+  const uint32_t rightChild = build_node(first + leftCount, count - leftCount, depth + 1);
+  nodes[nodeIndex].rightChild = rightChild;
+
+  return nodeIndex;
+}
+
+void SceneBvh::set_bounds(uint32_t object, const Aabb& bounds)
+{
+  if (object < objectSlots.size() && objectSlots[object] != UINT32_MAX)
+    objects[objectSlots[object]].bounds = bounds;
+}
+
+void SceneBvh::refit()
+{
+  // Children always come after their parent
+  for (size_t i = nodes.size(); i-- > 0;)
+  {
+    Node& node = nodes[i];
+    node.bounds = Aabb{};
+
+    if (node.rightChild == 0)
+    {
+      for (uint32_t o = node.firstObject; o < node.firstObject + node.objectCount; ++o)
+        node.bounds.grow(objects[o].bounds);
+    }
+    else
+    {
+      node.bounds.grow(nodes[i + 1].bounds);
+      node.bounds.grow(nodes[node.rightChild].bounds);
+    }
+  }
+}
+
+template<typename Test>
+void SceneBvh::query(const Test& test, std::vector<uint32_t>& out) const
+{
+  if (nodes.empty())
+    return;
+
+  uint32_t stack[MaxBvhDepth];
+  uint32_t stackSize = 0;
+  uint32_t nodeIndex = 0;
+
+  while (true)
+  {
+    const Node& node = nodes[nodeIndex];
+    const uint32_t overlap = test(node.bounds);
+
+    if (overlap == Inside)
+    {
+      // Nothing below can be outside, the subtree's objects are one run
+      for (uint32_t o = node.firstObject; o < node.firstObject + node.objectCount; ++o)
+        out.push_back(objects[o].object);
+    }
+    else if (overlap == Intersecting)
+    {
+      if (node.rightChild != 0)
+      {
+        stack[stackSize++] = node.rightChild;
+        nodeIndex = nodeIndex + 1;
+        continue;
+      }
+
+      for (uint32_t o = node.firstObject; o < node.firstObject + node.objectCount; ++o)
+      {
+        if (test(objects[o].bounds) != Outside)
+          out.push_back(objects[o].object);
+      }
+    }
+
+    if (stackSize == 0)
+      return;
+
+    nodeIndex = stack[--stackSize];
+  }
+}
+
+void SceneBvh::query_frustum(const Frustum& frustum, std::vector<uint32_t>& out) const
+{
+  query([&](const Aabb& box) { return classify_frustum(frustum, box); }, out);
+}
+
+void SceneBvh::query_frustum_brute_force(const Frustum& frustum, std::vector<uint32_t>& out) const
+{
+  for (const BvhObject& object : objects)
+  {
+    if (classify_frustum(frustum, object.bounds) != Outside)
+      out.push_back(object.object);
+  }
+}
+
+void SceneBvh::query_sphere(const glm::vec3& center, float radius, std::vector<uint32_t>& out) const
+{
+  query([&](const Aabb& box) { return classify_sphere(center, radius, box); }, out);
+}
+
+void SceneBvh::query_aabb(const Aabb& box, std::vector<uint32_t>& out) const
+{
+  query([&](const Aabb& nodeBox) { return classify_aabb(box, nodeBox); }, out);
+}
+
+std::optional<BvhHit> SceneBvh::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance) const
+{
+  const glm::vec3 inverseDirection = 1.f / direction;
+
+  if (nodes.empty() || !intersect_ray(origin, inverseDirection, maxDistance, nodes[0].bounds))
+    return std::nullopt;
+
+  std::optional<BvhHit> hit;
+  float nearest = maxDistance;
+
+  uint32_t stack[MaxBvhDepth];
+  uint32_t stackSize = 0;
+  uint32_t nodeIndex = 0;
+
+  while (true)
+  {
+    const Node& node = nodes[nodeIndex];
+
+    if (node.rightChild == 0)
+    {
+      for (uint32_t o = node.firstObject; o < node.firstObject + node.objectCount; ++o)
+      {
+        if (const std::optional<float> distance = intersect_ray(origin, inverseDirection, nearest, objects[o].bounds))
+        {
+          nearest = *distance;
+          hit = BvhHit{ .object = objects[o].object, .distance = *distance };
+        }
+      }
+    }
+    else
+    {
+      // The nearer child goes first, so the hits it finds can rule out the farther one
+      uint32_t nearChild = nodeIndex + 1, farChild = node.rightChild;
+      std::optional<float> nearDistance = intersect_ray(origin, inverseDirection, nearest, nodes[nearChild].bounds);
+      std::optional<float> farDistance = intersect_ray(origin, inverseDirection, nearest, nodes[farChild].bounds);
+
+      if (farDistance && (!nearDistance || *farDistance < *nearDistance))
+      {
+        std::swap(nearChild, farChild);
+        std::swap(nearDistance, farDistance);
+      }
+
+      if (nearDistance)
+      {
+        if (farDistance)
+          stack[stackSize++] = farChild;
+
+        nodeIndex = nearChild;
+        continue;
+      }
+    }
+
+    // Entries pushed before a closer hit was found may be past it now, they are tested again when popped
+    bool found = false;
+    while (stackSize > 0)
+    {
+      nodeIndex = stack[--stackSize];
+      if (intersect_ray(origin, inverseDirection, nearest, nodes[nodeIndex].bounds))
+      {
+        found = true;
+        break;
+      }
+    }
+
+    if (!found)
+      return hit;
+  }
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "core/renderer/vk_frustum.hpp"
+
+// Leaves hold at most this many objects, SAH may stop splitting earlier
+constexpr uint32_t MaxBvhLeafObjects = 4;
+
+// Bins the SAH build sorts centroids into along the split axis
+constexpr uint32_t BvhSahBins = 16;
+
+// Deeper nodes become leaves whatever they hold, so queries can walk the tree with a fixed size stack
+constexpr uint32_t MaxBvhDepth = 64;
+
+struct Aabb
+{
+  glm::vec3 min{ std::numeric_limits<float>::max() };
+  glm::vec3 max{ -std::numeric_limits<float>::max() };
+
+  void grow(const Aabb& other)
+  {
+    min = glm::min(min, other.min);
+    max = glm::max(max, other.max);
+  }
+
+  [[nodiscard]]
+  glm::vec3 center() const { return (min + max) * .5f; }
+
+  // Half the surface area, all SAH needs is the ratio between boxes
+  [[nodiscard]]
+  float half_area() const
+  {
+    const glm::vec3 size = max - min;
+    return size.x * size.y + size.y * size.z + size.z * size.x;
+  }
+};
+
+// World space box of an object space one under transform
+[[nodiscard]]
+Aabb transform_aabb(const glm::mat4& transform, const glm::vec3& min, const glm::vec3& max);
+
+struct BvhObject
+{
+  Aabb bounds;
+  uint32_t object; // What queries report for it, the renderer uses the object's SceneStore slot
+};
+
+struct BvhHit
+{
+  uint32_t object;
+  float distance; // Along the ray to where it enters the object's box
+};
+
+// Bounding volume hierarchy over the scene's objects, built top down with a binned surface area heuristic.
+// Objects that move get their bounds replaced and the tree refit, which keeps its shape but not its quality,
+// so it should be built again once many of them moved far.
+// Nodes are stored depth first, the left child follows its parent, and every subtree covers a contiguous run of
+// objects. Queries append matching objects and report whole subtrees without testing them once their node is
+// fully inside the query volume.
+class SceneBvh
+{
+public:
+  void build(std::vector<BvhObject> objects);
+
+  void clear();
+
+  // Takes effect on the next refit
+  void set_bounds(uint32_t object, const Aabb& bounds);
+
+  // Recomputes every node's box from its children, bottom up
+  void refit();
+
+  void query_frustum(const Frustum& frustum, std::vector<uint32_t>& out) const;
+  // query_frustum without the tree, every object's box is tested in turn. The reference the tree's results and
+  // timings are checked against.
+  void query_frustum_brute_force(const Frustum& frustum, std::vector<uint32_t>& out) const;
+  void query_sphere(const glm::vec3& center, float radius, std::vector<uint32_t>& out) const;
+  void query_aabb(const Aabb& box, std::vector<uint32_t>& out) const;
+
+  // Nearest object box the ray enters within maxDistance, a ray starting inside a box hits it at 0.
+  // direction does not need to be normalized, distances are in its units.
+  [[nodiscard]]
+  std::optional<BvhHit> raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance = std::numeric_limits<float>::max()) const;
+
+  [[nodiscard]]
+  uint32_t get_object_count() const { return (uint32_t)objects.size(); }
+
+  [[nodiscard]]
+  uint32_t get_node_count() const { return (uint32_t)nodes.size(); }
+
+private:
+  struct Node
+  {
+    Aabb bounds;
+    uint32_t firstObject; // First of the subtree's objects
+    uint32_t objectCount;
+    uint32_t rightChild;  // 0 for leaves
+  };
+
+  // Partitions objects[first, first + count) and appends the subtree's nodes, returns its root
+  uint32_t build_node(uint32_t first, uint32_t count, uint32_t depth);
+
+  // Walks the tree with test classifying a box as outside (0), intersecting (1) or inside (2) the query
+  template<typename Test>
+  void query(const Test& test, std::vector<uint32_t>& out) const;
+
+  std::vector<Node> nodes;
+  std::vector<BvhObject> objects;     // In subtree order
+  std::vector<uint32_t> objectSlots;  // Where each object ended up in objects, UINT32_MAX for absent ones
+};
@@ -0,0 +1,186 @@
+#include <pch.hpp>
+#include "vk_scene_store.hpp"
+
+MeshId SceneStore::register_mesh(Mesh* mesh)
+{
+  auto [iter, inserted] = meshLookup.insert({ mesh, (MeshId)meshTable.size() });
+  if (inserted)
+    meshTable.push_back(mesh);
+  return iter->second;
+}
+
+MaterialId SceneStore::register_material(Material* mat)
+{
+  auto [iter, inserted] = materialLookup.insert({ mat, (MaterialId)materialTable.size() });
+  if (inserted)
+    materialTable.push_back(mat);
+  return iter->second;
+}
+
+ObjectHandle SceneStore::add(MeshId mesh, MaterialId mat, const glm::mat4& transform, uint32_t objectFlags)
+{
+  uint32_t slot;
+  if (!freeSlots.empty())
+  {
+    slot = freeSlots.back();
+    freeSlots.pop_back();
+  }
+  else
+  {
+    slot = (uint32_t)generations.size();
+    generations.push_back(1);
+    slotIndices.push_back(0);
+  }
+
+  const uint32_t index = size();
+  slotIndices[slot] = index;
+
+  transforms.push_back(transform);
+  meshIds.push_back(mesh);
+  materialIds.push_back(mat);
+  bounds.emplace_back(0.f);
+  flags.push_back(objectFlags & ~(ObjectResident | ObjectFailed | ObjectMoved));
+  submeshMaterials.emplace_back();
+  denseSlots.push_back(slot);
+
+  update_bounds(index);
+
+  return ObjectHandle{ .slot = slot, .generation = generations[slot] };
+}
+
+bool SceneStore::remove(ObjectHandle handle)
+{
+  const uint32_t index = index_of(handle);
+  if (index == UINT32_MAX)
+    return false;
+
+  // The last object fills the hole so the arrays stay dense
+  const uint32_t last = size() - 1;
+  if (index != last)
+  {
+    transforms[index] = transforms[last];
+    meshIds[index] = meshIds[last];
+    materialIds[index] = materialIds[last];
+    bounds[index] = bounds[last];
+    flags[index] = flags[last];
+    submeshMaterials[index] = std::move(submeshMaterials[last]);
+    denseSlots[index] = denseSlots[last];
+    slotIndices[denseSlots[index]] = index;
+  }
+
+  transforms.pop_back();
+  meshIds.pop_back();
+  materialIds.pop_back();
+  bounds.pop_back();
+  flags.pop_back();
+  submeshMaterials.pop_back();
+  denseSlots.pop_back();
+
+  ++generations[handle.slot];
+  freeSlots.push_back(handle.slot);
+
+  return true;
+}
+
+void SceneStore::clear()
+{
+  // Every live handle goes stale, the slots stay around to keep their generations
+  for (const uint32_t slot : denseSlots)
+  {
+    ++generations[slot];
+    freeSlots.push_back(slot);
+  }
+
+  transforms.clear();
+  meshIds.clear();
+  materialIds.clear();
+  bounds.clear();
+  flags.clear();
+  submeshMaterials.clear();
+  denseSlots.clear();
+  movedSlots.clear();
+}
+
+uint32_t SceneStore::index_of(ObjectHandle handle) const
+{
+  if (handle.slot >= generations.size() || generations[handle.slot] != handle.generation)
+    return UINT32_MAX;
+  return slotIndices[handle.slot];
+}
+
+uint32_t SceneStore::index_of_slot(uint32_t slot) const
+{
+  if (slot >= slotIndices.size())
+    return UINT32_MAX;
+
+  // Free slots keep the index their last object had, which another object may hold by now
+  const uint32_t index = slotIndices[slot];
+  return index < size() && denseSlots[index] == slot ? index : UINT32_MAX;
+}
+
+void SceneStore::set_transform(ObjectHandle handle, const glm::mat4& transform)
+{
+  if (const uint32_t index = index_of(handle); index != UINT32_MAX)
+  {
+    transforms[index] = transform;
+    update_bounds(index);
+
+    if (!(flags[index] & ObjectMoved))
+    {
+      flags[index] |= ObjectMoved;
+      movedSlots.push_back(handle.slot);
+    }
+  }
+}
+
+void SceneStore::set_hidden(ObjectHandle handle, bool hidden)
+{
+  if (const uint32_t index = index_of(handle); index != UINT32_MAX)
+    flags[index] = hidden ? flags[index] | ObjectHidden : flags[index] & ~ObjectHidden;
+}
+
+void SceneStore::set_submesh_materials(ObjectHandle handle, std::vector<MaterialId> mats)
+{
+  if (const uint32_t index = index_of(handle); index != UINT32_MAX)
+    submeshMaterials[index] = std::move(mats);
+}
+
+void SceneStore::clear_moved()
+{
+  for (const uint32_t slot : movedSlots)
+  {
+    if (const uint32_t index = index_of_slot(slot); index != UINT32_MAX)
+      flags[index] &= ~ObjectMoved;
+  }
+  movedSlots.clear();
+}
+
+void SceneStore::refresh_bounds()
+{
+  for (uint32_t index = 0; index < size(); ++index)
+    update_bounds(index);
+}
+
+Material* SceneStore::get_submesh_material(uint32_t index, uint32_t materialSlot) const
+{
+  const std::vector<MaterialId>& mats = submeshMaterials[index];
+  if (materialSlot >= mats.size() || mats[materialSlot] == InvalidMaterialId)
+    return materialTable[materialIds[index]];
+  return materialTable[mats[materialSlot]];
+}
+
+void SceneStore::update_bounds(uint32_t index)
+{
+  const Mesh* mesh = meshTable[meshIds[index]];
+  if (!mesh->resident)
+  {
+    flags[index] = mesh->failed ? (flags[index] & ~ObjectResident) | ObjectFailed : flags[index] & ~(ObjectResident | ObjectFailed);
+    return;
+  }
+
+  const glm::mat4& transform = transforms[index];
+  const float scale = std::max({ glm::length(glm::vec3{ transform[0] }), glm::length(glm::vec3{ transform[1] }), glm::length(glm::vec3{ transform[2] }) });
+
+  bounds[index] = glm::vec4{ glm::vec3{ transform * glm::vec4{ mesh->bounds.origin, 1.f } }, mesh->bounds.radius * scale };
+  flags[index] = (flags[index] & ~ObjectFailed) | ObjectResident;
+}
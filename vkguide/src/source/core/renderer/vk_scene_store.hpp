@@ -0,0 +1,132 @@
+#pragma once
+
+#include "core/renderer/vk_mesh.hpp"
+
+struct Material;
+
+using MeshId = uint32_t;
+using MaterialId = uint32_t;
+
+// Per slot material that leaves the slot to the object's material
+constexpr MaterialId InvalidMaterialId = UINT32_MAX;
+
+// Set by refresh_bounds once the object's mesh is resident, its bounds are meaningless before
+constexpr uint32_t ObjectResident = 1u << 0;
+// Skipped by every pass without being removed
+constexpr uint32_t ObjectHidden = 1u << 1;
+// Set by refresh_bounds when the object's mesh failed to load, skipped like hidden objects rather than counted as streaming
+constexpr uint32_t ObjectFailed = 1u << 2;
+// Set by set_transform until clear_moved, keeps every object in the moved list once
+constexpr uint32_t ObjectMoved = 1u << 3;
+
+// Stays valid until its object is removed. Slots are reused with their generation bumped, so a stale handle
+// is told apart from the object that took its slot.
+struct ObjectHandle
+{
+  uint32_t slot = UINT32_MAX;
+  uint32_t generation = 0;
+
+  bool operator==(const ObjectHandle&) const = default;
+};
+
+// The scene's objects as dense arrays, one per field, so passes over them stream through memory and only load
+// the fields they read. Removing swaps the last object into the hole, dense indices are only stable until the
+// next removal, handles for as long as their object lives.
+// Meshes and materials are referred to by ids into tables the store keeps, their pointers have to stay valid.
+class SceneStore
+{
+public:
+  [[nodiscard]]
+  MeshId register_mesh(Mesh* mesh);
+
+  [[nodiscard]]
+  MaterialId register_material(Material* mat);
+
+  ObjectHandle add(MeshId mesh, MaterialId mat, const glm::mat4& transform, uint32_t objectFlags = 0);
+
+  // Returns false for stale handles
+  bool remove(ObjectHandle handle);
+
+  void clear();
+
+  // Dense index of the object, UINT32_MAX for stale handles
+  [[nodiscard]]
+  uint32_t index_of(ObjectHandle handle) const;
+
+  // Dense index of the object in the slot, UINT32_MAX for free slots
+  [[nodiscard]]
+  uint32_t index_of_slot(uint32_t slot) const;
+
+  [[nodiscard]]
+  ObjectHandle handle_at(uint32_t index) const { return ObjectHandle{ .slot = denseSlots[index], .generation = generations[denseSlots[index]] }; }
+
+  // Also records the object's slot in the moved list
+  void set_transform(ObjectHandle handle, const glm::mat4& transform);
+
+  void set_hidden(ObjectHandle handle, bool hidden);
+
+  // Material per Mesh::materialNames slot, slots past the end or set to InvalidMaterialId draw with the object's material
+  void set_submesh_materials(ObjectHandle handle, std::vector<MaterialId> mats);
+
+  // Recomputes every object's world bounds, ObjectResident and ObjectFailed, for when meshes became resident or failed
+  void refresh_bounds();
+
+  // Slots of the objects set_transform moved since the last clear_moved, each once. Slots freed since may be in it.
+  [[nodiscard]]
+  const std::vector<uint32_t>& get_moved_slots() const { return movedSlots; }
+
+  void clear_moved();
+
+  // Material the submesh draws with
+  [[nodiscard]]
+  Material* get_submesh_material(uint32_t index, uint32_t materialSlot) const;
+
+  [[nodiscard]]
+  uint32_t size() const { return (uint32_t)transforms.size(); }
+
+  [[nodiscard]]
+  Mesh* get_mesh(MeshId id) const { return meshTable[id]; }
+
+  [[nodiscard]]
+  Material* get_material(MaterialId id) const { return materialTable[id]; }
+
+  [[nodiscard]]
+  const std::vector<glm::mat4>& get_transforms() const { return transforms; }
+
+  [[nodiscard]]
+  const std::vector<MeshId>& get_mesh_ids() const { return meshIds; }
+
+  [[nodiscard]]
+  const std::vector<MaterialId>& get_material_ids() const { return materialIds; }
+
+  // World space spheres, xyz center and w radius
+  [[nodiscard]]
+  const std::vector<glm::vec4>& get_bounds() const { return bounds; }
+
+  [[nodiscard]]
+  const std::vector<uint32_t>& get_flags() const { return flags; }
+
+private:
+  void update_bounds(uint32_t index);
+
+  std::vector<Mesh*> meshTable;
+  std::vector<Material*> materialTable;
+  std::unordered_map<const Mesh*, MeshId> meshLookup;
+  std::unordered_map<const Material*, MaterialId> materialLookup;
+
+  // Dense, indexed by object
+  std::vector<glm::mat4> transforms;
+  std::vector<MeshId> meshIds;
+  std::vector<MaterialId> materialIds;
+  std::vector<glm::vec4> bounds;
+  std::vector<uint32_t> flags;
+  std::vector<std::vector<MaterialId>> submeshMaterials; // Cold, only read when building draws
+  std::vector<uint32_t> denseSlots;                       // The slot each object's handle refers to
+
+  // Indexed by slot
+  std::vector<uint32_t> generations;
+  std::vector<uint32_t> slotIndices; // Dense index of the slot's object
+  std::vector<uint32_t> freeSlots;
+
+  std::vector<uint32_t> movedSlots;
+};
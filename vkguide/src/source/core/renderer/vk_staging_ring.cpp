@@ -0,0 +1,205 @@
+#include <pch.hpp>
+#include "vk_staging_ring.hpp"
+
+void StagingRing::init(VkDevice device, VmaAllocator allocator, VkDeviceSize capacity)
+{
+  this->device = device;
+  this->allocator = allocator;
+  this->capacity = capacity;
+
+  VkBufferCreateInfo bufferInfo{
+    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+    .pNext = nullptr,
+
+    .size = capacity,
+    .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+  };
+
+  VmaAllocationCreateInfo allocInfo{
+    .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+    .usage = VMA_MEMORY_USAGE_AUTO,
+  };
+
+  VmaAllocationInfo allocation;
+  VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &buffer.buffer, &buffer.alloc, &allocation));
+
+  mapped = (uint8_t*)allocation.pMappedData;
+}
+
+StagingRegion StagingRing::allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+  allocatedBytes += size;
+
+  if (size <= capacity)
+  {
+    retire();
+
+    for (;;)
+    {
+      VkDeviceSize offset;
+      if (try_allocate(size, alignment, offset))
+        return StagingRegion{ .buffer = buffer.buffer, .offset = offset, .data = mapped + offset };
+
+      // The open batch fills the ring by itself, nothing to wait for
+      if (inFlight.empty())
+        break;
+
+      wait(inFlight.front().id);
+    }
+  }
+
+  VkBufferCreateInfo bufferInfo{
+    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+    .pNext = nullptr,
+
+    .size = size,
+    .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+  };
+
+  VmaAllocationCreateInfo allocInfo{
+    .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+    .usage = VMA_MEMORY_USAGE_AUTO,
+  };
+
+  AllocatedBuffer oversize;
+  VmaAllocationInfo allocation;
+  VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &oversize.buffer, &oversize.alloc, &allocation));
+
+  open.oversize.push_back(oversize);
+  ++oversizeCount;
+
+  std::cout << fmt::format("Staging {:.1f} MB outside of the {:.1f} MB staging ring\n", size / (1024.0 * 1024.0), capacity / (1024.0 * 1024.0));
+
+  return StagingRegion{ .buffer = oversize.buffer, .offset = 0, .data = (uint8_t*)allocation.pMappedData };
+}
+
+bool StagingRing::try_allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& outOffset)
+{
+  if (used == 0)
+    head = tail = 0;
+
+  const VkDeviceSize aligned = (head + alignment - 1) / alignment * alignment;
+  VkDeviceSize offset;
+
+  // Free space is [head, capacity) and [0, tail) while the bytes in use do not wrap, [head, tail) once they do
+  if (used == 0 || head > tail)
+  {
+    if (aligned + size <= capacity)
+      offset = aligned;
+    else if (size <= tail)
+      offset = 0;
+    else
+      return false;
+  }
+  else if (aligned + size <= tail)
+    offset = aligned;
+  else
+    return false;
+
+  // Wrapping skips what is left at the end, which stays with this batch until it retires
+  const VkDeviceSize consumed = offset >= head ? offset + size - head : capacity - head + size;
+
+  head = offset + size;
+  used += consumed;
+
+  open.bytes += consumed;
+  open.end = head;
+
+  outOffset = offset;
+  return true;
+}
+
+VkFence StagingRing::submit(uint64_t* outBatch)
+{
+  // No-ops on host coherent memory
+  vmaFlushAllocation(allocator, buffer.alloc, 0, VK_WHOLE_SIZE);
+  for (const AllocatedBuffer& oversize : open.oversize)
+    vmaFlushAllocation(allocator, oversize.alloc, 0, VK_WHOLE_SIZE);
+
+  if (freeFences.empty())
+  {
+    VkFenceCreateInfo fenceInfo{
+      .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+      .pNext = nullptr,
+
+      .flags = 0
+    };
+
+    VkFence fence;
+    VK_CHECK(vkCreateFence(device, &fenceInfo, nullptr, &fence));
+    freeFences.push_back(fence);
+  }
+
+  open.fence = freeFences.back();
+  freeFences.pop_back();
+  open.id = nextBatch++;
+
+  if (outBatch)
+    *outBatch = open.id;
+
+  VkFence fence = open.fence;
+
+  inFlight.push_back(std::move(open));
+  open = Batch{ .end = head };
+
+  return fence;
+}
+
+void StagingRing::retire()
+{
+  while (!inFlight.empty() && vkGetFenceStatus(device, inFlight.front().fence) == VK_SUCCESS)
+  {
+    release(inFlight.front());
+    inFlight.pop_front();
+  }
+}
+
+void StagingRing::wait(uint64_t batch)
+{
+  for (const Batch& pending : inFlight)
+  {
+    if (pending.id > batch)
+      break;
+
+    vkWaitForFences(device, 1, &pending.fence, VK_TRUE, UINT64_MAX);
+  }
+
+  retire();
+}
+
+void StagingRing::release(Batch& batch)
+{
+  // Batches without regions never moved the head, their end may be from before the ring last emptied
+  if (batch.bytes > 0)
+    tail = batch.end;
+  used -= batch.bytes;
+
+  for (const AllocatedBuffer& oversize : batch.oversize)
+    vmaDestroyBuffer(allocator, oversize.buffer, oversize.alloc);
+
+  VK_CHECK(vkResetFences(device, 1, &batch.fence));
+  freeFences.push_back(batch.fence);
+
+  completedBatch = batch.id;
+}
+
+void StagingRing::cleanup()
+{
+  for (Batch& pending : inFlight)
+  {
+    vkWaitForFences(device, 1, &pending.fence, VK_TRUE, UINT64_MAX);
+    release(pending);
+  }
+  inFlight.clear();
+
+  // Never submitted, so nothing reads these
+  for (const AllocatedBuffer& oversize : open.oversize)
+    vmaDestroyBuffer(allocator, oversize.buffer, oversize.alloc);
+  open = Batch{};
+
+  for (VkFence fence : freeFences)
+    vkDestroyFence(device, fence, nullptr);
+  freeFences.clear();
+
+  vmaDestroyBuffer(allocator, buffer.buffer, buffer.alloc);
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "core/renderer/vk_types.hpp"
+
+// Mapped slice of staging memory, data points at offset in buffer
+struct StagingRegion
+{
+  VkBuffer buffer = VK_NULL_HANDLE;
+  VkDeviceSize offset = 0;
+  uint8_t* data = nullptr;
+};
+
+// Persistently mapped staging buffer every upload writes its source data into. Regions are handed out front
+// to back and wrap around at the end, the regions allocated between two submit calls form a batch whose
+// space comes back once the fence returned by submit has signaled. Uploads that do not fit the ring at all
+// get a temporary buffer of their own, released along with their batch.
+// Not thread safe, it belongs to the thread recording the uploads.
+class StagingRing
+{
+public:
+  void init(VkDevice device, VmaAllocator allocator, VkDeviceSize capacity);
+
+  // Waits for older batches to finish when the ring is full
+  [[nodiscard]]
+  StagingRegion allocate(VkDeviceSize size, VkDeviceSize alignment);
+
+  // Closes the current batch. The returned fence has to be signaled by the submission reading its regions,
+  // outBatch identifies the batch for is_complete and wait.
+  [[nodiscard]]
+  VkFence submit(uint64_t* outBatch = nullptr);
+
+  // Reclaims the space of every batch the GPU is done with
+  void retire();
+
+  // Blocks until batch and every batch before it are done
+  void wait(uint64_t batch);
+
+  [[nodiscard]]
+  bool is_complete(uint64_t batch) const { return batch <= completedBatch; }
+
+  [[nodiscard]]
+  VkDeviceSize get_capacity() const { return capacity; }
+
+  [[nodiscard]]
+  uint32_t get_oversize_count() const { return oversizeCount; }
+
+  // Bytes handed out since init, oversize uploads included
+  [[nodiscard]]
+  uint64_t get_allocated_bytes() const { return allocatedBytes; }
+
+  void cleanup();
+
+private:
+  struct Batch
+  {
+    uint64_t id = 0;
+    VkFence fence = VK_NULL_HANDLE;
+    VkDeviceSize end = 0;   // Ring head after the batch's last region
+    VkDeviceSize bytes = 0; // Ring bytes the batch holds, alignment padding and space skipped at the wrap included
+    std::vector<AllocatedBuffer> oversize;
+  };
+
+  bool try_allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& outOffset);
+  void release(Batch& batch);
+
+  VkDevice device;
+  VmaAllocator allocator;
+
+  AllocatedBuffer buffer;
+  uint8_t* mapped = nullptr;
+  VkDeviceSize capacity = 0;
+
+  VkDeviceSize head = 0; // Next byte to hand out
+  VkDeviceSize tail = 0; // Oldest byte still in use
+  VkDeviceSize used = 0;
+
+  Batch open; // Regions allocated since the last submit
+  std::deque<Batch> inFlight;
+  std::vector<VkFence> freeFences;
+
+  uint64_t nextBatch = 1;
+  uint64_t completedBatch = 0;
+  uint32_t oversizeCount = 0;
+  uint64_t allocatedBytes = 0;
+};
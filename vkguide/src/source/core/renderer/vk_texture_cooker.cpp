@@ -0,0 +1,449 @@
+#include <pch.hpp>
+#include "vk_texture_cooker.hpp"
+
+#include "core/renderer/vk_ktx2.hpp"
+#include "core/threading/thread_pool.hpp"
+
+namespace
+{
+  constexpr int Bc7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+  // Mode 6 endpoint, 7 bits per channel plus the p-bit shared by its channels
+  struct Bc7Endpoint
+  {
+    uint8_t channels[4];
+    uint8_t pbit;
+
+    int value(int channel) const { return (channels[channel] << 1) | pbit; }
+  };
+
+  Bc7Endpoint quantize_endpoint(const float* color, uint8_t pbit)
+  {
+    Bc7Endpoint endpoint{ .pbit = pbit };
+    for (int c = 0; c < 4; ++c)
+      endpoint.channels[c] = (uint8_t)std::clamp((int)std::lround((color[c] - pbit) * .5f), 0, 127);
+    return endpoint;
+  }
+
+  // Picks the closest palette entry per texel, returns the summed squared error
+  uint32_t assign_indices(const uint8_t* texels, const Bc7Endpoint& e0, const Bc7Endpoint& e1, uint8_t* outIndices)
+  {
+    int palette[16][4];
+    for (int i = 0; i < 16; ++i)
+    {
+      for (int c = 0; c < 4; ++c)
+        palette[i][c] = ((64 - Bc7Weights[i]) * e0.value(c) + Bc7Weights[i] * e1.value(c) + 32) >> 6;
+    }
+
+    uint32_t totalError = 0;
+    for (int t = 0; t < 16; ++t)
+    {
+      const uint8_t* texel = texels + 4 * t;
+
+      uint32_t bestError = UINT32_MAX;
+      for (int i = 0; i < 16; ++i)
+      {
+        uint32_t error = 0;
+        for (int c = 0; c < 4; ++c)
+        {
+          const int d = palette[i][c] - texel[c];
+          error += d * d;
+        }
+
+        if (error < bestError)
+        {
+          bestError = error;
+          outIndices[t] = (uint8_t)i;
+        }
+      }
+
+      totalError += bestError;
+    }
+
+    return totalError;
+  }
+
+  // Tries every p-bit combination for a pair of unquantized endpoints, keeps the best one if it beats bestError
+  void try_endpoints(const uint8_t* texels, const float* lo, const float* hi, Bc7Endpoint& e0, Bc7Endpoint& e1, uint8_t* indices, uint32_t& bestError)
+  {
+    for (uint8_t p0 = 0; p0 < 2; ++p0)
+    {
+      for (uint8_t p1 = 0; p1 < 2; ++p1)
+      {
+        Bc7Endpoint q0 = quantize_endpoint(lo, p0);
+        Bc7Endpoint q1 = quantize_endpoint(hi, p1);
+
+        uint8_t candidate[16];
+        const uint32_t error = assign_indices(texels, q0, q1, candidate);
+        if (error < bestError)
+        {
+          bestError = error;
+          e0 = q0;
+          e1 = q1;
+          memcpy(indices, candidate, sizeof candidate);
+        }
+      }
+    }
+  }
+
+  struct BitWriter
+  {
+    uint8_t* out;
+    uint32_t bit = 0;
+
+    void write(uint32_t value, uint32_t count)
+    {
+      for (uint32_t i = 0; i < count; ++i, ++bit)
+        out[bit >> 3] |= (uint8_t)(((value >> i) & 1) << (bit & 7));
+    }
+  };
+
+  // Gathers the 4x4 block at (blockX, blockY), texels past the level's edge repeat the last row / column
+  void fetch_block(const uint8_t* level, int width, int height, int blockX, int blockY, uint8_t* outTexels)
+  {
+    for (int y = 0; y < 4; ++y)
+    {
+      const int sy = std::min(blockY * 4 + y, height - 1);
+      for (int x = 0; x < 4; ++x)
+      {
+        const int sx = std::min(blockX * 4 + x, width - 1);
+        memcpy(outTexels + 4 * (y * 4 + x), level + 4 * ((size_t)sy * width + sx), 4);
+      }
+    }
+  }
+
+  uint32_t codec_block_bytes(TextureCodec codec)
+  {
+    return codec == TextureCodec::BC1 ? 8 : 16;
+  }
+
+  std::vector<uint8_t> encode_level(const uint8_t* level, int width, int height, TextureCodec codec, ThreadPool* workers)
+  {
+    const int blocksX = (width + 3) / 4;
+    const int blocksY = (height + 3) / 4;
+    const uint32_t blockBytes = codec_block_bytes(codec);
+
+    std::vector<uint8_t> blocks((size_t)blocksX * blocksY * blockBytes);
+
+    auto encode_row = [&](uint32_t by) {
+      uint8_t texels[64];
+      for (int bx = 0; bx < blocksX; ++bx)
+      {
+        fetch_block(level, width, height, bx, (int)by, texels);
+
+        uint8_t* out = blocks.data() + ((size_t)by * blocksX + bx) * blockBytes;
+        switch (codec)
+        {
+        case TextureCodec::BC1:
+          stb_compress_dxt_block(out, texels, 0, STB_DXT_HIGHQUAL);
+          break;
+        case TextureCodec::BC3:
+          stb_compress_dxt_block(out, texels, 1, STB_DXT_HIGHQUAL);
+          break;
+        case TextureCodec::BC7:
+          encode_bc7_block(texels, out);
+          break;
+        }
+      }
+    };
+
+    // Block rows are shared out over the workers, the big levels are where nearly all the time goes
+    if (workers)
+      workers->parallel_for((uint32_t)blocksY, encode_row);
+    else
+    {
+      for (uint32_t by = 0; by < (uint32_t)blocksY; ++by)
+        encode_row(by);
+    }
+
+    return blocks;
+  }
+
+  int64_t write_time(const std::filesystem::path& filePath, std::error_code& ec)
+  {
+    return std::filesystem::last_write_time(filePath, ec).time_since_epoch().count();
+  }
+}
+
+VkFormat texture_codec_format(TextureCodec codec)
+{
+  switch (codec)
+  {
+  case TextureCodec::BC1: return VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+  case TextureCodec::BC3: return VK_FORMAT_BC3_SRGB_BLOCK;
+  case TextureCodec::BC7: return VK_FORMAT_BC7_SRGB_BLOCK;
+  }
+  return VK_FORMAT_UNDEFINED;
+}
+
+const char* texture_codec_name(TextureCodec codec)
+{
+  switch (codec)
+  {
+  case TextureCodec::BC1: return "bc1";
+  case TextureCodec::BC3: return "bc3";
+  case TextureCodec::BC7: return "bc7";
+  }
+  return "unknown";
+}
+
+std::filesystem::path cooked_texture_path(const std::string& sourcePath, TextureCodec codec)
+{
+  std::filesystem::path fileName = std::filesystem::path(sourcePath).filename();
+  fileName += fmt::format(".{}.ktx2", texture_codec_name(codec));
+
+  return std::filesystem::current_path() / "cache" / fileName;
+}
+
+bool cooked_texture_is_current(const std::string& sourcePath, TextureCodec codec)
+{
+  std::error_code ec;
+  const int64_t cookedTime = write_time(cooked_texture_path(sourcePath, codec), ec);
+  if (ec)
+    return false;
+
+  const std::filesystem::path source{ sourcePath };
+  if (!std::filesystem::exists(source, ec))
+    return true;
+
+  const int64_t sourceTime = write_time(source, ec);
+  return !ec && cookedTime >= sourceTime;
+}
+
+bool cook_texture(const std::string& sourcePath, TextureCodec codec, ThreadPool* workers)
+{
+  std::cout << fmt::format("Cooking texture: {} ({})\n", sourcePath, texture_codec_name(codec));
+  const auto t1 = std::chrono::high_resolution_clock::now();
+
+  int width, height, channels;
+
+  stbi_uc* pixels = stbi_load(sourcePath.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+
+  if (!pixels)
+  {
+    std::cout << fmt::format("Failed to load texture file: {}\n", sourcePath);
+    return false;
+  }
+
+  Ktx2Texture texture{
+    .format = texture_codec_format(codec),
+    .width = (uint32_t)width,
+    .height = (uint32_t)height,
+  };
+
+  const uint32_t mipLevels = mip_level_count(width, height);
+  texture.levels.reserve(mipLevels);
+
+  std::vector<uint8_t> level(pixels, pixels + 4ull * width * height);
+  stbi_image_free(pixels);
+
+  std::vector<uint8_t> nextLevel;
+  for (uint32_t i = 0; i < mipLevels; ++i)
+  {
+    const int levelWidth = std::max(width >> i, 1);
+    const int levelHeight = std::max(height >> i, 1);
+
+    texture.levels.push_back(encode_level(level.data(), levelWidth, levelHeight, codec, workers));
+
+    if (i + 1 < mipLevels)
+    {
+      const int nextWidth = std::max(levelWidth >> 1, 1);
+      const int nextHeight = std::max(levelHeight >> 1, 1);
+
+      nextLevel.resize(4ull * nextWidth * nextHeight);
+      downsample_srgb(level.data(), levelWidth, levelHeight, nextLevel.data(), nextWidth, nextHeight);
+      level.swap(nextLevel);
+    }
+  }
+
+  if (!write_ktx2(cooked_texture_path(sourcePath, codec).string(), texture))
+  {
+    std::cout << fmt::format("WARN: Failed to write texture cache for {}\n", sourcePath);
+    return false;
+  }
+
+  const auto t2 = std::chrono::high_resolution_clock::now();
+  std::cout << fmt::format("Cooked texture [{}] with {} mips in {:.4} seconds\n", sourcePath, mipLevels, std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count() / 1000000000.0);
+
+  return true;
+}
+
+uint32_t mip_level_count(int width, int height)
+{
+  return (uint32_t)std::floor(std::log2(std::max(width, height))) + 1;
+}
+
+void downsample_srgb(const uint8_t* src, int srcWidth, int srcHeight, uint8_t* dst, int dstWidth, int dstHeight)
+{
+  static const auto [toLinear, toSrgb] = [] {
+    std::array<float, 256> decode;
+    for (int i = 0; i < 256; ++i)
+    {
+      const float c = i / 255.f;
+      decode[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+
+    std::array<uint8_t, 4096> encode;
+    for (int i = 0; i < 4096; ++i)
+    {
+      const float c = i / 4095.f;
+      const float e = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.f / 2.4f) - 0.055f;
+      encode[i] = (uint8_t)std::clamp(e * 255.f + .5f, 0.f, 255.f);
+    }
+
+    return std::pair{ decode, encode };
+  }();
+
+  for (int y = 0; y < dstHeight; ++y)
+  {
+    const int y0 = std::min(y * 2, srcHeight - 1);
+    const int y1 = std::min(y * 2 + 1, srcHeight - 1);
+
+    for (int x = 0; x < dstWidth; ++x)
+    {
+      const int x0 = std::min(x * 2, srcWidth - 1);
+      const int x1 = std::min(x * 2 + 1, srcWidth - 1);
+
+      const uint8_t* texels[4] = {
+        src + 4 * ((size_t)y0 * srcWidth + x0), src + 4 * ((size_t)y0 * srcWidth + x1),
+        src + 4 * ((size_t)y1 * srcWidth + x0), src + 4 * ((size_t)y1 * srcWidth + x1)
+      };
+
+      uint8_t* out = dst + 4 * ((size_t)y * dstWidth + x);
+
+      for (int c = 0; c < 3; ++c)
+      {
+        const float linear = (toLinear[texels[0][c]] + toLinear[texels[1][c]] + toLinear[texels[2][c]] + toLinear[texels[3][c]]) * .25f;
+        out[c] = toSrgb[(int)(linear * 4095.f + .5f)];
+      }
+
+      // Alpha is stored linearly
+      out[3] = (uint8_t)((texels[0][3] + texels[1][3] + texels[2][3] + texels[3][3] + 2) / 4);
+    }
+  }
+}
+
+void encode_bc7_block(const uint8_t* texels, uint8_t* outBlock)
+{
+  // Endpoints start at the extent of the texels along their principal axis
+  float mean[4]{};
+  for (int t = 0; t < 16; ++t)
+  {
+    for (int c = 0; c < 4; ++c)
+      mean[c] += texels[4 * t + c] / 16.f;
+  }
+
+  float covariance[4][4]{};
+  for (int t = 0; t < 16; ++t)
+  {
+    float d[4];
+    for (int c = 0; c < 4; ++c)
+      d[c] = texels[4 * t + c] - mean[c];
+
+    for (int i = 0; i < 4; ++i)
+    {
+      for (int j = 0; j < 4; ++j)
+        covariance[i][j] += d[i] * d[j];
+    }
+  }
+
+  float axis[4] = { 1.f, 1.f, 1.f, 1.f };
+  for (int iteration = 0; iteration < 8; ++iteration)
+  {
+    float next[4]{};
+    for (int i = 0; i < 4; ++i)
+    {
+      for (int j = 0; j < 4; ++j)
+        next[i] += covariance[i][j] * axis[j];
+    }
+
+    const float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+    if (length < 1e-6f)
+      break;
+
+    for (int c = 0; c < 4; ++c)
+      axis[c] = next[c] / length;
+  }
+
+  float tMin = std::numeric_limits<float>::max(), tMax = -std::numeric_limits<float>::max();
+  for (int t = 0; t < 16; ++t)
+  {
+    float projection = 0.f;
+    for (int c = 0; c < 4; ++c)
+      projection += (texels[4 * t + c] - mean[c]) * axis[c];
+
+    tMin = std::min(tMin, projection);
+    tMax = std::max(tMax, projection);
+  }
+
+  float lo[4], hi[4];
+  for (int c = 0; c < 4; ++c)
+  {
+    lo[c] = std::clamp(mean[c] + axis[c] * tMin, 0.f, 255.f);
+    hi[c] = std::clamp(mean[c] + axis[c] * tMax, 0.f, 255.f);
+  }
+
+  Bc7Endpoint e0{}, e1{};
+  uint8_t indices[16]{};
+  uint32_t bestError = UINT32_MAX;
+  try_endpoints(texels, lo, hi, e0, e1, indices, bestError);
+
+  // Refit the endpoints to the chosen weights by least squares, twice is where it stops paying off
+  for (int iteration = 0; iteration < 2 && bestError > 0; ++iteration)
+  {
+    float a = 0.f, b = 0.f, c = 0.f;
+    float x0[4]{}, x1[4]{};
+    for (int t = 0; t < 16; ++t)
+    {
+      const float w = Bc7Weights[indices[t]] / 64.f;
+      a += (1.f - w) * (1.f - w);
+      b += (1.f - w) * w;
+      c += w * w;
+
+      for (int ch = 0; ch < 4; ++ch)
+      {
+        x0[ch] += (1.f - w) * texels[4 * t + ch];
+        x1[ch] += w * texels[4 * t + ch];
+      }
+    }
+
+    const float det = a * c - b * b;
+    if (std::abs(det) < 1e-6f)
+      break;
+
+    for (int ch = 0; ch < 4; ++ch)
+    {
+      lo[ch] = std::clamp((c * x0[ch] - b * x1[ch]) / det, 0.f, 255.f);
+      hi[ch] = std::clamp((a * x1[ch] - b * x0[ch]) / det, 0.f, 255.f);
+    }
+
+    const uint32_t previousError = bestError;
+    try_endpoints(texels, lo, hi, e0, e1, indices, bestError);
+    if (bestError == previousError)
+      break;
+  }
+
+  // The first texel's index is stored without its top bit, so it has to sit in the lower half
+  if (indices[0] >= 8)
+  {
+    std::swap(e0, e1);
+    for (uint8_t& index : indices)
+      index = 15 - index;
+  }
+
+  memset(outBlock, 0, 16);
+  BitWriter writer{ .out = outBlock };
+
+  writer.write(1 << 6, 7); // Mode 6
+  for (int ch = 0; ch < 4; ++ch)
+  {
+    writer.write(e0.channels[ch], 7);
+    writer.write(e1.channels[ch], 7);
+  }
+  writer.write(e0.pbit, 1);
+  writer.write(e1.pbit, 1);
+
+  writer.write(indices[0], 3);
+  for (int t = 1; t < 16; ++t)
+    writer.write(indices[t], 4);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "core/renderer/vk_types.hpp"
+
+class ThreadPool;
+
+// Block compression the cooker can encode to. BC1 drops alpha, BC3 and BC7 keep it.
+enum class TextureCodec
+{
+  BC1,
+  BC3,
+  BC7,
+};
+
+// sRGB block format a codec's blocks are sampled as
+[[nodiscard]]
+VkFormat texture_codec_format(TextureCodec codec);
+
+[[nodiscard]]
+const char* texture_codec_name(TextureCodec codec);
+
+// Path of the cooked .ktx2 file holding sourcePath encoded with codec
+[[nodiscard]]
+std::filesystem::path cooked_texture_path(const std::string& sourcePath, TextureCodec codec);
+
+// True if the cooked file exists and is not older than its source (a missing source counts as current)
+[[nodiscard]]
+bool cooked_texture_is_current(const std::string& sourcePath, TextureCodec codec);
+
+// Loads the image, builds its full mip chain and writes every level block compressed into a KTX2 file.
+// The blocks are encoded on workers and the calling thread if workers are given, on the calling thread otherwise.
+[[nodiscard]]
+bool cook_texture(const std::string& sourcePath, TextureCodec codec, ThreadPool* workers = nullptr);
+
+[[nodiscard]]
+uint32_t mip_level_count(int width, int height);
+
+// Box filters an sRGB encoded RGBA8 level into the next one. Colour is averaged in linear space, averaging
+// the encoded values would darken every level. Odd sizes repeat their last row / column.
+void downsample_srgb(const uint8_t* src, int srcWidth, int srcHeight, uint8_t* dst, int dstWidth, int dstHeight);
+
+// BC7 mode 6 (one subset, RGBA endpoints with a p-bit each, 4 bit indices) for a 4x4 block of RGBA8 texels
+void encode_bc7_block(const uint8_t* texels, uint8_t* outBlock);
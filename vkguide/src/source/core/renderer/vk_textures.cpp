@@ -1,102 +1,181 @@
 #include <pch.hpp>
 #include "vk_textures.hpp"
 
+#include "core/filesystem/mapped_file.hpp"
 #include "core/renderer/vk_initializers.hpp"
+#include "core/renderer/vk_ktx2.hpp"
 
-namespace vkutil
+namespace
 {
-  bool load_image(VulkanRenderer& renderer, const std::string& filePath, AllocatedImage& outImage)
+  VkImageSubresourceRange color_levels(uint32_t baseLevel, uint32_t levelCount)
   {
-    std::cout << fmt::format("Loading texture: {}\n", filePath);
-    const auto t1 = std::chrono::high_resolution_clock::now();
-
-    int width, height, channels;
-
-    stbi_uc* pixels = stbi_load(filePath.c_str(), &width, &height, &channels, STBI_rgb_alpha);
-
-    if (!pixels)
-    {
-      std::cout << fmt::format("Failed to load texture file: {}\n", filePath);
-      return false;
-    }
-
-    void* pixelPtr = pixels;
-    VkDeviceSize imageSize = 4ull * width * height; // 4 = rgba
-
-    // The format R8G8B8A8 matches exactly with the pixels loaded from stb_image lib
-    VkFormat imageFormat = VK_FORMAT_R8G8B8A8_SRGB;
-
-    AllocatedBuffer staging = renderer.create_buffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
-
-    void* data;
-    vmaMapMemory(renderer.allocator, staging.alloc, &data);
-    memcpy(data, pixelPtr, imageSize);
-    vmaUnmapMemory(renderer.allocator, staging.alloc);
-
-    // Data now in staging, don't need CPU image data anymore
-    stbi_image_free(pixels);
+    return VkImageSubresourceRange{
+      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .baseMipLevel = baseLevel,
+      .levelCount = levelCount,
+      .baseArrayLayer = 0,
+      .layerCount = 1,
+    };
+  }
 
+  AllocatedImage create_image(VulkanRenderer& renderer, const DecodedImage& decoded)
+  {
     VkExtent3D imageExtent{
-      .width = (uint32_t)width,
-      .height = (uint32_t)height,
+      .width = decoded.width,
+      .height = decoded.height,
       .depth = 1
     };
 
-    auto imgInfo = vkinit::image_create_info(imageFormat, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, imageExtent);
+    VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    if (decoded.levels.size() < decoded.mipLevels)
+      usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
+    auto imgInfo = vkinit::image_create_info(decoded.format, usage, imageExtent, decoded.mipLevels);
 
-    AllocatedImage image;
+    AllocatedImage image{ .format = decoded.format, .mipLevels = decoded.mipLevels };
 
     VmaAllocationCreateInfo imgAllocInfo{
       .flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT,
       .usage = VMA_MEMORY_USAGE_AUTO,
     };
 
-    vmaCreateImage(renderer.allocator, &imgInfo, &imgAllocInfo, &image.image, &image.alloc, nullptr);
+    VK_CHECK(vmaCreateImage(renderer.allocator, &imgInfo, &imgAllocInfo, &image.image, &image.alloc, nullptr));
+
+    return image;
+  }
 
-    renderer.immediate_submit([=](VkCommandBuffer cmd){
-      VkImageSubresourceRange range{
-        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-        .baseMipLevel = 0,
-        .levelCount = 1,
-        .baseArrayLayer = 0,
-        .layerCount = 1,
-      };
+  // Bytes the decoded levels take up in staging
+  VkDeviceSize staging_size(const DecodedImage& decoded)
+  {
+    VkDeviceSize size = 0;
+    for (const std::vector<uint8_t>& level : decoded.levels)
+      size += level.size();
+    return size;
+  }
 
-      VkImageMemoryBarrier copyBarrier{
-        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-        .pNext = nullptr,
+  // Enqueues copies of the decoded levels from staging, which holds them back to back from stagingOffset, blits
+  // for the rest of the mip chain and barriers leaving every level shader readable
+  void record_image_upload(UploadBatch& batch, const AllocatedImage& image, const DecodedImage& decoded, VkBuffer staging, VkDeviceSize stagingOffset)
+  {
+    const uint32_t width = decoded.width;
+    const uint32_t height = decoded.height;
+    const uint32_t mipLevels = decoded.mipLevels;
+    const uint32_t copiedLevels = (uint32_t)decoded.levels.size();
+    const bool blitMips = copiedLevels < mipLevels;
 
-        .srcAccessMask = 0,
-        .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+    VkImageMemoryBarrier copyBarrier{
+      .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+      .pNext = nullptr,
 
-        .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-        .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        .image = image.image,
-        .subresourceRange = range,
-      };
+      .srcAccessMask = 0,
+      .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+
+      .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+      .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      .image = image.image,
+      .subresourceRange = color_levels(0, mipLevels),
+    };
 
-      vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &copyBarrier);
+    batch.barrier_before_copies(copyBarrier);
 
-      // Now that our barrier that sets the layout of the image correctly, let's now receive the pixel data from the buffer
-      VkBufferImageCopy copyRegion{
-        .bufferOffset = 0,
+    // Now that our barrier that sets the layout of the image correctly, let's now receive the pixel data from the buffer
+    VkDeviceSize levelOffset = stagingOffset;
+    for (uint32_t level = 0; level < copiedLevels; ++level)
+    {
+      batch.copy_buffer_to_image(staging, image.image, VkBufferImageCopy{
+        .bufferOffset = levelOffset,
         .bufferRowLength = 0,
         .bufferImageHeight = 0,
 
         .imageSubresource{
           .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-          .mipLevel = 0,
+          .mipLevel = level,
           .baseArrayLayer = 0,
           .layerCount = 1,
         },
-        .imageExtent = imageExtent
-      };
+        .imageExtent{
+          .width = std::max(width >> level, 1u),
+          .height = std::max(height >> level, 1u),
+          .depth = 1
+        }
+      });
+
+      levelOffset += decoded.levels[level].size();
+    }
 
-      vkCmdCopyBufferToImage(cmd, staging.buffer, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+    // Each level is filled from the one above, which is then done and made shader readable
+    if (blitMips)
+    {
+      batch.after_copies([image = image.image, width, height, copiedLevels, mipLevels](VkCommandBuffer cmd) {
+        for (uint32_t level = copiedLevels; level < mipLevels; ++level)
+        {
+          VkImageMemoryBarrier srcBarrier{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .pNext = nullptr,
+
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+
+            .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            .image = image,
+            .subresourceRange = color_levels(level - 1, 1),
+          };
+
+          vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &srcBarrier);
+
+          VkImageBlit blit{
+            .srcSubresource{
+              .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+              .mipLevel = level - 1,
+              .baseArrayLayer = 0,
+              .layerCount = 1,
+            },
+            .srcOffsets{ { 0, 0, 0 }, { (int32_t)std::max(width >> (level - 1), 1u), (int32_t)std::max(height >> (level - 1), 1u), 1 } },
+            .dstSubresource{
+              .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+              .mipLevel = level,
+              .baseArrayLayer = 0,
+              .layerCount = 1,
+            },
+            .dstOffsets{ { 0, 0, 0 }, { (int32_t)std::max(width >> level, 1u), (int32_t)std::max(height >> level, 1u), 1 } },
+          };
+
+          vkCmdBlitImage(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+          VkImageMemoryBarrier readBarrier{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .pNext = nullptr,
 
-      // Now that the image data has been transferred, set the image layout one more time to make it shader readable
+            .srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+
+            .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            .newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            .image = image,
+            .subresourceRange = srcBarrier.subresourceRange,
+          };
+
+          vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &readBarrier);
+        }
+      });
+    }
+
+    // Now that the image data has been transferred, set the image layout one more time to make it shader readable.
+    // That is every copied level that was not a blit source, plus the last level.
+    std::vector<VkImageSubresourceRange> writtenLevels;
+    if (!blitMips)
+      writtenLevels.push_back(color_levels(0, mipLevels));
+    else
+    {
+      if (copiedLevels > 1)
+        writtenLevels.push_back(color_levels(0, copiedLevels - 1));
+      writtenLevels.push_back(color_levels(mipLevels - 1, 1));
+    }
 
-      VkImageMemoryBarrier imageBarrier{
+    for (const VkImageSubresourceRange& range : writtenLevels)
+    {
+      batch.barrier_after_copies(VkImageMemoryBarrier{
         .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
         .pNext = nullptr,
 
@@ -107,18 +186,325 @@ namespace vkutil
         .newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
         .image = image.image,
         .subresourceRange = range,
-      };
+      }, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+    }
+  }
 
-      vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
-    });
+  // Stages every decoded image that has data in one region and enqueues its upload into batch.
+  // Images without data come back with a null handle.
+  std::vector<AllocatedImage> upload_images(VulkanRenderer& renderer, const std::vector<DecodedImage>& decoded, UploadBatch& batch, VkDeviceSize& outStagingBytes)
+  {
+    // Images start 16 byte aligned in staging, enough for any texel block size
+    constexpr VkDeviceSize StagingAlignment = 16;
+
+    std::vector<VkDeviceSize> stagingOffsets(decoded.size());
+    VkDeviceSize stagingSize = 0;
+    for (size_t i = 0; i < decoded.size(); ++i)
+    {
+      stagingOffsets[i] = stagingSize;
+      stagingSize = (stagingSize + staging_size(decoded[i]) + StagingAlignment - 1) / StagingAlignment * StagingAlignment;
+    }
+
+    outStagingBytes = stagingSize;
+
+    std::vector<AllocatedImage> images(decoded.size(), AllocatedImage{ .image = VK_NULL_HANDLE, .alloc = nullptr });
+    if (stagingSize == 0)
+      return images;
+
+    StagingRegion staging = renderer.get_staging().allocate(stagingSize, StagingAlignment);
+    for (size_t i = 0; i < decoded.size(); ++i)
+    {
+      VkDeviceSize offset = stagingOffsets[i];
+      for (const std::vector<uint8_t>& level : decoded[i].levels)
+      {
+        memcpy(staging.data + offset, level.data(), level.size());
+        offset += level.size();
+      }
+    }
 
-    vmaDestroyBuffer(renderer.allocator, staging.buffer, staging.alloc);
+    for (size_t i = 0; i < decoded.size(); ++i)
+    {
+      if (!decoded[i].levels.empty())
+        images[i] = create_image(renderer, decoded[i]);
+    }
+
+    for (size_t i = 0; i < decoded.size(); ++i)
+    {
+      if (images[i].image != VK_NULL_HANDLE)
+        record_image_upload(batch, images[i], decoded[i], staging.buffer, staging.offset + stagingOffsets[i]);
+    }
+
+    return images;
+  }
+
+  bool can_sample(VulkanRenderer& renderer, VkFormat format)
+  {
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(renderer.get_gpu(), format, &formatProperties);
+    return (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+  }
+
+  // Whether the GPU can create a sampled image of that size and level count, vmaCreateImage fails otherwise
+  bool fits_device(VulkanRenderer& renderer, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels)
+  {
+    VkImageFormatProperties properties;
+    const VkResult result = vkGetPhysicalDeviceImageFormatProperties(renderer.get_gpu(), format, VK_IMAGE_TYPE_2D, VK_IMAGE_TILING_OPTIMAL,
+      VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, 0, &properties);
+
+    return result == VK_SUCCESS && width <= properties.maxExtent.width && height <= properties.maxExtent.height && mipLevels <= properties.maxMipLevels;
+  }
+
+  // Decodes with stb_image into RGBA8. Only level 0 is kept when the GPU can blit the mips, the CPU builds the
+  // whole chain otherwise.
+  bool decode_png(VulkanRenderer& renderer, const std::string& filePath, DecodedImage& outImage)
+  {
+    int width, height, channels;
+
+    stbi_uc* pixels = stbi_load(filePath.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+
+    if (!pixels)
+    {
+      std::cout << fmt::format("Failed to load texture file: {}\n", filePath);
+      return false;
+    }
+
+    // The format R8G8B8A8 matches exactly with the pixels loaded from stb_image lib
+    outImage.format = VK_FORMAT_R8G8B8A8_SRGB;
+    outImage.width = (uint32_t)width;
+    outImage.height = (uint32_t)height;
+    outImage.mipLevels = mip_level_count(width, height);
+
+    // Mips are blitted from each other on the GPU, unless the format can't be linearly filtered there
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(renderer.get_gpu(), outImage.format, &formatProperties);
+
+    constexpr VkFormatFeatureFlags BlitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    const bool gpuMips = (formatProperties.optimalTilingFeatures & BlitFeatures) == BlitFeatures;
+
+    outImage.levels.resize(gpuMips ? 1 : outImage.mipLevels);
+    outImage.levels[0].assign(pixels, pixels + 4ull * width * height); // 4 = rgba
+
+    // Data now copied, don't need stb's image data anymore
+    stbi_image_free(pixels);
+
+    for (uint32_t level = 1; level < outImage.levels.size(); ++level)
+    {
+      const int srcWidth = std::max(width >> (level - 1), 1);
+      const int srcHeight = std::max(height >> (level - 1), 1);
+      const int dstWidth = std::max(width >> level, 1);
+      const int dstHeight = std::max(height >> level, 1);
+
+      outImage.levels[level].resize(4ull * dstWidth * dstHeight);
+      downsample_srgb(outImage.levels[level - 1].data(), srcWidth, srcHeight, outImage.levels[level].data(), dstWidth, dstHeight);
+    }
+
+    return true;
+  }
+
+  // Reads every level stored in a KTX2 file, fails if the GPU can't sample its format
+  bool decode_ktx2(VulkanRenderer& renderer, const std::string& filePath, DecodedImage& outImage)
+  {
+    MappedFile file;
+    if (!file.open(filePath))
+    {
+      std::cout << fmt::format("Failed to load texture file: {}\n", filePath);
+      return false;
+    }
+
+    std::vector<Ktx2Level> levels;
+    if (!parse_ktx2(file, outImage.format, outImage.width, outImage.height, levels))
+    {
+      std::cout << fmt::format("Unsupported or corrupt KTX2 file: {}\n", filePath);
+      return false;
+    }
+
+    if (!can_sample(renderer, outImage.format))
+    {
+      std::cout << fmt::format("The GPU can't sample the format ({}) of {}\n", (int)outImage.format, filePath);
+      return false;
+    }
+
+    if (!fits_device(renderer, outImage.format, outImage.width, outImage.height, (uint32_t)levels.size()))
+    {
+      std::cout << fmt::format("The GPU can't create a {}x{} image with {} levels for {}\n", outImage.width, outImage.height, levels.size(), filePath);
+      return false;
+    }
+
+    outImage.mipLevels = (uint32_t)levels.size();
+    outImage.levels.resize(levels.size());
+    for (size_t level = 0; level < levels.size(); ++level)
+      outImage.levels[level].assign(file.data() + levels[level].offset, file.data() + levels[level].offset + levels[level].size);
+
+    return true;
+  }
+
+  // Block compressed through the texture cache when a codec is given and the GPU supports BC, RGBA8 otherwise.
+  // Cooking splits its blocks over workers if any are given.
+  bool decode_texture(VulkanRenderer& renderer, const std::string& filePath, std::optional<TextureCodec> codec, DecodedImage& outImage, ThreadPool* workers)
+  {
+    if (!codec)
+      return decode_png(renderer, filePath, outImage);
+
+    if (!renderer.supports_bc_textures())
+    {
+      std::cout << fmt::format("No BC texture support, loading {} as RGBA8\n", filePath);
+      return decode_png(renderer, filePath, outImage);
+    }
+
+    if (!cooked_texture_is_current(filePath, *codec) && !cook_texture(filePath, *codec, workers))
+      return decode_png(renderer, filePath, outImage);
+
+    DecodedImage cooked;
+    if (decode_ktx2(renderer, cooked_texture_path(filePath, *codec).string(), cooked))
+    {
+      outImage = std::move(cooked);
+      return true;
+    }
+
+    return decode_png(renderer, filePath, outImage);
+  }
+
+  double seconds_between(std::chrono::high_resolution_clock::time_point t1, std::chrono::high_resolution_clock::time_point t2)
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count() / 1000000000.0;
+  }
+
+  // Decodes and stages a single texture, reporting how long it took. With submit set the batch is submitted
+  // here too, image batches go through immediate_submit so the upload time includes waiting for its fence.
+  bool load_single(VulkanRenderer& renderer, const std::string& filePath, AllocatedImage& outImage, UploadBatch& batch, bool submit,
+    const std::function<bool(DecodedImage&)>& decode)
+  {
+    std::cout << fmt::format("Loading texture: {}\n", filePath);
+    const auto t1 = std::chrono::high_resolution_clock::now();
+
+    std::vector<DecodedImage> decoded(1);
+    if (!decode(decoded[0]))
+      return false;
 
-    outImage = image;
-    
     const auto t2 = std::chrono::high_resolution_clock::now();
-    std::cout << fmt::format("Successfully loaded texture [{}] in {:.4} seconds\n", filePath, std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count() / 1000000000.0);
+
+    VkDeviceSize stagingBytes;
+    outImage = upload_images(renderer, decoded, batch, stagingBytes)[0];
+
+    const auto t3 = std::chrono::high_resolution_clock::now();
+
+    if (!submit)
+    {
+      std::cout << fmt::format("Successfully staged texture [{}] with {} mips ({:.1f} MB): decode {:.4} seconds, staging {:.4} seconds\n", filePath, decoded[0].mipLevels,
+        stagingBytes / (1024.0 * 1024.0), seconds_between(t1, t2), seconds_between(t2, t3));
+      return true;
+    }
+
+    renderer.submit_uploads(batch);
+
+    const auto t4 = std::chrono::high_resolution_clock::now();
+    std::cout << fmt::format("Successfully loaded texture [{}] with {} mips ({:.1f} MB): decode {:.4} seconds, staging {:.4} seconds, upload {:.4} seconds\n", filePath,
+      decoded[0].mipLevels, stagingBytes / (1024.0 * 1024.0), seconds_between(t1, t2), seconds_between(t2, t3), seconds_between(t3, t4));
 
     return true;
   }
+
+  // Decodes the files in parallel and stages all of them in one region, reporting how long each step took.
+  // submit works as for load_single.
+  std::vector<AllocatedImage> load_batch(VulkanRenderer& renderer, const std::vector<vkutil::TextureRequest>& requests, UploadBatch& batch, bool submit)
+  {
+    const auto t1 = std::chrono::high_resolution_clock::now();
+
+    std::vector<DecodedImage> decoded(requests.size());
+
+    // Decoding is independent per file, so every file gets a job on the asset workers. Cooking shares them out
+    // further, block rows of one file go to whichever workers the other files left idle. The upload needs them all.
+    ThreadPool& workers = renderer.get_asset_workers();
+    workers.parallel_for((uint32_t)requests.size(), [&](uint32_t i) {
+      if (!decode_texture(renderer, requests[i].filePath, requests[i].codec, decoded[i], &workers))
+        decoded[i] = {};
+    });
+
+    const auto t2 = std::chrono::high_resolution_clock::now();
+
+    VkDeviceSize stagingBytes;
+    std::vector<AllocatedImage> images = upload_images(renderer, decoded, batch, stagingBytes);
+
+    const auto t3 = std::chrono::high_resolution_clock::now();
+
+    const size_t loaded = std::count_if(images.begin(), images.end(), [](const AllocatedImage& image) { return image.image != VK_NULL_HANDLE; });
+    if (!submit)
+    {
+      std::cout << fmt::format("Staged {}/{} textures ({:.1f} MB): decode {:.4} seconds, staging {:.4} seconds\n", loaded, requests.size(), stagingBytes / (1024.0 * 1024.0),
+        seconds_between(t1, t2), seconds_between(t2, t3));
+      return images;
+    }
+
+    renderer.submit_uploads(batch);
+
+    const auto t4 = std::chrono::high_resolution_clock::now();
+    std::cout << fmt::format("Loaded {}/{} textures ({:.1f} MB): decode {:.4} seconds, staging {:.4} seconds, upload {:.4} seconds\n", loaded, requests.size(),
+      stagingBytes / (1024.0 * 1024.0), seconds_between(t1, t2), seconds_between(t2, t3), seconds_between(t3, t4));
+
+    return images;
+  }
+}
+
+namespace vkutil
+{
+  bool load_image(VulkanRenderer& renderer, const std::string& filePath, AllocatedImage& outImage, UploadBatch& batch)
+  {
+    return load_single(renderer, filePath, outImage, batch, false, [&](DecodedImage& decoded) { return decode_png(renderer, filePath, decoded); });
+  }
+
+  bool load_image(VulkanRenderer& renderer, const std::string& filePath, AllocatedImage& outImage)
+  {
+    UploadBatch batch;
+    return load_single(renderer, filePath, outImage, batch, true, [&](DecodedImage& decoded) { return decode_png(renderer, filePath, decoded); });
+  }
+
+  bool load_ktx2_image(VulkanRenderer& renderer, const std::string& filePath, AllocatedImage& outImage, UploadBatch& batch)
+  {
+    return load_single(renderer, filePath, outImage, batch, false, [&](DecodedImage& decoded) { return decode_ktx2(renderer, filePath, decoded); });
+  }
+
+  bool load_ktx2_image(VulkanRenderer& renderer, const std::string& filePath, AllocatedImage& outImage)
+  {
+    UploadBatch batch;
+    return load_single(renderer, filePath, outImage, batch, true, [&](DecodedImage& decoded) { return decode_ktx2(renderer, filePath, decoded); });
+  }
+
+  bool load_cooked_image(VulkanRenderer& renderer, const std::string& filePath, TextureCodec codec, AllocatedImage& outImage, UploadBatch& batch)
+  {
+    return load_single(renderer, filePath, outImage, batch, false,
+      [&](DecodedImage& decoded) { return decode_texture(renderer, filePath, codec, decoded, &renderer.get_asset_workers()); });
+  }
+
+  bool load_cooked_image(VulkanRenderer& renderer, const std::string& filePath, TextureCodec codec, AllocatedImage& outImage)
+  {
+    UploadBatch batch;
+    return load_single(renderer, filePath, outImage, batch, true,
+      [&](DecodedImage& decoded) { return decode_texture(renderer, filePath, codec, decoded, &renderer.get_asset_workers()); });
+  }
+
+  std::vector<AllocatedImage> load_images(VulkanRenderer& renderer, const std::vector<TextureRequest>& requests)
+  {
+    UploadBatch batch;
+    return load_batch(renderer, requests, batch, true);
+  }
+
+  std::vector<AllocatedImage> load_images(VulkanRenderer& renderer, const std::vector<TextureRequest>& requests, UploadBatch& batch)
+  {
+    return load_batch(renderer, requests, batch, false);
+  }
+
+  bool decode_image(VulkanRenderer& renderer, const TextureRequest& request, DecodedImage& outImage, ThreadPool* workers)
+  {
+    if (decode_texture(renderer, request.filePath, request.codec, outImage, workers))
+      return true;
+
+    outImage = {};
+    return false;
+  }
+
+  std::vector<AllocatedImage> upload_decoded(VulkanRenderer& renderer, const std::vector<DecodedImage>& decoded, UploadBatch& batch)
+  {
+    VkDeviceSize stagingBytes;
+    return upload_images(renderer, decoded, batch, stagingBytes);
+  }
 }
@@ -1,8 +1,53 @@
 #include "core/renderer/vk_renderer.hpp"
+#include "core/renderer/vk_texture_cooker.hpp"
 #include "core/renderer/vk_types.hpp"
 
 namespace vkutil
 {
+  struct TextureRequest
+  {
+    std::string filePath;
+    // Block compressed through the texture cache (see load_cooked_image), RGBA8 if empty
+    std::optional<TextureCodec> codec;
+  };
+
+  // The overloads taking an UploadBatch only enqueue the upload, the image is usable once the caller has
+  // submitted the batch with VulkanRenderer::submit_uploads. The others submit on their own and wait, the upload
+  // time they report includes that wait.
+
+  // Decodes with stb_image into RGBA8 and builds the mip chain on upload
   [[nodiscard]]
   bool load_image(VulkanRenderer& renderer, const std::string& filePath, AllocatedImage& outImage);
+  [[nodiscard]]
+  bool load_image(VulkanRenderer& renderer, const std::string& filePath, AllocatedImage& outImage, UploadBatch& batch);
+
+  // Uploads every level stored in a KTX2 file as is, fails if the GPU can't sample its format
+  [[nodiscard]]
+  bool load_ktx2_image(VulkanRenderer& renderer, const std::string& filePath, AllocatedImage& outImage);
+  [[nodiscard]]
+  bool load_ktx2_image(VulkanRenderer& renderer, const std::string& filePath, AllocatedImage& outImage, UploadBatch& batch);
+
+  // Loads the block compressed version of filePath, cooking it first if the cached one is missing or stale.
+  // Falls back to load_image when the GPU has no BC support or the cooked file can't be used.
+  [[nodiscard]]
+  bool load_cooked_image(VulkanRenderer& renderer, const std::string& filePath, TextureCodec codec, AllocatedImage& outImage);
+  [[nodiscard]]
+  bool load_cooked_image(VulkanRenderer& renderer, const std::string& filePath, TextureCodec codec, AllocatedImage& outImage, UploadBatch& batch);
+
+  // Decodes the files in parallel, then stages all of them in one region.
+  // Returns an image per request, the ones that failed to load have a null handle.
+  [[nodiscard]]
+  std::vector<AllocatedImage> load_images(VulkanRenderer& renderer, const std::vector<TextureRequest>& requests);
+  [[nodiscard]]
+  std::vector<AllocatedImage> load_images(VulkanRenderer& renderer, const std::vector<TextureRequest>& requests, UploadBatch& batch);
+
+  // The decoding half of the loads above, safe to call from any thread. outImage is left empty on failure.
+  // Cooking splits its blocks over workers if any are given.
+  [[nodiscard]]
+  bool decode_image(VulkanRenderer& renderer, const TextureRequest& request, DecodedImage& outImage, ThreadPool* workers = nullptr);
+
+  // The uploading half, on the thread recording uploads. Stages the images with data in one region and enqueues
+  // their uploads into batch, the others come back with a null handle.
+  [[nodiscard]]
+  std::vector<AllocatedImage> upload_decoded(VulkanRenderer& renderer, const std::vector<DecodedImage>& decoded, UploadBatch& batch);
 }
@@ -0,0 +1,134 @@
+#include <pch.hpp>
+#include "vk_transfer_queue.hpp"
+
+#include "core/renderer/vk_initializers.hpp"
+
+void TransferQueue::init(VkDevice device, VkQueue queue, uint32_t queueFamily, uint32_t graphicsQueueFamily)
+{
+  this->device = device;
+  this->queue = queue;
+  this->queueFamily = queueFamily;
+  this->graphicsQueueFamily = graphicsQueueFamily;
+
+  // Command buffers are short lived, one per submission and freed once it is done
+  auto poolInfo = vkinit::command_pool_create_info(queueFamily, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+
+  VK_CHECK(vkCreateCommandPool(device, &poolInfo, nullptr, &pool));
+
+  VkSemaphoreTypeCreateInfo timelineInfo{
+    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+    .pNext = nullptr,
+
+    .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+    .initialValue = 0
+  };
+
+  VkSemaphoreCreateInfo semaphoreInfo{
+    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+    .pNext = &timelineInfo,
+
+    .flags = 0
+  };
+
+  VK_CHECK(vkCreateSemaphore(device, &semaphoreInfo, nullptr, &timeline));
+}
+
+VkCommandBuffer TransferQueue::begin()
+{
+  VkCommandBuffer cmd;
+
+  auto cmdAllocInfo = vkinit::command_buffer_allocate_info(pool, 1);
+  VK_CHECK(vkAllocateCommandBuffers(device, &cmdAllocInfo, &cmd));
+
+  auto beginInfo = vkinit::command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+  VK_CHECK(vkBeginCommandBuffer(cmd, &beginInfo));
+
+  return cmd;
+}
+
+uint64_t TransferQueue::submit(VkCommandBuffer cmd, VkFence fence)
+{
+  VK_CHECK(vkEndCommandBuffer(cmd));
+
+  const uint64_t value = ++lastValue;
+
+  VkTimelineSemaphoreSubmitInfo timelineInfo{
+    .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+    .pNext = nullptr,
+
+    .waitSemaphoreValueCount = 0,
+    .pWaitSemaphoreValues = nullptr,
+    .signalSemaphoreValueCount = 1,
+    .pSignalSemaphoreValues = &value
+  };
+
+  auto submit = vkinit::submit_info(&cmd);
+  submit.pNext = &timelineInfo;
+  submit.signalSemaphoreCount = 1;
+  submit.pSignalSemaphores = &timeline;
+
+  VK_CHECK(vkQueueSubmit(queue, 1, &submit, fence));
+
+  inFlight.emplace_back(value, cmd);
+
+  return value;
+}
+
+void TransferQueue::retire()
+{
+  const uint64_t completed = get_completed_value();
+
+  while (!inFlight.empty() && inFlight.front().first <= completed)
+  {
+    vkFreeCommandBuffers(device, pool, 1, &inFlight.front().second);
+    inFlight.pop_front();
+  }
+}
+
+uint64_t TransferQueue::get_completed_value() const
+{
+  uint64_t value;
+  VK_CHECK(vkGetSemaphoreCounterValue(device, timeline, &value));
+  return value;
+}
+
+VkBufferMemoryBarrier TransferQueue::ownership_barrier(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, VkAccessFlags srcAccess, VkAccessFlags dstAccess) const
+{
+  const bool transfer = needs_ownership_transfer();
+
+  return VkBufferMemoryBarrier{
+    .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+    .pNext = nullptr,
+
+    .srcAccessMask = srcAccess,
+    .dstAccessMask = dstAccess,
+
+    .srcQueueFamilyIndex = transfer ? queueFamily : VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = transfer ? graphicsQueueFamily : VK_QUEUE_FAMILY_IGNORED,
+
+    .buffer = buffer,
+    .offset = offset,
+    .size = size
+  };
+}
+
+void TransferQueue::cleanup()
+{
+  VkSemaphoreWaitInfo waitInfo{
+    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+    .pNext = nullptr,
+
+    .flags = 0,
+    .semaphoreCount = 1,
+    .pSemaphores = &timeline,
+    .pValues = &lastValue
+  };
+
+  vkWaitSemaphores(device, &waitInfo, UINT64_MAX);
+
+  // Frees the command buffers still around along with it
+  vkDestroyCommandPool(device, pool, nullptr);
+  inFlight.clear();
+
+  vkDestroySemaphore(device, timeline, nullptr);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "core/renderer/vk_types.hpp"
+
+// Queue uploads are submitted on without waiting for them. A transfer queue family without graphics when the
+// GPU has one, so copies run alongside rendering, the graphics queue otherwise. Every submission signals the
+// next value of a timeline semaphore, which graphics submissions reading the uploaded data wait on.
+// Resources written here are released to the graphics family when the families differ, see ownership_barrier.
+class TransferQueue
+{
+public:
+  void init(VkDevice device, VkQueue queue, uint32_t queueFamily, uint32_t graphicsQueueFamily);
+
+  // Command buffer from this queue's pool, already begun
+  [[nodiscard]]
+  VkCommandBuffer begin();
+
+  // Ends and submits cmd, fence may be null. Returns the timeline value that is signaled once it is done.
+  uint64_t submit(VkCommandBuffer cmd, VkFence fence);
+
+  // Frees the command buffers of finished submissions
+  void retire();
+
+  [[nodiscard]]
+  uint64_t get_completed_value() const;
+
+  [[nodiscard]]
+  VkSemaphore get_semaphore() const { return timeline; }
+
+  [[nodiscard]]
+  uint32_t get_queue_family() const { return queueFamily; }
+
+  [[nodiscard]]
+  uint32_t get_graphics_queue_family() const { return graphicsQueueFamily; }
+
+  // Exclusive resources written here change hands with a release barrier on this queue and a matching
+  // acquire barrier on the graphics queue
+  [[nodiscard]]
+  bool needs_ownership_transfer() const { return queueFamily != graphicsQueueFamily; }
+
+  // Barrier over a range of buffer written by a transfer. With srcAccess set it makes the writes available
+  // for the graphics queue, with dstAccess set it makes them visible there. Both halves of an ownership
+  // transfer when the families differ.
+  [[nodiscard]]
+  VkBufferMemoryBarrier ownership_barrier(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, VkAccessFlags srcAccess, VkAccessFlags dstAccess) const;
+
+  // Waits for everything submitted
+  void cleanup();
+
+private:
+  VkDevice device;
+  VkQueue queue;
+  uint32_t queueFamily;
+  uint32_t graphicsQueueFamily;
+
+  VkCommandPool pool;
+  VkSemaphore timeline;
+  uint64_t lastValue = 0;
+
+  std::deque<std::pair<uint64_t, VkCommandBuffer>> inFlight;
+};
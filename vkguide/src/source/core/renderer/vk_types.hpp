@@ -12,4 +12,17 @@ struct AllocatedImage
 {
   VkImage image;
   VmaAllocation alloc;
+  VkFormat format = VK_FORMAT_UNDEFINED;
+  uint32_t mipLevels = 1;
+};
+
+// CPU side texture ready for upload. levels holds the tightly packed data of the first levels, every level
+// after those is blitted from the one above on upload.
+struct DecodedImage
+{
+  VkFormat format = VK_FORMAT_UNDEFINED;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t mipLevels = 0;
+  std::vector<std::vector<uint8_t>> levels;
 };
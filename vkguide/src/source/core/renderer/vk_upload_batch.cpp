@@ -0,0 +1,89 @@
+#include <pch.hpp>
+#include "vk_upload_batch.hpp"
+
+void UploadBatch::copy_buffer(VkBuffer src, VkBuffer dst, const VkBufferCopy& region)
+{
+  bufferCopies[{ src, dst }].push_back(region);
+  ++copyCount;
+}
+
+void UploadBatch::copy_buffer_to_image(VkBuffer src, VkImage dst, const VkBufferImageCopy& region)
+{
+  imageCopies[{ src, dst }].push_back(region);
+  ++copyCount;
+}
+
+void UploadBatch::barrier_before_copies(const VkImageMemoryBarrier& barrier)
+{
+  preImageBarriers.push_back(barrier);
+}
+
+void UploadBatch::barrier_after_copies(const VkBufferMemoryBarrier& barrier, VkPipelineStageFlags dstStages)
+{
+  postBufferBarriers.push_back(barrier);
+  postDstStages |= dstStages;
+}
+
+void UploadBatch::barrier_after_copies(const VkImageMemoryBarrier& barrier, VkPipelineStageFlags dstStages)
+{
+  postImageBarriers.push_back(barrier);
+  postDstStages |= dstStages;
+}
+
+void UploadBatch::after_copies(std::function<void(VkCommandBuffer)>&& commands)
+{
+  this->commands.push_back(std::move(commands));
+}
+
+void UploadBatch::record(VkCommandBuffer cmd) const
+{
+  if (!preImageBarriers.empty())
+  {
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr,
+      (uint32_t)preImageBarriers.size(), preImageBarriers.data());
+  }
+
+  for (const auto& [buffers, regions] : bufferCopies)
+    vkCmdCopyBuffer(cmd, buffers.first, buffers.second, (uint32_t)regions.size(), regions.data());
+
+  for (const auto& [resources, regions] : imageCopies)
+    vkCmdCopyBufferToImage(cmd, resources.first, resources.second, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32_t)regions.size(), regions.data());
+
+  for (const auto& command : commands)
+    command(cmd);
+
+  if (!postBufferBarriers.empty() || !postImageBarriers.empty())
+  {
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, postDstStages, 0, 0, nullptr,
+      (uint32_t)postBufferBarriers.size(), postBufferBarriers.data(),
+      (uint32_t)postImageBarriers.size(), postImageBarriers.data());
+  }
+}
+
+UploadBatch UploadBatch::split_graphics()
+{
+  UploadBatch graphics;
+
+  for (const auto& [resources, regions] : imageCopies)
+    graphics.copyCount += (uint32_t)regions.size();
+  copyCount -= graphics.copyCount;
+
+  graphics.imageCopies = std::move(imageCopies);
+  graphics.preImageBarriers = std::move(preImageBarriers);
+  graphics.commands = std::move(commands);
+  graphics.postImageBarriers = std::move(postImageBarriers);
+  graphics.postDstStages = postDstStages;
+
+  imageCopies.clear();
+  preImageBarriers.clear();
+  commands.clear();
+  postImageBarriers.clear();
+
+  return graphics;
+}
+
+bool UploadBatch::empty() const
+{
+  return bufferCopies.empty() && imageCopies.empty() && commands.empty() && preImageBarriers.empty()
+    && postBufferBarriers.empty() && postImageBarriers.empty();
+}
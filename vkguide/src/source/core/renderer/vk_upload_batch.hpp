@@ -0,0 +1,61 @@
+#pragma once
+
+#include "core/renderer/vk_types.hpp"
+
+// Copies and barriers of any number of uploads, recorded into one command buffer and submitted once through
+// VulkanRenderer::submit_uploads. Copies between the same two resources are merged into one command.
+// Recorded as: barriers before the copies, buffer copies, image copies, commands added with after_copies in
+// the order they were added, then the barriers after the copies.
+// Staging for a batch comes from the renderer's StagingRing, whose regions are reclaimed in submission order,
+// so submit a batch before staging anything for the next one.
+class UploadBatch
+{
+public:
+  void copy_buffer(VkBuffer src, VkBuffer dst, const VkBufferCopy& region);
+
+  // dst has to be in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL by then, see barrier_before_copies
+  void copy_buffer_to_image(VkBuffer src, VkImage dst, const VkBufferImageCopy& region);
+
+  // Executes before any copy, typically moving images into the transfer destination layout
+  void barrier_before_copies(const VkImageMemoryBarrier& barrier);
+
+  // Execute after every copy and after_copies command, dstStages are the stages that wait for them
+  void barrier_after_copies(const VkBufferMemoryBarrier& barrier, VkPipelineStageFlags dstStages);
+  void barrier_after_copies(const VkImageMemoryBarrier& barrier, VkPipelineStageFlags dstStages);
+
+  // Commands depending on the copies, like generating mips from a copied level. They need the graphics queue.
+  void after_copies(std::function<void(VkCommandBuffer)>&& commands);
+
+  void record(VkCommandBuffer cmd) const;
+
+  // Moves the image copies, image barriers and after_copies commands into a batch of their own and returns it,
+  // this one keeps the buffer copies and barriers
+  [[nodiscard]]
+  UploadBatch split_graphics();
+
+  [[nodiscard]]
+  bool empty() const;
+
+  // Image layouts and mip blits are not handed between queue families, batches with those stay on the graphics queue
+  [[nodiscard]]
+  bool needs_graphics_queue() const { return !imageCopies.empty() || !commands.empty(); }
+
+  [[nodiscard]]
+  bool has_buffer_copies() const { return !bufferCopies.empty() || !postBufferBarriers.empty(); }
+
+  [[nodiscard]]
+  uint32_t get_copy_count() const { return copyCount; }
+
+private:
+  std::map<std::pair<VkBuffer, VkBuffer>, std::vector<VkBufferCopy>> bufferCopies;
+  std::map<std::pair<VkBuffer, VkImage>, std::vector<VkBufferImageCopy>> imageCopies;
+  uint32_t copyCount = 0;
+
+  std::vector<VkImageMemoryBarrier> preImageBarriers;
+
+  std::vector<std::function<void(VkCommandBuffer)>> commands;
+
+  std::vector<VkBufferMemoryBarrier> postBufferBarriers;
+  std::vector<VkImageMemoryBarrier> postImageBarriers;
+  VkPipelineStageFlags postDstStages = 0;
+};
@@ -0,0 +1,92 @@
+#include <pch.hpp>
+#include "thread_pool.hpp"
+
+void ThreadPool::init(uint32_t threadCount)
+{
+  stopping = false;
+
+  workers.reserve(threadCount);
+  for (uint32_t i = 0; i < threadCount; ++i)
+    workers.emplace_back([this] { worker_loop(); });
+}
+
+void ThreadPool::submit(std::function<void()>&& job)
+{
+  {
+    std::lock_guard lock{ mutex };
+    jobs.push_back(std::move(job));
+  }
+
+  wake.notify_one();
+}
+
+void ThreadPool::parallel_for(uint32_t count, const std::function<void(uint32_t)>& func)
+{
+  // Owned by the helper jobs as well, ones starting after this returned find no index left and never touch func
+  struct Shared
+  {
+    std::atomic<uint32_t> next{ 0 };
+    std::atomic<uint32_t> finished{ 0 };
+    uint32_t count = 0;
+    const std::function<void(uint32_t)>* func = nullptr;
+  };
+
+  auto shared = std::make_shared<Shared>();
+  shared->count = count;
+  shared->func = &func;
+
+  auto run = [](Shared& s) {
+    for (uint32_t i = s.next++; i < s.count; i = s.next++)
+    {
+      (*s.func)(i);
+      if (++s.finished == s.count)
+        s.finished.notify_all();
+    }
+  };
+
+  const uint32_t helpers = std::min(count > 0 ? count - 1 : 0, get_thread_count());
+  for (uint32_t i = 0; i < helpers; ++i)
+    submit([shared, run] { run(*shared); });
+
+  run(*shared);
+
+  // Only indices already running on a worker are left
+  for (uint32_t finished = shared->finished; finished < count; finished = shared->finished)
+    shared->finished.wait(finished);
+}
+
+void ThreadPool::cleanup()
+{
+  {
+    std::lock_guard lock{ mutex };
+    stopping = true;
+    jobs.clear();
+  }
+
+  wake.notify_all();
+
+  for (std::thread& worker : workers)
+    worker.join();
+  workers.clear();
+}
+
+void ThreadPool::worker_loop()
+{
+  while (true)
+  {
+    std::function<void()> job;
+
+    {
+      std::unique_lock lock{ mutex };
+      wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+
+      if (stopping)
+        return;
+
+      job = std::move(jobs.front());
+      jobs.pop_front();
+    }
+
+    job();
+  }
+}
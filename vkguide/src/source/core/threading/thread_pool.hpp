@@ -0,0 +1,30 @@
+#pragma once
+
+// Fixed set of worker threads running submitted jobs in submission order
+class ThreadPool
+{
+public:
+  void init(uint32_t threadCount);
+
+  void submit(std::function<void()>&& job);
+
+  // Runs func for every index in [0, count) on the workers and the calling thread, returns once all of them ran.
+  // The caller claims indices too rather than waiting on queued jobs, so jobs of this pool may call it.
+  void parallel_for(uint32_t count, const std::function<void(uint32_t)>& func);
+
+  // Jobs that have not started yet are dropped, running ones are waited on
+  void cleanup();
+
+  [[nodiscard]]
+  uint32_t get_thread_count() const { return (uint32_t)workers.size(); }
+
+private:
+  void worker_loop();
+
+  std::vector<std::thread> workers;
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::deque<std::function<void()>> jobs;
+  bool stopping = false;
+};
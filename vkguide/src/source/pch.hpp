@@ -27,6 +27,7 @@
 
 // stb
 #include <stb_image.h>
+#include <stb_dxt.h>
 
 // tiny obj loader
 #include <tiny_obj_loader.h>
@@ -48,16 +49,24 @@
 #include <algorithm>
 #include <any>
 #include <array>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <deque>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <latch>
+#include <limits>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
 #include <optional>
 #include <queue>
 #include <random>